@@ -0,0 +1,530 @@
+/* conn_util.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* POSIX headers */
+
+/* Local headers */
+#include "conn_util.h"
+
+/* Macros */
+/* most free buffers of each size kept for reuse, beyond are free()d */
+#ifndef POOL_KEEP_SMALL
+#define POOL_KEEP_SMALL 32
+#endif
+#ifndef POOL_KEEP_LARGE
+#define POOL_KEEP_LARGE 4
+#endif
+
+/* first table size, it doubles when a descriptor is past its end */
+#ifndef CONN_TABINIT
+#define CONN_TABINIT 64
+#endif
+
+/* File scope variables */
+static EVNT_LOCAL unsigned int active_count = 0; /* HTTP connections, not listen */
+
+/* External variables */
+/* External functions */
+
+/* Structures and unions */
+
+/* each worker thread has its own table and pools */
+
+/* conn_tab is indexed directly by file descriptor */
+/*  and grows when the kernel hands out a larger descriptor */
+/*  entries are allocated one by one, so they do not move when it grows */
+/*  and timers linked into them stay valid */
+static EVNT_LOCAL struct conn_struct **conn_tab = NULL;
+static EVNT_LOCAL unsigned int conn_tab_size = 0;
+
+/* read buffer pool, one free list per buffer size */
+/*  a free buffer's first bytes link it to the next */
+/*  buffers are only held while a request is being read */
+struct pool_struct {
+ unsigned int size;
+ unsigned int keep;
+ unsigned int free_count;
+ void *free_list;
+};
+static EVNT_LOCAL struct pool_struct pool_small = { SBUFSIZE, POOL_KEEP_SMALL, 0, NULL };
+static EVNT_LOCAL struct pool_struct pool_large = { RBUFSIZE, POOL_KEEP_LARGE, 0, NULL };
+
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/****************/
+/* conn_clear() */
+/****************/
+static void
+conn_clear(
+ struct conn_struct *c)
+{
+  c->fd = (-1);
+  c->kind = CONN_FREE;
+  c->poll_slot = (-1);
+  c->ring_events = 0;
+  c->ring_armed = 0;
+  c->ring_gen = 0;
+  c->pos = 0;
+  c->cap = 0;
+  c->buf = NULL;
+  memset(&(c->req), 0, sizeof(c->req));
+  c->sse_sub = NULL;
+  c->sse_frame = NULL;
+  c->sse_sent = 0;
+  c->sse_last = 0;
+  c->sse_live = 0;
+  c->flags = 0;
+  c->out_policy = 0;
+  c->out_errno = 0;
+  c->out = NULL;
+  c->out_off = 0;
+  c->out_frame = 0;
+  c->out_len = 0;
+  c->out_cap = 0;
+  c->ref = NULL;
+  c->ref_len = 0;
+  c->ref_done = NULL;
+  c->ref_arg = NULL;
+  evnt_timer_init(&(c->timer), NULL, NULL);
+}
+
+
+/**************/
+/* pool_get() */
+/**************/
+/* return: buffer of p->size bytes, NULL on error */
+static char *
+pool_get(
+ struct pool_struct *p)
+{
+void *b = NULL;
+
+  if (p->free_list != NULL) {
+    b = p->free_list;
+    p->free_list = *(void **)b;
+    p->free_count -= 1;
+    return((char *)b);
+  }
+
+  b = malloc(p->size);
+  if (b == NULL) {
+    fprintf(stderr, "pool_get: malloc() error\n");
+  }
+
+  return((char *)b);
+}
+
+
+/**************/
+/* pool_put() */
+/**************/
+static void
+pool_put(
+ struct pool_struct *p,
+ char *in_buf)
+{
+  if (p->free_count >= p->keep) {
+    free(in_buf);
+    return;
+  }
+
+  *(void **)in_buf = p->free_list;
+  p->free_list = in_buf;
+  p->free_count += 1;
+}
+
+
+/****************/
+/* pool_drain() */
+/****************/
+static void
+pool_drain(
+ struct pool_struct *p)
+{
+void *b = NULL;
+
+  while (p->free_list != NULL) {
+    b = p->free_list;
+    p->free_list = *(void **)b;
+    free(b);
+  }
+  p->free_count = 0;
+}
+
+
+/***************/
+/* conn_grow() */
+/***************/
+/* make the table large enough to index in_fd */
+/* return: 0 on success, -1 error */
+static int
+conn_grow(
+ int in_fd)
+{
+struct conn_struct **t = NULL;
+unsigned int new_size = 0;
+unsigned int i = 0;
+
+  new_size = (conn_tab_size > 0) ? conn_tab_size : 1;
+  while (new_size <= in_fd) new_size *= 2;
+
+  t = realloc(conn_tab, sizeof(struct conn_struct *) * new_size);
+  if (t == NULL) {
+    fprintf(stderr, "conn_grow: realloc() error\n");
+    return(-1);
+  }
+  conn_tab = t;
+
+  for (i = conn_tab_size; i < new_size; i++) {
+    conn_tab[i] = NULL;
+  }
+  conn_tab_size = new_size;
+
+  return(0);
+}
+
+
+/***************/
+/* conn_init() */
+/***************/
+/* return: 0 on success, -1 error */
+int
+conn_init(void)
+{
+  active_count = 0;
+
+  /* room for stdio, log and listen descriptors and a few connections */
+  /*  read buffers are not allocated until a request arrives */
+  conn_tab = NULL;
+  conn_tab_size = 0;
+  if (conn_grow(CONN_TABINIT - 1) == (-1)) {
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/**************/
+/* conn_add() */
+/**************/
+/* claim the table entry for in_fd */
+/* return: pointer to entry, NULL on error */
+/*  pointer is valid until conn_rem() */
+struct conn_struct *
+conn_add(
+ int in_fd,
+ int in_kind)
+{
+struct conn_struct *c = NULL;
+
+  if (in_fd < 0) return(NULL);
+
+  if (in_fd >= conn_tab_size) {
+    if (conn_grow(in_fd) == (-1)) return(NULL);
+  }
+
+  if (conn_tab[in_fd] != NULL) {
+    fprintf(stderr, "conn_add: descriptor already in use\n");
+    return(NULL);
+  }
+
+  c = malloc(sizeof(struct conn_struct));
+  if (c == NULL) {
+    fprintf(stderr, "conn_add: malloc() error\n");
+    return(NULL);
+  }
+  conn_clear(c);
+  conn_tab[in_fd] = c;
+
+  if (in_kind == CONN_HTTP) active_count += 1;
+
+  c->fd = in_fd;
+  c->kind = in_kind;
+
+  return(c);
+}
+
+
+/**************/
+/* conn_get() */
+/**************/
+/* return: pointer to entry, NULL if in_fd not in table */
+struct conn_struct *
+conn_get(
+ int in_fd)
+{
+  if ((in_fd < 0) || (in_fd >= conn_tab_size)) return(NULL);
+
+  return(conn_tab[in_fd]);
+}
+
+
+/**************/
+/* conn_rem() */
+/**************/
+/* release entry, its buffers and its timer */
+/*  caller has already removed it from the backend and SSE map */
+/* return: 0 on success, -1 error (not found) */
+int
+conn_rem(
+ int in_fd)
+{
+struct conn_struct *c = NULL;
+
+  c = conn_get(in_fd);
+  if (c == NULL) {
+    fprintf(stderr, "conn_rem: descriptor not found\n");
+    return(-1);
+  }
+
+  conn_buf_release(c);
+  conn_out_release(c);
+  conn_ref_release(c);
+  evnt_timer_cancel(&(c->timer));
+  if (c->kind == CONN_HTTP) active_count -= 1;
+
+  conn_tab[in_fd] = NULL;
+  free(c);
+
+  return(0);
+}
+
+
+/*******************/
+/* conn_buf_room() */
+/*******************/
+/* make sure io_c has a read buffer with space left in it */
+/*  takes a small buffer first, moves to a large one when that fills */
+/*  one byte is always kept back for the terminating '\0' */
+/* return: bytes that can be read into io_c->buf at io_c->pos, */
+/*  0 when the largest buffer is full, -1 error */
+int
+conn_buf_room(
+ struct conn_struct *io_c)
+{
+char *b = NULL;
+
+  if (io_c->buf == NULL) {
+    io_c->buf = pool_get(&pool_small);
+    if (io_c->buf == NULL) return(-1);
+    io_c->cap = SBUFSIZE;
+    io_c->pos = 0;
+    io_c->buf[0] = '\0';
+  }
+
+  if ((io_c->pos + 1 >= io_c->cap) && (io_c->cap < RBUFSIZE)) {
+    b = pool_get(&pool_large);
+    if (b == NULL) return(-1);
+    memcpy(b, io_c->buf, io_c->pos);
+    pool_put(&pool_small, io_c->buf);
+    io_c->buf = b;
+    io_c->cap = RBUFSIZE;
+  }
+
+  return(io_c->cap - 1 - io_c->pos);
+}
+
+
+/**********************/
+/* conn_buf_release() */
+/**********************/
+/* hand io_c's read buffer back to the pool */
+/*  for connections that will not send another request, */
+/*  such as SSE listeners */
+void
+conn_buf_release(
+ struct conn_struct *io_c)
+{
+  if (io_c->buf != NULL) {
+    if (io_c->cap == RBUFSIZE) {
+      pool_put(&pool_large, io_c->buf);
+    } else {
+      pool_put(&pool_small, io_c->buf);
+    }
+  }
+  io_c->buf = NULL;
+  io_c->cap = 0;
+  io_c->pos = 0;
+  memset(&(io_c->req), 0, sizeof(io_c->req));
+}
+
+
+/**********************/
+/* conn_buf_consume() */
+/**********************/
+/* discard the first in_len bytes of io_c's read buffer, */
+/*  a request that has been answered, and start parsing the next */
+/*  an emptied buffer goes back to the pool, so idle */
+/*  keep-alive connections hold none */
+void
+conn_buf_consume(
+ struct conn_struct *io_c,
+ unsigned int in_len)
+{
+  if (in_len >= io_c->pos) {
+    conn_buf_release(io_c);
+    return;
+  }
+
+  /* pipelined, the next request is already here */
+  memmove(io_c->buf, &(io_c->buf[in_len]), io_c->pos - in_len);
+  io_c->pos -= in_len;
+  io_c->buf[io_c->pos] = '\0';
+  memset(&(io_c->req), 0, sizeof(io_c->req));
+}
+
+
+/*******************/
+/* conn_out_push() */
+/*******************/
+/* append in_buf to io_c's output queue */
+/*  the queue is allocated on first use and grows up to OUTQMAX */
+/* return: 0 on success, -1 over budget or error (queue unchanged) */
+int
+conn_out_push(
+ struct conn_struct *io_c,
+ const char *in_buf,
+ unsigned int in_len)
+{
+char *t = NULL;
+unsigned int need = 0;
+unsigned int new_cap = 0;
+
+  /* sent bytes at the front are reclaimed first */
+  if ((io_c->out_off > 0) && (io_c->out_len + in_len > io_c->out_cap)) {
+    memmove(io_c->out, &(io_c->out[io_c->out_off]), io_c->out_len - io_c->out_off);
+    io_c->out_len -= io_c->out_off;
+    io_c->out_frame -= io_c->out_off;
+    io_c->out_off = 0;
+  }
+
+  need = io_c->out_len + in_len;
+  if (need > OUTQMAX) {
+    return(-1);
+  }
+
+  if (need > io_c->out_cap) {
+    new_cap = (io_c->out_cap > 0) ? io_c->out_cap : SBUFSIZE;
+    while (new_cap < need) new_cap *= 2;
+    if (new_cap > OUTQMAX) new_cap = OUTQMAX;
+    t = realloc(io_c->out, new_cap);
+    if (t == NULL) {
+      fprintf(stderr, "conn_out_push: realloc() error\n");
+      return(-1);
+    }
+    io_c->out = t;
+    io_c->out_cap = new_cap;
+  }
+
+  memcpy(&(io_c->out[io_c->out_len]), in_buf, in_len);
+  io_c->out_len += in_len;
+
+  return(0);
+}
+
+
+/**********************/
+/* conn_out_release() */
+/**********************/
+/* discard io_c's output queue and free its memory */
+void
+conn_out_release(
+ struct conn_struct *io_c)
+{
+  free(io_c->out);
+  io_c->out = NULL;
+  io_c->out_off = 0;
+  io_c->out_frame = 0;
+  io_c->out_len = 0;
+  io_c->out_cap = 0;
+}
+
+
+/**********************/
+/* conn_ref_release() */
+/**********************/
+/* drop io_c's body sent by reference, sent or not, */
+/*  and tell its owner it is no longer needed */
+void
+conn_ref_release(
+ struct conn_struct *io_c)
+{
+void (*done)(void *) = io_c->ref_done;
+
+  io_c->ref = NULL;
+  io_c->ref_len = 0;
+  io_c->ref_done = NULL;
+  if (done != NULL) done(io_c->ref_arg);
+  io_c->ref_arg = NULL;
+}
+
+
+/****************/
+/* conn_count() */
+/****************/
+/* return: number of HTTP connections */
+unsigned int
+conn_count(void)
+{
+  return(active_count);
+}
+
+
+/***************/
+/* conn_size() */
+/***************/
+/* return: one more than the largest descriptor the table can index */
+unsigned int
+conn_size(void)
+{
+  return(conn_tab_size);
+}
+
+
+/**************/
+/* conn_end() */
+/**************/
+void
+conn_end(void)
+{
+unsigned int i = 0;
+
+  for (i = 0; i < conn_tab_size; i++) {
+    if (conn_tab[i] != NULL) conn_rem(i);
+  }
+  free(conn_tab);
+  conn_tab = NULL;
+  conn_tab_size = 0;
+
+  pool_drain(&pool_small);
+  pool_drain(&pool_large);
+}
@@ -0,0 +1,117 @@
+/* conn_util.h */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* connection table, indexed by file descriptor */
+/*  one entry owns everything the server keeps for a descriptor */
+
+#ifndef conn_util_h
+#define conn_util_h
+
+#include "http_util.h"
+#include "evnt_util.h"
+
+/* read buffers start small and grow once, to the largest request */
+#ifndef SBUFSIZE
+#define SBUFSIZE 1024
+#endif
+#ifndef RBUFSIZE
+#define RBUFSIZE 16384
+#endif
+
+/* most bytes queued for a slow client */
+#ifndef OUTQMAX
+#define OUTQMAX 65536
+#endif
+
+/* kinds of descriptor */
+#define CONN_FREE   0
+#define CONN_LISTEN 1
+#define CONN_HTTP   2
+#define CONN_WAKE   3 /* worker's wake pipe */
+
+/* connection flags */
+#define CONN_F_DEAD   0x01 /* close at the end of this event */
+#define CONN_F_LINGER 0x02 /* close once output queue is sent */
+#define CONN_F_RING   0x04 /* a bknd_send() is with the kernel, */
+                           /*  so the close waits for its completion */
+#define CONN_F_LAST   0x08 /* the request left waiting is the last, */
+                           /*  its client did not keep the connection */
+#define CONN_F_WAIT   0x10 /* a long-poll request is parked, requests */
+                           /*  sent behind it wait in buf for its answer */
+
+struct sse_frame_struct;
+struct sse_sub_struct;
+
+struct conn_struct {
+ int fd;
+ int kind;
+ int poll_slot;    /* index in poll() array, poll backend only */
+ int ring_events;  /* events wanted, io_uring backend only */
+ int ring_armed;   /* a poll is with the kernel, io_uring backend only */
+ unsigned int ring_gen; /* registration generation, io_uring backend only */
+ unsigned int pos; /* bytes held in buf */
+ unsigned int cap; /* size of buf, 0 when none held */
+ char *buf;        /* HTTP request read buffer, from the pool */
+ struct http_req_struct req; /* parse state of request in buf */
+ struct sse_sub_struct *sse_sub;     /* topics listened to, NULL when none */
+ struct sse_frame_struct *sse_frame; /* shared frame being sent */
+ unsigned int sse_sent;              /* bytes of it sent */
+ unsigned long sse_last; /* timer clock of the last frame to it */
+ unsigned long sse_live; /* and when its output was last all taken */
+ int flags;
+ int out_policy;         /* what to do when the queue is over budget */
+ int out_errno;          /* of the failed write that dropped it, 0 none */
+ char *out;              /* output not yet accepted by the socket */
+ unsigned int out_off;   /* next byte to send */
+ unsigned int out_frame; /* end of the message being sent */
+ unsigned int out_len;
+ unsigned int out_cap;
+ const char *ref;        /* body sent by reference, after the queue */
+ size_t ref_len;         /* bytes of it not yet sent, 0 when none */
+ void (*ref_done)(void *); /* called once it is no longer needed */
+ void *ref_arg;
+ struct evnt_timer_struct timer; /* request and linger timeout */
+};
+
+int conn_init(void);
+
+struct conn_struct *conn_add(int in_fd, int in_kind);
+
+struct conn_struct *conn_get(int in_fd);
+
+int conn_rem(int in_fd);
+
+int conn_buf_room(struct conn_struct *io_c);
+
+void conn_buf_release(struct conn_struct *io_c);
+
+void conn_buf_consume(struct conn_struct *io_c, unsigned int in_len);
+
+int conn_out_push(struct conn_struct *io_c, const char *in_buf, unsigned int in_len);
+
+void conn_out_release(struct conn_struct *io_c);
+
+void conn_ref_release(struct conn_struct *io_c);
+
+unsigned int conn_count(void);
+
+unsigned int conn_size(void);
+
+void conn_end(void);
+
+#endif
@@ -0,0 +1,1302 @@
+/* evnt_bknd.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Feature test switches */
+/* #define _POSIX_C_SOURCE 200112L */
+ /* epoll and kqueue are not POSIX, */
+ /*  their headers need the system's default namespace */
+#if defined(__linux__)
+#define _DEFAULT_SOURCE /* -std=c99 hides syscall() and MAP_POPULATE on glibc */
+#endif
+
+/* backend selection, one of EVNT_EPOLL, EVNT_KQUEUE, EVNT_POLL */
+/*  EVNT_URING adds io_uring to EVNT_EPOLL, which it falls back to */
+/*  when the running kernel lacks it */
+#if !defined(EVNT_EPOLL) && !defined(EVNT_KQUEUE) && !defined(EVNT_POLL)
+#if defined(__linux__)
+#define EVNT_EPOLL
+#elif defined(__OpenBSD__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+      defined(__DragonFly__) || defined(__APPLE__)
+#define EVNT_KQUEUE
+#else
+#define EVNT_POLL
+#endif
+#endif
+#if defined(EVNT_URING) && !defined(EVNT_EPOLL)
+#error "EVNT_URING is for Linux, with EVNT_EPOLL"
+#endif
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+/* POSIX headers */
+#include <unistd.h>
+#if defined(EVNT_POLL)
+#include <poll.h>
+#endif
+
+/* non POSIX headers */
+#if defined(EVNT_EPOLL)
+#include <sys/epoll.h>
+#endif
+#if defined(EVNT_URING)
+#include <string.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#if defined(EVNT_EPOLL)
+#elif defined(EVNT_KQUEUE)
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+/* Local headers */
+#include "evnt_util.h"
+#include "evnt_bknd.h"
+#if defined(EVNT_POLL) || defined(EVNT_URING)
+#include "conn_util.h"
+#endif
+
+/* Macros */
+/* File scope variables */
+/*  one backend per worker thread */
+static EVNT_LOCAL unsigned int bknd_size = 0;
+
+#if defined(EVNT_EPOLL)
+static EVNT_LOCAL int epoll_fd = -1;
+static EVNT_LOCAL struct epoll_event *epoll_ev = NULL;
+#if defined(EVNT_URING)
+static EVNT_LOCAL int ring_on = 0; /* io_uring in use, else epoll */
+static EVNT_LOCAL int ring_fd = -1;
+static EVNT_LOCAL unsigned int ring_gen = 0;
+static EVNT_LOCAL unsigned int ring_sends = 0; /* sends not yet completed */
+static EVNT_LOCAL void *sq_map = NULL;
+static EVNT_LOCAL size_t sq_map_len = 0;
+static EVNT_LOCAL void *cq_map = NULL;
+static EVNT_LOCAL size_t cq_map_len = 0;
+static EVNT_LOCAL struct io_uring_sqe *sqes = NULL;
+static EVNT_LOCAL unsigned int sqe_count = 0;
+static EVNT_LOCAL unsigned int sq_local = 0; /* tail, ahead of the kernel's */
+static EVNT_LOCAL unsigned int sq_mask = 0;
+static EVNT_LOCAL unsigned int *sq_head = NULL;
+static EVNT_LOCAL unsigned int *sq_tail = NULL;
+static EVNT_LOCAL unsigned int *sq_array = NULL;
+static EVNT_LOCAL unsigned int cq_mask = 0;
+static EVNT_LOCAL unsigned int *cq_head = NULL;
+static EVNT_LOCAL unsigned int *cq_tail = NULL;
+static EVNT_LOCAL struct io_uring_cqe *cqes = NULL;
+#endif
+#elif defined(EVNT_KQUEUE)
+static EVNT_LOCAL int kq_fd = -1;
+static EVNT_LOCAL struct kevent *kq_ev = NULL;
+#else
+static EVNT_LOCAL unsigned int   polld_count = 0;
+static EVNT_LOCAL struct pollfd *polld_array = NULL;
+#endif
+
+/* External variables */
+/* External functions */
+/* Structures and unions */
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+#if defined(EVNT_EPOLL)
+
+#if defined(EVNT_URING)
+
+/* io_uring, through its system calls, without liburing */
+/*  readiness is one-shot IORING_OP_POLL_ADD, re-armed after */
+/*  each event, so it behaves as level triggered like epoll */
+/*  registration changes and sends are queued as submissions */
+/*  and all go to the kernel with the next wait, in one call */
+
+/* user_data of a submission: generation, descriptor and operation */
+/*  the generation tells a stale completion, for a descriptor since */
+/*  removed or re-registered, from a current one */
+#define RING_POLL   0
+#define RING_SEND   1
+#define RING_CANCEL 2
+/* submission queue entries, the completion queue has twice as many */
+#ifndef RING_ENTRIES
+#define RING_ENTRIES 1024
+#endif
+
+#define RING_DATA(g, fd, op) (((unsigned long long)(g) << 32) | ((unsigned long long)(fd) << 2) | (op))
+
+/* at shutdown, milliseconds waited for cancelled sends to complete */
+#ifndef RING_DRAIN
+#define RING_DRAIN 1000
+#endif
+
+
+/****************/
+/* ring_setup() */
+/****************/
+/* return: 0 on success, -1 io_uring missing or lacking a feature */
+static int
+ring_setup(
+ unsigned int in_entries)
+{
+struct io_uring_params p;
+void *sq = NULL;
+void *cq = NULL;
+size_t sq_len = 0;
+size_t cq_len = 0;
+
+  memset(&p, 0, sizeof(p));
+  ring_fd = syscall(__NR_io_uring_setup, in_entries, &p);
+  if (ring_fd == (-1)) {
+    return(-1);
+  }
+
+  /* waiting with a timeout needs IORING_ENTER_EXT_ARG, Linux 5.11 */
+  if (!(p.features & IORING_FEAT_EXT_ARG)) {
+    close(ring_fd);
+    ring_fd = (-1);
+    return(-1);
+  }
+
+  sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cq_len > sq_len) sq_len = cq_len;
+    cq_len = sq_len;
+  }
+
+  sq = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+   ring_fd, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED) {
+    close(ring_fd);
+    ring_fd = (-1);
+    return(-1);
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    cq = sq;
+  } else {
+    cq = mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+     ring_fd, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED) {
+      munmap(sq, sq_len);
+      close(ring_fd);
+      ring_fd = (-1);
+      return(-1);
+    }
+  }
+  sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    if (cq != sq) munmap(cq, cq_len);
+    munmap(sq, sq_len);
+    close(ring_fd);
+    ring_fd = (-1);
+    sqes = NULL;
+    return(-1);
+  }
+
+  sq_map = sq;
+  sq_map_len = sq_len;
+  cq_map = cq;
+  cq_map_len = cq_len;
+  sqe_count = p.sq_entries;
+
+  sq_head = (unsigned int *)((char *)sq + p.sq_off.head);
+  sq_tail = (unsigned int *)((char *)sq + p.sq_off.tail);
+  sq_mask = *(unsigned int *)((char *)sq + p.sq_off.ring_mask);
+  sq_array = (unsigned int *)((char *)sq + p.sq_off.array);
+  cq_head = (unsigned int *)((char *)cq + p.cq_off.head);
+  cq_tail = (unsigned int *)((char *)cq + p.cq_off.tail);
+  cq_mask = *(unsigned int *)((char *)cq + p.cq_off.ring_mask);
+  cqes = (struct io_uring_cqe *)((char *)cq + p.cq_off.cqes);
+
+  sq_local = *sq_tail;
+
+  return(0);
+}
+
+
+/****************/
+/* ring_enter() */
+/****************/
+/* submit what is queued, and if in_wait, wait for a completion */
+/*  for up to in_timeout milliseconds, -1 forever */
+/* return: 0 on success, -1 error, errno set */
+static int
+ring_enter(
+ int in_wait,
+ int in_timeout)
+{
+struct io_uring_getevents_arg arg;
+struct __kernel_timespec ts;
+unsigned int flags = 0;
+unsigned int submit = 0;
+int n = 0;
+
+  submit = sq_local - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+
+  memset(&arg, 0, sizeof(arg));
+  if (in_wait) {
+    flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    if (in_timeout >= 0) {
+      ts.tv_sec = in_timeout / 1000;
+      ts.tv_nsec = (in_timeout % 1000) * 1000000L;
+      arg.ts = (unsigned long long)(unsigned long)&ts;
+    }
+  } else if (submit == 0) {
+    return(0);
+  }
+
+  n = syscall(__NR_io_uring_enter, ring_fd, submit, in_wait ? 1 : 0, flags,
+   in_wait ? &arg : NULL, sizeof(arg));
+  if ((n == (-1)) && (errno == ETIME)) {
+    return(0);
+  }
+
+  return((n == (-1)) ? (-1) : 0);
+}
+
+
+/**************/
+/* ring_sqe() */
+/**************/
+/* return: next free submission entry, zeroed, NULL if the ring stays full */
+static struct io_uring_sqe *
+ring_sqe(void)
+{
+struct io_uring_sqe *sqe = NULL;
+
+  if (sq_local - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sqe_count) {
+    /* full, hand what is queued to the kernel now */
+    if (ring_enter(0, 0) == (-1)) {
+      return(NULL);
+    }
+    if (sq_local - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sqe_count) {
+      return(NULL);
+    }
+  }
+
+  sqe = &sqes[sq_local & sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+
+  return(sqe);
+}
+
+
+/***************/
+/* ring_push() */
+/***************/
+/* publish the entry taken by ring_sqe(), it is sent with the next enter */
+static void
+ring_push(void)
+{
+  sq_array[sq_local & sq_mask] = sq_local & sq_mask;
+  sq_local += 1;
+  __atomic_store_n(sq_tail, sq_local, __ATOMIC_RELEASE);
+}
+
+
+/**************/
+/* ring_arm() */
+/**************/
+/* queue a one-shot poll for what c wants */
+/* return: 0 on success, -1 error */
+static int
+ring_arm(
+ struct conn_struct *c)
+{
+struct io_uring_sqe *sqe = NULL;
+
+  sqe = ring_sqe();
+  if (sqe == NULL) {
+    fprintf(stderr, "bknd_wait: io_uring submission queue full\n");
+    return(-1);
+  }
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = c->fd;
+  sqe->poll32_events = POLLIN | POLLOUT;
+  if (!(c->ring_events & BKND_IN)) sqe->poll32_events &= ~POLLIN;
+  if (!(c->ring_events & BKND_OUT)) sqe->poll32_events &= ~POLLOUT;
+  sqe->user_data = RING_DATA(c->ring_gen, c->fd, RING_POLL);
+  ring_push();
+  c->ring_armed = 1;
+
+  return(0);
+}
+
+
+/*****************/
+/* ring_disarm() */
+/*****************/
+/* cancel c's poll, if one is armed, and retire its generation */
+static void
+ring_disarm(
+ struct conn_struct *c)
+{
+struct io_uring_sqe *sqe = NULL;
+
+  if (c->ring_armed) {
+    sqe = ring_sqe();
+    if (sqe != NULL) {
+      sqe->opcode = IORING_OP_POLL_REMOVE;
+      sqe->fd = (-1);
+      sqe->addr = RING_DATA(c->ring_gen, c->fd, RING_POLL);
+      sqe->user_data = RING_DATA(0, 0, RING_CANCEL);
+      ring_push();
+    }
+    c->ring_armed = 0;
+  }
+
+  ring_gen += 1;
+  c->ring_gen = ring_gen;
+}
+
+
+/**************/
+/* ring_add() */
+/**************/
+/* return: 0 on success, -1 error */
+static int
+ring_add(
+ int in_fd,
+ int in_events)
+{
+struct conn_struct *c = NULL;
+
+  c = conn_get(in_fd);
+  if (c == NULL) {
+    fprintf(stderr, "bknd_add: descriptor not in connection table\n");
+    return(-1);
+  }
+
+  ring_gen += 1;
+  c->ring_gen = ring_gen;
+  c->ring_events = in_events;
+  c->ring_armed = 0;
+  if (in_events == 0) return(0);
+
+  return(ring_arm(c));
+}
+
+
+/**************/
+/* ring_mod() */
+/**************/
+/* return: 0 on success, -1 error */
+static int
+ring_mod(
+ int in_fd,
+ int in_events)
+{
+struct conn_struct *c = NULL;
+
+  c = conn_get(in_fd);
+  if (c == NULL) {
+    fprintf(stderr, "bknd_mod: descriptor not in connection table\n");
+    return(-1);
+  }
+  if ((in_events == c->ring_events) && c->ring_armed) {
+    return(0);
+  }
+
+  ring_disarm(c);
+  c->ring_events = in_events;
+  if (in_events == 0) return(0);
+
+  return(ring_arm(c));
+}
+
+
+/**************/
+/* ring_del() */
+/**************/
+/* return: 0 on success, -1 error */
+static int
+ring_del(
+ int in_fd)
+{
+struct conn_struct *c = NULL;
+
+  c = conn_get(in_fd);
+  if (c == NULL) {
+    fprintf(stderr, "bknd_del: descriptor not in connection table\n");
+    return(-1);
+  }
+
+  ring_disarm(c);
+  c->ring_events = 0;
+
+  return(0);
+}
+
+
+/***************/
+/* ring_wait() */
+/***************/
+/* return: number of events, 0 timeout or interrupted, -1 error */
+static int
+ring_wait(
+ struct bknd_event *out_ev,
+ int in_max,
+ int in_timeout)
+{
+struct io_uring_cqe *cqe = NULL;
+struct conn_struct *c = NULL;
+unsigned long long ud = 0;
+unsigned int head = 0;
+unsigned int tail = 0;
+int fd = 0;
+int n = 0;
+
+  /* completions left from last time are returned without waiting */
+  head = *cq_head;
+  tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+  if (ring_enter(head == tail, in_timeout) == (-1)) {
+    if (errno == EINTR) return(0);
+    fprintf(stderr, "bknd_wait: io_uring_enter() error\n");
+    return(-1);
+  }
+  tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+  while ((head != tail) && (n < in_max)) {
+    cqe = &cqes[head & cq_mask];
+    ud = cqe->user_data;
+    head += 1;
+
+    fd = (int)((ud >> 2) & 0x3fffffff);
+    if ((ud & 3) == RING_SEND) ring_sends -= 1;
+    c = conn_get(fd);
+    if ((c == NULL) || ((ud & 3) == RING_CANCEL)) {
+      continue;
+    }
+
+    if ((ud & 3) == RING_SEND) {
+      out_ev[n].fd = fd;
+      out_ev[n].events = BKND_DONE;
+      out_ev[n].res = cqe->res;
+      n += 1;
+      continue;
+    }
+
+    /* a poll, of the descriptor's current registration only */
+    if ((unsigned int)(ud >> 32) != c->ring_gen) {
+      continue;
+    }
+    c->ring_armed = 0;
+    if (cqe->res < 0) {
+      if (cqe->res == -ECANCELED) continue;
+      out_ev[n].events = BKND_ERR;
+    } else {
+      out_ev[n].events = 0;
+      if (cqe->res & POLLIN) out_ev[n].events |= BKND_IN;
+      if (cqe->res & POLLOUT) out_ev[n].events |= BKND_OUT;
+      if (cqe->res & (POLLERR | POLLHUP)) out_ev[n].events |= BKND_ERR;
+    }
+    out_ev[n].fd = fd;
+    out_ev[n].res = 0;
+    n += 1;
+
+    /* one-shot, so watch again, it reaches the kernel with the next */
+    /*  wait, after this event has been handled */
+    ring_arm(c);
+  }
+
+  __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+  return(n);
+}
+
+
+/***************/
+/* ring_send() */
+/***************/
+/* queue a send of in_buf, its completion is a BKND_DONE event */
+/* return: 0 queued, -1 not queued */
+static int
+ring_send(
+ int in_fd,
+ const char *in_buf,
+ size_t in_len)
+{
+struct io_uring_sqe *sqe = NULL;
+
+  sqe = ring_sqe();
+  if (sqe == NULL) {
+    return(-1);
+  }
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = in_fd;
+  sqe->addr = (unsigned long long)(unsigned long)in_buf;
+  sqe->len = in_len;
+  sqe->msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+  sqe->user_data = RING_DATA(0, in_fd, RING_SEND);
+  ring_push();
+  ring_sends += 1;
+
+  return(0);
+}
+
+
+/****************/
+/* ring_drain() */
+/****************/
+/* cancel the sends still with the kernel and wait for them, */
+/*  their completions are consumed, not returned as events */
+/* return: 0 none left, -1 some still with the kernel */
+static int
+ring_drain(void)
+{
+struct io_uring_sqe *sqe = NULL;
+struct io_uring_cqe *cqe = NULL;
+struct conn_struct *c = NULL;
+unsigned int head = 0;
+unsigned int tail = 0;
+int waited = 0;
+int fd = 0;
+
+  /* a connection has at most one send with the kernel, */
+  /*  one already done only has its cancel fail */
+  for (fd = 0; fd < conn_size(); fd++) {
+    c = conn_get(fd);
+    if ((c == NULL) || !(c->flags & CONN_F_RING)) continue;
+    sqe = ring_sqe();
+    if (sqe == NULL) break;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = (-1);
+    sqe->addr = RING_DATA(0, fd, RING_SEND);
+    sqe->user_data = RING_DATA(0, 0, RING_CANCEL);
+    ring_push();
+  }
+
+  /* sends still queued go to the kernel ahead of their cancels */
+  while ((ring_sends > 0) && (waited < RING_DRAIN)) {
+    if ((ring_enter(1, 100) == (-1)) && (errno != EINTR)) {
+      fprintf(stderr, "bknd_drain: io_uring_enter() error\n");
+      break;
+    }
+    waited += 100;
+
+    head = *cq_head;
+    tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      cqe = &cqes[head & cq_mask];
+      if ((cqe->user_data & 3) == RING_SEND) ring_sends -= 1;
+      head += 1;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  return((ring_sends > 0) ? (-1) : 0);
+}
+
+
+/**************/
+/* ring_end() */
+/**************/
+static void
+ring_end(void)
+{
+  if (sqes != NULL) munmap(sqes, sqe_count * sizeof(struct io_uring_sqe));
+  if ((cq_map != NULL) && (cq_map != sq_map)) munmap(cq_map, cq_map_len);
+  if (sq_map != NULL) munmap(sq_map, sq_map_len);
+  if (ring_fd >= 0) close(ring_fd);
+  sqes = NULL;
+  cq_map = NULL;
+  sq_map = NULL;
+  ring_fd = (-1);
+  ring_on = 0;
+  ring_sends = 0;
+}
+
+#endif /* EVNT_URING */
+
+
+/****************/
+/* epoll_mask() */
+/****************/
+static unsigned int
+epoll_mask(
+ int in_events)
+{
+unsigned int mask = 0;
+
+  if (in_events & BKND_IN) mask |= EPOLLIN;
+  if (in_events & BKND_OUT) mask |= EPOLLOUT;
+
+  return(mask);
+}
+
+
+/***************/
+/* bknd_init() */
+/***************/
+/* in_size is the most events one bknd_wait() returns, */
+/*  any number of descriptors may be registered */
+/* return: 0 on success, -1 error */
+int
+bknd_init(
+ unsigned int in_size)
+{
+  bknd_size = in_size;
+
+#if defined(EVNT_URING)
+  /* a full submission queue is handed to the kernel early, */
+  /*  so this bounds a batch, not the descriptors */
+  if (ring_setup(RING_ENTRIES) == 0) {
+    ring_on = 1;
+    return(0);
+  }
+  fprintf(stderr, "bknd_init: io_uring not available, using epoll\n");
+#endif
+
+  /* the size is only a hint, and ignored since Linux 2.6.8 */
+  epoll_fd = epoll_create(in_size);
+  if (epoll_fd == (-1)) {
+    fprintf(stderr, "bknd_init: epoll_create() error\n");
+    return(-1);
+  }
+
+  epoll_ev = malloc(sizeof(struct epoll_event) * bknd_size);
+  if (epoll_ev == NULL) {
+    fprintf(stderr, "bknd_init: malloc() error\n");
+    close(epoll_fd);
+    epoll_fd = (-1);
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/**************/
+/* bknd_add() */
+/**************/
+/* return: 0 on success, -1 error */
+int
+bknd_add(
+ int in_fd,
+ int in_events)
+{
+struct epoll_event ev;
+
+#if defined(EVNT_URING)
+  if (ring_on) return(ring_add(in_fd, in_events));
+#endif
+
+  ev.events = epoll_mask(in_events);
+  ev.data.u64 = 0;
+  ev.data.fd = in_fd;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, in_fd, &ev) == (-1)) {
+    fprintf(stderr, "bknd_add: epoll_ctl() error\n");
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/**************/
+/* bknd_mod() */
+/**************/
+/* return: 0 on success, -1 error */
+int
+bknd_mod(
+ int in_fd,
+ int in_events)
+{
+struct epoll_event ev;
+
+#if defined(EVNT_URING)
+  if (ring_on) return(ring_mod(in_fd, in_events));
+#endif
+
+  ev.events = epoll_mask(in_events);
+  ev.data.u64 = 0;
+  ev.data.fd = in_fd;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, in_fd, &ev) == (-1)) {
+    fprintf(stderr, "bknd_mod: epoll_ctl() error\n");
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/**************/
+/* bknd_del() */
+/**************/
+/* must be called before the descriptor is closed */
+/* return: 0 on success, -1 error */
+int
+bknd_del(
+ int in_fd)
+{
+struct epoll_event ev;
+
+#if defined(EVNT_URING)
+  if (ring_on) return(ring_del(in_fd));
+#endif
+
+  /* ev unused, but pre 2.6.9 kernels require non-NULL */
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, in_fd, &ev) == (-1)) {
+    fprintf(stderr, "bknd_del: epoll_ctl() error\n");
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/***************/
+/* bknd_wait() */
+/***************/
+/* wait up to in_timeout milliseconds (-1 forever) for ready descriptors */
+/*  fills out_ev with at most in_max entries */
+/* return: number of ready descriptors, 0 timeout or interrupted, -1 error */
+int
+bknd_wait(
+ struct bknd_event *out_ev,
+ int in_max,
+ int in_timeout)
+{
+int n = 0;
+int i = 0;
+unsigned int e = 0;
+
+  if (in_max > bknd_size) in_max = bknd_size;
+
+#if defined(EVNT_URING)
+  if (ring_on) return(ring_wait(out_ev, in_max, in_timeout));
+#endif
+
+  n = epoll_wait(epoll_fd, epoll_ev, in_max, in_timeout);
+  if (n == (-1)) {
+    if (errno == EINTR) return(0);
+    fprintf(stderr, "bknd_wait: epoll_wait() error\n");
+    return(-1);
+  }
+
+  for (i = 0; i < n; i++) {
+    e = epoll_ev[i].events;
+    out_ev[i].fd = epoll_ev[i].data.fd;
+    out_ev[i].res = 0;
+    out_ev[i].events = 0;
+    if (e & EPOLLIN) out_ev[i].events |= BKND_IN;
+    if (e & EPOLLOUT) out_ev[i].events |= BKND_OUT;
+    if (e & (EPOLLERR | EPOLLHUP)) out_ev[i].events |= BKND_ERR;
+  }
+
+  return(n);
+}
+
+
+/***************/
+/* bknd_send() */
+/***************/
+/* queue a send of in_buf to in_fd, to go with the next bknd_wait() */
+/*  in_buf must stay unchanged until its BKND_DONE event */
+/* return: 0 queued, -1 not supported, the caller writes itself */
+int
+bknd_send(
+ int in_fd,
+ const char *in_buf,
+ size_t in_len)
+{
+#if defined(EVNT_URING)
+  if (ring_on) return(ring_send(in_fd, in_buf, in_len));
+#endif
+  return(-1);
+}
+
+
+/***************/
+/* bknd_name() */
+/***************/
+const char *
+bknd_name(void)
+{
+#if defined(EVNT_URING)
+  if (ring_on) return("io_uring");
+#endif
+  return("epoll");
+}
+
+
+/****************/
+/* bknd_drain() */
+/****************/
+/* before the buffers of bknd_send() are freed, at shutdown, */
+/*  cancel the sends still with the kernel and wait for them */
+/* return: 0 none left, -1 some may still read their buffers */
+int
+bknd_drain(void)
+{
+#if defined(EVNT_URING)
+  if (ring_on) return(ring_drain());
+#endif
+  return(0);
+}
+
+
+/**************/
+/* bknd_end() */
+/**************/
+void
+bknd_end(void)
+{
+#if defined(EVNT_URING)
+  ring_end();
+#endif
+  if (epoll_fd >= 0) close(epoll_fd);
+  epoll_fd = (-1);
+  free(epoll_ev);
+  epoll_ev = NULL;
+}
+
+#elif defined(EVNT_KQUEUE)
+
+/************/
+/* kq_set() */
+/************/
+/* read and write filters are both always registered */
+/*  and only enabled or disabled, so EV_DELETE never fails */
+/* return: 0 on success, -1 error */
+static int
+kq_set(
+ int in_fd,
+ int in_events)
+{
+struct kevent kev[2];
+
+  EV_SET(&kev[0], in_fd, EVFILT_READ,
+   EV_ADD | ((in_events & BKND_IN) ? EV_ENABLE : EV_DISABLE), 0, 0, NULL);
+  EV_SET(&kev[1], in_fd, EVFILT_WRITE,
+   EV_ADD | ((in_events & BKND_OUT) ? EV_ENABLE : EV_DISABLE), 0, 0, NULL);
+
+  return(kevent(kq_fd, kev, 2, NULL, 0, NULL));
+}
+
+
+/***************/
+/* bknd_init() */
+/***************/
+/* in_size is the most descriptors one bknd_wait() returns, */
+/*  any number of descriptors may be registered */
+/* return: 0 on success, -1 error */
+int
+bknd_init(
+ unsigned int in_size)
+{
+  bknd_size = in_size;
+
+  kq_fd = kqueue();
+  if (kq_fd == (-1)) {
+    fprintf(stderr, "bknd_init: kqueue() error\n");
+    return(-1);
+  }
+
+  /* a descriptor can report both read and write */
+  kq_ev = malloc(sizeof(struct kevent) * bknd_size * 2);
+  if (kq_ev == NULL) {
+    fprintf(stderr, "bknd_init: malloc() error\n");
+    close(kq_fd);
+    kq_fd = (-1);
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/**************/
+/* bknd_add() */
+/**************/
+/* return: 0 on success, -1 error */
+int
+bknd_add(
+ int in_fd,
+ int in_events)
+{
+  if (kq_set(in_fd, in_events) == (-1)) {
+    fprintf(stderr, "bknd_add: kevent() error\n");
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/**************/
+/* bknd_mod() */
+/**************/
+/* return: 0 on success, -1 error */
+int
+bknd_mod(
+ int in_fd,
+ int in_events)
+{
+  if (kq_set(in_fd, in_events) == (-1)) {
+    fprintf(stderr, "bknd_mod: kevent() error\n");
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/**************/
+/* bknd_del() */
+/**************/
+/* must be called before the descriptor is closed */
+/* return: 0 on success, -1 error */
+int
+bknd_del(
+ int in_fd)
+{
+struct kevent kev[2];
+
+  EV_SET(&kev[0], in_fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+  EV_SET(&kev[1], in_fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+  if (kevent(kq_fd, kev, 2, NULL, 0, NULL) == (-1)) {
+    fprintf(stderr, "bknd_del: kevent() error\n");
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/***************/
+/* bknd_wait() */
+/***************/
+/* wait up to in_timeout milliseconds (-1 forever) for ready descriptors */
+/*  fills out_ev with at most in_max entries */
+/*  a descriptor ready for read and write may appear twice */
+/* return: number of ready descriptors, 0 timeout or interrupted, -1 error */
+int
+bknd_wait(
+ struct bknd_event *out_ev,
+ int in_max,
+ int in_timeout)
+{
+struct timespec ts;
+struct timespec *tsp = NULL;
+int n = 0;
+int i = 0;
+
+  if (in_max > bknd_size * 2) in_max = bknd_size * 2;
+
+  if (in_timeout >= 0) {
+    ts.tv_sec = in_timeout / 1000;
+    ts.tv_nsec = (in_timeout % 1000) * 1000000L;
+    tsp = &ts;
+  }
+
+  n = kevent(kq_fd, NULL, 0, kq_ev, in_max, tsp);
+  if (n == (-1)) {
+    if (errno == EINTR) return(0);
+    fprintf(stderr, "bknd_wait: kevent() error\n");
+    return(-1);
+  }
+
+  for (i = 0; i < n; i++) {
+    out_ev[i].fd = (int)kq_ev[i].ident;
+    out_ev[i].res = 0;
+    if (kq_ev[i].flags & EV_ERROR) {
+      out_ev[i].events = BKND_ERR;
+    } else if (kq_ev[i].filter == EVFILT_WRITE) {
+      out_ev[i].events = BKND_OUT;
+    } else {
+      /* EV_EOF is left for read() to discover */
+      out_ev[i].events = BKND_IN;
+    }
+  }
+
+  return(n);
+}
+
+
+/***************/
+/* bknd_send() */
+/***************/
+/* return: -1, not supported, the caller writes itself */
+int
+bknd_send(
+ int in_fd,
+ const char *in_buf,
+ size_t in_len)
+{
+  return(-1);
+}
+
+
+/***************/
+/* bknd_name() */
+/***************/
+const char *
+bknd_name(void)
+{
+  return("kqueue");
+}
+
+
+/****************/
+/* bknd_drain() */
+/****************/
+/* return: 0, bknd_send() is not supported, nothing is with the kernel */
+int
+bknd_drain(void)
+{
+  return(0);
+}
+
+
+/**************/
+/* bknd_end() */
+/**************/
+void
+bknd_end(void)
+{
+  if (kq_fd >= 0) close(kq_fd);
+  kq_fd = (-1);
+  free(kq_ev);
+  kq_ev = NULL;
+}
+
+#else
+
+/***************/
+/* bknd_init() */
+/***************/
+/* in_size is the first size of the poll array, */
+/*  which doubles as more descriptors are registered */
+/* return: 0 on success, -1 error */
+int
+bknd_init(
+ unsigned int in_size)
+{
+  bknd_size = in_size;
+
+  polld_array = malloc(sizeof(struct pollfd) * bknd_size);
+  if (polld_array == NULL) {
+    fprintf(stderr, "bknd_init: malloc() for poll error\n");
+    return(-1);
+  }
+  polld_count = 0;
+
+  return(0);
+}
+
+
+/**************/
+/* bknd_add() */
+/**************/
+/* in_fd must already have a connection table entry */
+/*  which records its slot in the poll array */
+/* return: 0 on success, -1 error */
+int
+bknd_add(
+ int in_fd,
+ int in_events)
+{
+struct conn_struct *c = NULL;
+struct pollfd *t = NULL;
+
+  c = conn_get(in_fd);
+  if (c == NULL) {
+    fprintf(stderr, "bknd_add: descriptor not in connection table\n");
+    return(-1);
+  }
+
+  if (polld_count >= bknd_size) {
+    t = realloc(polld_array, sizeof(struct pollfd) * bknd_size * 2);
+    if (t == NULL) {
+      fprintf(stderr, "bknd_add: realloc() for poll error\n");
+      return(-1);
+    }
+    polld_array = t;
+    bknd_size *= 2;
+  }
+
+  /* append fd onto polld array */
+  polld_array[polld_count].fd = in_fd;
+  polld_array[polld_count].events = 0;
+  if (in_events & BKND_IN) polld_array[polld_count].events |= POLLIN;
+  if (in_events & BKND_OUT) polld_array[polld_count].events |= POLLOUT;
+  polld_array[polld_count].revents = 0;
+  c->poll_slot = polld_count;
+
+  polld_count += 1;
+
+  return(0);
+}
+
+
+/**************/
+/* bknd_mod() */
+/**************/
+/* return: 0 on success, -1 error */
+int
+bknd_mod(
+ int in_fd,
+ int in_events)
+{
+struct conn_struct *c = NULL;
+int i = 0;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->poll_slot < 0)) {
+    fprintf(stderr, "bknd_mod: descriptor not found\n");
+    return(-1);
+  }
+  i = c->poll_slot;
+
+  polld_array[i].events = 0;
+  if (in_events & BKND_IN) polld_array[i].events |= POLLIN;
+  if (in_events & BKND_OUT) polld_array[i].events |= POLLOUT;
+
+  return(0);
+}
+
+
+/**************/
+/* bknd_del() */
+/**************/
+/* return: 0 on success, -1 error */
+int
+bknd_del(
+ int in_fd)
+{
+struct conn_struct *c = NULL;
+int i = 0;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->poll_slot < 0)) {
+    fprintf(stderr, "bknd_del: descriptor not found\n");
+    return(-1);
+  }
+  i = c->poll_slot;
+  c->poll_slot = (-1);
+
+  /* remove by moving the last entry into the hole */
+  polld_count -= 1;
+  if (i < polld_count) {
+    polld_array[i] = polld_array[polld_count];
+    conn_get(polld_array[i].fd)->poll_slot = i;
+  }
+
+  return(0);
+}
+
+
+/***************/
+/* bknd_wait() */
+/***************/
+/* wait up to in_timeout milliseconds (-1 forever) for ready descriptors */
+/*  fills out_ev with at most in_max entries */
+/* return: number of ready descriptors, 0 timeout or interrupted, -1 error */
+int
+bknd_wait(
+ struct bknd_event *out_ev,
+ int in_max,
+ int in_timeout)
+{
+int poll_status = 0;
+int i = 0;
+int n = 0;
+short r = 0;
+
+  poll_status = poll(polld_array, polld_count, in_timeout);
+  if (poll_status == (-1)) {
+    if (errno == EINTR) return(0);
+    fprintf(stderr, "bknd_wait: poll() error\n");
+    return(-1);
+  }
+
+  /* poll() has no ready list, the array has to be walked */
+  for (i = 0; (i < polld_count) && (n < poll_status) && (n < in_max); i++) {
+    r = polld_array[i].revents;
+    if (r == 0) continue;
+    out_ev[n].fd = polld_array[i].fd;
+    out_ev[n].res = 0;
+    out_ev[n].events = 0;
+    if (r & POLLIN) out_ev[n].events |= BKND_IN;
+    if (r & POLLOUT) out_ev[n].events |= BKND_OUT;
+    if (r & (POLLERR | POLLHUP | POLLNVAL)) out_ev[n].events |= BKND_ERR;
+    n += 1;
+  }
+
+  return(n);
+}
+
+
+/***************/
+/* bknd_send() */
+/***************/
+/* return: -1, not supported, the caller writes itself */
+int
+bknd_send(
+ int in_fd,
+ const char *in_buf,
+ size_t in_len)
+{
+  return(-1);
+}
+
+
+/***************/
+/* bknd_name() */
+/***************/
+const char *
+bknd_name(void)
+{
+  return("poll");
+}
+
+
+/****************/
+/* bknd_drain() */
+/****************/
+/* return: 0, bknd_send() is not supported, nothing is with the kernel */
+int
+bknd_drain(void)
+{
+  return(0);
+}
+
+
+/**************/
+/* bknd_end() */
+/**************/
+void
+bknd_end(void)
+{
+  free(polld_array);
+  polld_array = NULL;
+  polld_count = 0;
+}
+
+#endif
@@ -0,0 +1,60 @@
+/* evnt_bknd.h */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* readiness backend for the event loop */
+/*  epoll on Linux, kqueue on the BSDs, poll() everywhere else */
+/*  compile with -DEVNT_POLL to force the poll() fallback */
+/*  or on Linux with -DEVNT_URING to use io_uring when the kernel has it */
+
+#ifndef evnt_bknd_h
+#define evnt_bknd_h
+
+#include <stddef.h>
+
+/* event flags, may be or'ed together */
+#define BKND_IN  0x01
+#define BKND_OUT 0x02
+#define BKND_ERR 0x04
+#define BKND_DONE 0x08 /* a bknd_send() completed, res holds its result */
+
+/* one ready descriptor, as returned by bknd_wait() */
+struct bknd_event {
+ int fd;
+ int events;
+ int res; /* bytes sent or -errno, BKND_DONE only */
+};
+
+int bknd_init(unsigned int in_size);
+
+int bknd_add(int in_fd, int in_events);
+
+int bknd_mod(int in_fd, int in_events);
+
+int bknd_del(int in_fd);
+
+int bknd_wait(struct bknd_event *out_ev, int in_max, int in_timeout);
+
+int bknd_send(int in_fd, const char *in_buf, size_t in_len);
+
+const char *bknd_name(void);
+
+int bknd_drain(void);
+
+void bknd_end(void);
+
+#endif
@@ -0,0 +1,374 @@
+/* evnt_timr.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* hierarchical timer wheel for the event loop */
+/*  four levels of 64 slots, level 0 is one tick per slot, */
+/*  each level above is 64 times coarser and is cascaded down */
+/*  into the level below as the wheel turns */
+/*  a timer sits in one doubly linked slot list, so arming */
+/*  and cancelling are O(1) whatever the number of timers */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdio.h>
+
+/* POSIX headers */
+#include <time.h>
+
+/* Local headers */
+#include "evnt_util.h"
+#include "evnt_timr.h"
+
+/* Macros */
+/* milliseconds per tick, the resolution of all timers */
+#ifndef EVNT_TICK
+#define EVNT_TICK 10
+#endif
+
+#define TIMR_BITS   6
+#define TIMR_SLOTS  (1 << TIMR_BITS)
+#define TIMR_MASK   (TIMR_SLOTS - 1)
+#define TIMR_LEVELS 4
+/* ticks beyond the top level are clamped, about 46 hours */
+#define TIMR_SPAN   (1UL << (TIMR_BITS * TIMR_LEVELS))
+
+/* File scope variables */
+static EVNT_LOCAL struct timespec timr_base;  /* clock at tick 0 */
+static EVNT_LOCAL unsigned long timr_now = 0; /* next tick to run, all before have */
+static EVNT_LOCAL unsigned int timr_count[TIMR_LEVELS]; /* armed timers per level */
+
+/* External variables */
+/* External functions */
+
+/* Structures and unions */
+/*  one wheel per worker thread */
+/*  each slot is the head of a circular list, empty when it points to itself */
+static EVNT_LOCAL struct evnt_timer_struct wheel[TIMR_LEVELS][TIMR_SLOTS];
+
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/****************/
+/* timr_clock() */
+/****************/
+/* return: milliseconds since timr_init() */
+static unsigned long
+timr_clock(void)
+{
+struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == (-1)) {
+    fprintf(stderr, "timr_clock: clock_gettime() error\n");
+    return(timr_now * EVNT_TICK);
+  }
+
+  return((unsigned long)(ts.tv_sec - timr_base.tv_sec) * 1000 +
+    (ts.tv_nsec - timr_base.tv_nsec) / 1000000);
+}
+
+
+/*****************/
+/* timr_unlink() */
+/*****************/
+static void
+timr_unlink(
+ struct evnt_timer_struct *t)
+{
+  t->prev->next = t->next;
+  t->next->prev = t->prev;
+  t->next = t;
+  t->prev = t;
+}
+
+
+/*****************/
+/* timr_insert() */
+/*****************/
+/* link t into the slot for t->expire, relative to timr_now */
+static void
+timr_insert(
+ struct evnt_timer_struct *t)
+{
+struct evnt_timer_struct *head = NULL;
+unsigned long delta = 0;
+int level = 0;
+
+  /* already due, runs on the next tick */
+  if (t->expire < timr_now) t->expire = timr_now;
+
+  delta = t->expire - timr_now;
+  if (delta >= TIMR_SPAN) {
+    delta = TIMR_SPAN - 1;
+    t->expire = timr_now + delta;
+  }
+
+  level = 0;
+  while (delta >= (1UL << (TIMR_BITS * (level + 1)))) level += 1;
+
+  head = &wheel[level][(t->expire >> (TIMR_BITS * level)) & TIMR_MASK];
+  t->level = level;
+  t->prev = head->prev;
+  t->next = head;
+  head->prev->next = t;
+  head->prev = t;
+  timr_count[level] += 1;
+}
+
+
+/******************/
+/* timr_cascade() */
+/******************/
+/* move the timers of one slot down into the levels below */
+static void
+timr_cascade(
+ int in_level,
+ unsigned int in_slot)
+{
+struct evnt_timer_struct *head = &wheel[in_level][in_slot];
+struct evnt_timer_struct *t = NULL;
+
+  while (head->next != head) {
+    t = head->next;
+    timr_unlink(t);
+    timr_count[in_level] -= 1;
+    timr_insert(t);
+  }
+}
+
+
+/***************/
+/* timr_tick() */
+/***************/
+/* run the timers due on tick timr_now, and advance it */
+static void
+timr_tick(void)
+{
+struct evnt_timer_struct due;
+struct evnt_timer_struct *head = NULL;
+struct evnt_timer_struct *t = NULL;
+int level = 0;
+
+  /* at each turn of a level, bring down the next slot of the one above */
+  /*  top level first, so its timers can cascade on down in the same tick */
+  for (level = 1; level < TIMR_LEVELS; level++) {
+    if ((timr_now >> (TIMR_BITS * level) << (TIMR_BITS * level)) != timr_now) break;
+  }
+  for (level = level - 1; level > 0; level--) {
+    timr_cascade(level, (timr_now >> (TIMR_BITS * level)) & TIMR_MASK);
+  }
+
+  /* take the due list off the wheel before running it */
+  /*  so callbacks may arm and cancel timers, including these */
+  head = &wheel[0][timr_now & TIMR_MASK];
+  due.next = &due;
+  due.prev = &due;
+  if (head->next != head) {
+    due.next = head->next;
+    due.prev = head->prev;
+    due.next->prev = &due;
+    due.prev->next = &due;
+    head->next = head;
+    head->prev = head;
+  }
+  timr_now += 1;
+
+  while (due.next != &due) {
+    t = due.next;
+    timr_unlink(t);
+    timr_count[0] -= 1;
+    t->level = (-1);
+    t->f(t->arg);
+  }
+}
+
+
+/***************/
+/* timr_init() */
+/***************/
+/* return: 0 on success, -1 error */
+int
+timr_init(void)
+{
+int level = 0;
+int slot = 0;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &timr_base) == (-1)) {
+    fprintf(stderr, "timr_init: clock_gettime() error\n");
+    return(-1);
+  }
+  timr_now = 0;
+
+  for (level = 0; level < TIMR_LEVELS; level++) {
+    timr_count[level] = 0;
+    for (slot = 0; slot < TIMR_SLOTS; slot++) {
+      evnt_timer_init(&wheel[level][slot], NULL, NULL);
+    }
+  }
+
+  return(0);
+}
+
+
+/******************/
+/* timr_timeout() */
+/******************/
+/* return: milliseconds until the wheel next needs to run, */
+/*  -1 when no timer is armed, so the loop can sleep until an event */
+int
+timr_timeout(void)
+{
+unsigned long next = 0;
+unsigned long when = 0;
+unsigned long elapsed = 0;
+unsigned int cur = 0;
+unsigned int d = 0;
+int level = 0;
+int armed = 0;
+
+  for (level = 0; level < TIMR_LEVELS; level++) {
+    if (timr_count[level] == 0) continue;
+
+    /* first non-empty slot ahead, it is due at its tick on level 0 */
+    /*  and cascades down at the start of its span on the levels above */
+    /*  the current slot is still to cascade when timr_now starts its span */
+    cur = (timr_now >> (TIMR_BITS * level)) & TIMR_MASK;
+    d = ((timr_now & ((1UL << (TIMR_BITS * level)) - 1)) == 0) ? 0 : 1;
+    for (; d <= TIMR_SLOTS; d++) {
+      if (wheel[level][(cur + d) & TIMR_MASK].next != &wheel[level][(cur + d) & TIMR_MASK]) break;
+    }
+    when = ((timr_now >> (TIMR_BITS * level)) + d) << (TIMR_BITS * level);
+
+    if ((armed == 0) || (when < next)) next = when;
+    armed = 1;
+  }
+
+  if (armed == 0) return(-1);
+
+  elapsed = timr_clock();
+  if (next * EVNT_TICK <= elapsed) return(0);
+
+  return((int)(next * EVNT_TICK - elapsed));
+}
+
+
+/**************/
+/* timr_run() */
+/**************/
+/* run all timers due by now */
+void
+timr_run(void)
+{
+unsigned long target = 0;
+int level = 0;
+int armed = 0;
+
+  target = timr_clock() / EVNT_TICK;
+
+  while (timr_now <= target) {
+    armed = 0;
+    for (level = 0; level < TIMR_LEVELS; level++) armed += timr_count[level];
+    if (armed == 0) {
+      /* nothing armed, the wheel can jump ahead */
+      timr_now = target + 1;
+      break;
+    }
+    timr_tick();
+  }
+}
+
+
+/*********************/
+/* evnt_timer_init() */
+/*********************/
+/* prepare io_t to call in_f(in_arg) when it expires */
+void
+evnt_timer_init(
+ struct evnt_timer_struct *io_t,
+ void (*in_f)(void *),
+ void *in_arg)
+{
+  io_t->next = io_t;
+  io_t->prev = io_t;
+  io_t->expire = 0;
+  io_t->level = (-1);
+  io_t->f = in_f;
+  io_t->arg = in_arg;
+}
+
+
+/********************/
+/* evnt_timer_add() */
+/********************/
+/* arm io_t to expire in_ms milliseconds from now, */
+/*  re-arming one already armed moves it */
+void
+evnt_timer_add(
+ struct evnt_timer_struct *io_t,
+ unsigned long in_ms)
+{
+  evnt_timer_cancel(io_t);
+
+  io_t->expire = (timr_clock() + in_ms + EVNT_TICK - 1) / EVNT_TICK;
+  timr_insert(io_t);
+}
+
+
+/***********************/
+/* evnt_timer_cancel() */
+/***********************/
+/* disarm io_t, harmless if it is not armed */
+void
+evnt_timer_cancel(
+ struct evnt_timer_struct *io_t)
+{
+  if (io_t->level < 0) return;
+
+  timr_unlink(io_t);
+  timr_count[io_t->level] -= 1;
+  io_t->level = (-1);
+}
+
+
+/********************/
+/* evnt_timer_now() */
+/********************/
+/* return: milliseconds of this worker's timer clock, */
+/*  for measuring time between events */
+unsigned long
+evnt_timer_now(void)
+{
+  return(timr_clock());
+}
+
+
+/************************/
+/* evnt_timer_pending() */
+/************************/
+/* return: 1 when in_t is armed, 0 otherwise */
+int
+evnt_timer_pending(
+ const struct evnt_timer_struct *in_t)
+{
+  return((in_t->level >= 0) ? 1 : 0);
+}
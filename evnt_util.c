@@ -23,56 +23,113 @@
 /* C language headers */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
 
 /* POSIX headers */
 /*  issue 1 */
 #include <unistd.h>
-/*  issue 4 */
-#include <poll.h>
+#include <sys/uio.h> /* struct iovec */
+#include <fcntl.h>
+/*  issue 5 */
+#include <pthread.h>
 
 /* Local headers */
 #include "evnt_util.h"
+#include "evnt_bknd.h"
+#include "evnt_timr.h"
+#include "conn_util.h"
 #include "sckt_util.h"
 #include "http_util.h"
 #include "sse_util.h"
 
 /* Macros */
-#ifndef RBUFSIZE
-#define RBUFSIZE 16384 
+/* most ready descriptors handled per wakeup */
+#ifndef EVNT_BATCH
+#define EVNT_BATCH 64
+#endif
+
+/* milliseconds a client has to send its request, */
+/*  and again to take the response, before it is dropped */
+#ifndef EVNT_REQTIMEOUT
+#define EVNT_REQTIMEOUT 30000
+#endif
+
+/* milliseconds a keep-alive connection may wait for its next request */
+#ifndef EVNT_IDLETIMEOUT
+#define EVNT_IDLETIMEOUT 15000
+#endif
+
+/* clients turned away, by the connection limit, */
+/*  are told to come back this many a second at most */
+#ifndef EVNT_WAVE
+#define EVNT_WAVE 200
 #endif
 
 /* File scope variables */
-static int stop_server = 0; /* 0 false, continue, -1 true, stop */
-static int listen_count = 0;
- /* number of sockets on the primary listen port 80, or 8080 */
+static int stop_server = 0; /* 0 false, continue, 1 true, stop */
+ /* read and written atomically, from any worker or the signal handler */
+
+/* connection limit, over all workers, and the count against it */
+/*  read and written atomically, from any worker */
+static unsigned int max_connections = 0;
+static unsigned int open_connections = 0;
+
+/* the second, of the monotonic clock, the next client turned away */
+/*  is told to come back at, and how many have been told it */
+static long wave_sec = 0;
+static unsigned int wave_count = 0;
+static pthread_mutex_t wave_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the rest is kept per worker thread */
+static EVNT_LOCAL int listen_count = 0;
+static EVNT_LOCAL int listen_fd[2] = { -1, -1 };
+ /* sockets on the primary listen port 80, or 8080 */
  /*  for possibility of IPv4 and/or IPv6 */
  /*  other sockets after accept */
  /*  are connected to another (ephemeral) port */
-static int max_connections = 0;
 
-static unsigned int    polld_size  = 0;
-static unsigned int    polld_count = 0;
-static struct pollfd  *polld_array = NULL;
+/* connections marked dead during an event, */
+/*  closed by evnt_reap() once the event is handled */
+static EVNT_LOCAL int *dead_fd = NULL;
+static EVNT_LOCAL unsigned int dead_count = 0;
+static EVNT_LOCAL unsigned int dead_size = 0;
+
+/* a descriptor held in reserve, given up to accept a client */
+/*  when none are left, see evnt_shed() */
+static EVNT_LOCAL int spare_fd = -1;
 
 /* External variables */
 /* External functions */
-
 /* Structures and unions */
-/* polld array has to be constantly compacted */
-
-/*  map_poll_buf maps the index of poll array (file descriptor) */
-/*  to the index of buffer fd_buf for that file descriptor */
-static signed int *map_poll_buf = NULL;
+/*  per descriptor state lives in the connection table, conn_util.c */
+
+/* a message posted to a worker, run by that worker's thread */
+/*  its data is copied in just after the structure */
+struct evnt_msg_struct {
+ struct evnt_msg_struct *next;
+ void (*f)(void *);
+ void *arg;
+};
 
-/* fd_buf is an array of buffers for holding HTTP requests */
-struct fd_buf_struct {
- int fd;
- unsigned int pos;
- char buf[RBUFSIZE];
+/* each worker has a mailbox, a lock-free multi-producer */
+/*  single-consumer queue, any thread pushes, only its worker pops */
+/*  and a pipe its event loop watches, to be woken when mail arrives */
+struct evnt_worker_struct {
+ struct evnt_msg_struct *head; /* newest, producers swap themselves in */
+ struct evnt_msg_struct *tail; /* oldest, only the worker touches it */
+ struct evnt_msg_struct stub;  /* keeps the queue never empty */
+ int woken;                    /* a wake byte is on its way */
+ int active;
+ int wake_fd[2];
 };
-static struct fd_buf_struct *fd_buf = NULL;
+static struct evnt_worker_struct worker_tab[EVNT_MAXWORKERS];
+static int worker_count = 0;
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static EVNT_LOCAL struct evnt_worker_struct *self = NULL;
 
 
 /* Signal catching functions */
@@ -85,13 +142,326 @@ static void
 interruptHandler(
  int signum)
 {
-  stop_server = 1;
+int saved_errno = errno;
+
+  /* evnt_stop() only uses write() and atomics, safe in a signal handler */
+  evnt_stop();
+  errno = saved_errno;
 }
 
 
 /* Functions */
 
 
+/*****************/
+/* evnt_expire() */
+/*****************/
+/* timer callback, a connection ran out of time */
+static void
+evnt_expire(
+ void *in_arg)
+{
+struct conn_struct *c = in_arg;
+
+  evnt_drop(c->fd);
+}
+
+
+/***************/
+/* mbox_push() */
+/***************/
+/* any thread, append in_m to io_w's mailbox */
+static void
+mbox_push(
+ struct evnt_worker_struct *io_w,
+ struct evnt_msg_struct *in_m)
+{
+struct evnt_msg_struct *prev = NULL;
+
+  __atomic_store_n(&(in_m->next), NULL, __ATOMIC_RELAXED);
+  prev = __atomic_exchange_n(&(io_w->head), in_m, __ATOMIC_ACQ_REL);
+  /* until this store, in_m is in the queue but not reachable, */
+  /*  mbox_pop() then sees an empty queue and the wake byte follows */
+  __atomic_store_n(&(prev->next), in_m, __ATOMIC_RELEASE);
+}
+
+
+/**************/
+/* mbox_pop() */
+/**************/
+/* owning worker only */
+/* return: oldest message, NULL when none can be taken now */
+static struct evnt_msg_struct *
+mbox_pop(
+ struct evnt_worker_struct *io_w)
+{
+struct evnt_msg_struct *t = io_w->tail;
+struct evnt_msg_struct *next = NULL;
+
+  next = __atomic_load_n(&(t->next), __ATOMIC_ACQUIRE);
+  if (t == &(io_w->stub)) {
+    if (next == NULL) return(NULL);
+    io_w->tail = next;
+    t = next;
+    next = __atomic_load_n(&(t->next), __ATOMIC_ACQUIRE);
+  }
+
+  if (next != NULL) {
+    io_w->tail = next;
+    return(t);
+  }
+
+  /* t is the last, put the stub back behind it before taking it */
+  if (t != __atomic_load_n(&(io_w->head), __ATOMIC_ACQUIRE)) return(NULL);
+  mbox_push(io_w, &(io_w->stub));
+  next = __atomic_load_n(&(t->next), __ATOMIC_ACQUIRE);
+  if (next != NULL) {
+    io_w->tail = next;
+    return(t);
+  }
+
+  return(NULL);
+}
+
+
+/***************/
+/* evnt_mail() */
+/***************/
+/* wake pipe is readable, run the messages posted to this worker */
+static void
+evnt_mail(void)
+{
+struct evnt_msg_struct *m = NULL;
+char scratch[64];
+
+  while (read(self->wake_fd[0], scratch, sizeof(scratch)) > 0);
+
+  /* cleared before the queue is read, so a message pushed */
+  /*  after this point is always followed by another wake byte */
+  __atomic_store_n(&(self->woken), 0, __ATOMIC_SEQ_CST);
+
+  while ((m = mbox_pop(self)) != NULL) {
+    m->f(m->arg);
+    free(m);
+  }
+}
+
+
+/*******************/
+/* evnt_post_all() */
+/*******************/
+/* run in_f on every worker's own thread, with its own copy of in_data */
+/*  messages reach each worker in the order they were posted, */
+/*  provided posters serialize among themselves */
+/*  the poster's own worker gets it too, from its event loop */
+/* return: 0 on success, -1 a worker could not be posted to */
+int
+evnt_post_all(
+ void (*in_f)(void *),
+ const void *in_data,
+ size_t in_len)
+{
+struct evnt_worker_struct *w = NULL;
+struct evnt_msg_struct *m = NULL;
+int count = 0;
+int status = 0;
+int i = 0;
+
+  count = __atomic_load_n(&worker_count, __ATOMIC_ACQUIRE);
+  for (i = 0; i < count; i++) {
+    w = &worker_tab[i];
+    if (!__atomic_load_n(&(w->active), __ATOMIC_ACQUIRE)) continue;
+
+    m = malloc(sizeof(struct evnt_msg_struct) + in_len);
+    if (m == NULL) {
+      fprintf(stderr, "evnt_post_all: malloc() error\n");
+      status = (-1);
+      continue;
+    }
+    m->f = in_f;
+    m->arg = m + 1;
+    memcpy(m->arg, in_data, in_len);
+
+    mbox_push(w, m);
+    if (__atomic_exchange_n(&(w->woken), 1, __ATOMIC_SEQ_CST) == 0) {
+      write(w->wake_fd[1], "", 1);
+    }
+  }
+
+  return(status);
+}
+
+
+/***************/
+/* evnt_stop() */
+/***************/
+/* ask every worker's event loop to end */
+void
+evnt_stop(void)
+{
+int i = 0;
+
+  __atomic_store_n(&stop_server, 1, __ATOMIC_SEQ_CST);
+  for (i = 0; i < __atomic_load_n(&worker_count, __ATOMIC_ACQUIRE); i++) {
+    if (__atomic_load_n(&(worker_tab[i].active), __ATOMIC_ACQUIRE)) {
+      write(worker_tab[i].wake_fd[1], "", 1);
+    }
+  }
+}
+
+
+/*****************/
+/* worker_join() */
+/*****************/
+/* give this thread a worker slot, with its mailbox and wake pipe */
+/* return: 0 on success, -1 error */
+static int
+worker_join(void)
+{
+struct evnt_worker_struct *w = NULL;
+int fcntl_flags = 0;
+int i = 0;
+
+  pthread_mutex_lock(&worker_lock);
+
+  if (worker_count >= EVNT_MAXWORKERS) {
+    pthread_mutex_unlock(&worker_lock);
+    fprintf(stderr, "worker_join: exceeds max workers\n");
+    return(-1);
+  }
+  w = &worker_tab[worker_count];
+
+  if (pipe(w->wake_fd) == (-1)) {
+    pthread_mutex_unlock(&worker_lock);
+    fprintf(stderr, "worker_join: pipe() error\n");
+    return(-1);
+  }
+  for (i = 0; i < 2; i++) {
+    fcntl_flags = fcntl(w->wake_fd[i], F_GETFL, 0);
+    fcntl(w->wake_fd[i], F_SETFL, fcntl_flags | O_NONBLOCK);
+  }
+
+  w->stub.next = NULL;
+  w->head = &(w->stub);
+  w->tail = &(w->stub);
+  w->woken = 0;
+  __atomic_store_n(&(w->active), 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&worker_count, worker_count + 1, __ATOMIC_RELEASE);
+
+  pthread_mutex_unlock(&worker_lock);
+
+  self = w;
+
+  return(0);
+}
+
+
+/**********************/
+/* evnt_retry_after() */
+/**********************/
+/* for a client turned away, when it should come back */
+/*  each second takes EVNT_WAVE of them, so a crowd, */
+/*  such as every listener after a restart, returns in waves */
+/* return: seconds from now, at least 1 */
+unsigned int
+evnt_retry_after(void)
+{
+struct timespec ts;
+long after = 0;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == (-1)) {
+    ts.tv_sec = 0;
+  }
+
+  pthread_mutex_lock(&wave_lock);
+  if (wave_sec <= ts.tv_sec) {
+    wave_sec = ts.tv_sec + 1;
+    wave_count = 0;
+  }
+  if (wave_count >= EVNT_WAVE) {
+    wave_sec += 1;
+    wave_count = 0;
+  }
+  wave_count += 1;
+  after = wave_sec - ts.tv_sec;
+  pthread_mutex_unlock(&wave_lock);
+
+  return((unsigned int)after);
+}
+
+
+/***************/
+/* evnt_load() */
+/***************/
+/* return: percent of the connection limit in use, over all workers */
+unsigned int
+evnt_load(void)
+{
+unsigned long open = 0;
+unsigned long max = 0;
+
+  open = __atomic_load_n(&open_connections, __ATOMIC_RELAXED);
+  max = __atomic_load_n(&max_connections, __ATOMIC_RELAXED);
+  if (max == 0) {
+    return(100);
+  }
+
+  return((unsigned int)(open * 100 / max));
+}
+
+
+/*****************/
+/* evnt_refuse() */
+/*****************/
+/* turn away in_fd, over the connection limit, with a 503 */
+/*  saying when to come back, instead of only closing it */
+/*  best effort, it is not waited for */
+static void
+evnt_refuse(
+ int in_fd)
+{
+char scratch[512];
+char resp[128];
+int len = 0;
+
+  /* a request already here is read, */
+  /*  so the close does not reset the connection before the answer */
+  while (sckt_read(in_fd, scratch, sizeof(scratch)) > 0);
+
+  len = snprintf(resp, sizeof(resp), "HTTP/1.1 503 Service Unavailable\r\nRetry-After: %u\r\n"
+   "Content-Length: 0\r\nConnection: close\r\n\r\n", evnt_retry_after());
+  sckt_write(in_fd, resp, len);
+}
+
+
+/***************/
+/* evnt_shed() */
+/***************/
+/* a client waits on listener in_fd, but no descriptor is left to */
+/*  accept it with, and it would wake the loop again and again */
+/*  the reserve is given up to accept it, it is turned away */
+/*  with a 503, and the reserve taken back */
+static void
+evnt_shed(
+ int in_fd)
+{
+int acpt_fd = 0;
+
+  if (spare_fd == (-1)) {
+    spare_fd = open("/dev/null", O_RDONLY);
+    if (spare_fd == (-1)) return;
+  }
+
+  close(spare_fd);
+  acpt_fd = sckt_accept(in_fd);
+  if (acpt_fd != (-1)) {
+    evnt_refuse(acpt_fd);
+    sckt_close(acpt_fd);
+  }
+  spare_fd = open("/dev/null", O_RDONLY);
+}
+
+
 /***************/
 /* polld_add() */
 /***************/
@@ -100,85 +470,454 @@ static int
 polld_add(
  int in_fd)
 {
-int i = 0;
+struct conn_struct *c = NULL;
+
+  /* counted before the limit is checked, so two workers */
+  /*  cannot both take the last place */
+  if (__atomic_add_fetch(&open_connections, 1, __ATOMIC_RELAXED) >
+   __atomic_load_n(&max_connections, __ATOMIC_RELAXED)) {
+    __atomic_sub_fetch(&open_connections, 1, __ATOMIC_RELAXED);
+    evnt_refuse(in_fd);
+    return(-1);
+  }
 
-  if (polld_count >= polld_size) {
-    fprintf(stderr, "polld_add: exceeds max poll array size\n");
+  /* claim connection table entry */
+  c = conn_add(in_fd, CONN_HTTP);
+  if (c == NULL) {
+    __atomic_sub_fetch(&open_connections, 1, __ATOMIC_RELAXED);
     return(-1);
   }
 
-  /* find an unused buffer */
-  for (i = 0; i < max_connections; i++) {
-    if (fd_buf[i].fd == (-1) ) break;
+  /* register with the readiness backend */
+  if (bknd_add(in_fd, BKND_IN) == (-1)) {
+    conn_rem(in_fd);
+    __atomic_sub_fetch(&open_connections, 1, __ATOMIC_RELAXED);
+    return(-1);
   }
-  if (i == max_connections) {
-    fprintf(stderr, "polld_add: error, no buffers available?\n");
+
+  /* half-open and idle clients are dropped, not kept forever */
+  evnt_timer_init(&(c->timer), evnt_expire, c);
+  evnt_timer_add(&(c->timer), EVNT_REQTIMEOUT);
+
+  return(0);
+}
+
+
+/****************/
+/* evnt_close() */
+/****************/
+/* remove a connection from the backend, SSE map and table, and close it */
+/*  immediately, callbacks should use evnt_drop() instead */
+void
+evnt_close(
+ int in_fd)
+{
+struct conn_struct *c = NULL;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->kind != CONN_HTTP)) {
+    fprintf(stderr, "evnt_close: descriptor not found\n");
+    return;
+  }
+
+  /* the kernel still has a send of this connection's, */
+  /*  it is closed when that completes */
+  if (c->flags & CONN_F_RING) {
+    c->flags |= CONN_F_DEAD;
+    return;
+  }
+
+  /* definitely remove from backend, before close */
+  bknd_del(in_fd);
+  if (c->sse_sub != NULL) {
+    sse_rem(in_fd);
+  }
+  conn_rem(in_fd);
+  sckt_close(in_fd);
+  __atomic_sub_fetch(&open_connections, 1, __ATOMIC_RELAXED);
+}
+
+
+/***************/
+/* evnt_drop() */
+/***************/
+/* mark a connection to be closed once the current event is handled */
+/*  its output queue is discarded and no more is sent to it */
+/* return: 0 on success, -1 not found */
+int
+evnt_drop(
+ int in_fd)
+{
+struct conn_struct *c = NULL;
+int *t = NULL;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->kind != CONN_HTTP)) {
     return(-1);
   }
+  if (c->flags & CONN_F_DEAD) {
+    return(0);
+  }
+
+  if (dead_count >= dead_size) {
+    t = realloc(dead_fd, sizeof(int) * (dead_size + 16));
+    if (t == NULL) {
+      /* cannot defer, so do not, caller must not touch it again */
+      fprintf(stderr, "evnt_drop: realloc() error\n");
+      evnt_close(in_fd);
+      return(0);
+    }
+    dead_fd = t;
+    dead_size += 16;
+  }
+
+  c->flags |= CONN_F_DEAD;
+  dead_fd[dead_count] = in_fd;
+  dead_count += 1;
+
+  return(0);
+}
+
+
+/***************/
+/* evnt_reap() */
+/***************/
+/* close the connections marked by evnt_drop() */
+static void
+evnt_reap(void)
+{
+struct conn_struct *c = NULL;
+unsigned int i = 0;
+
+  for (i = 0; i < dead_count; i++) {
+    c = conn_get(dead_fd[i]);
+    /* may have been closed, and the descriptor reused, since */
+    if ((c != NULL) && (c->flags & CONN_F_DEAD)) {
+      evnt_close(dead_fd[i]);
+    }
+  }
+  dead_count = 0;
+}
+
 
-  /* activate and reset buffer */
-  fd_buf[i].fd = in_fd;
-  fd_buf[i].pos = 0;
-  fd_buf[i].buf[0] = '\0';
+/*****************/
+/* evnt_linger() */
+/*****************/
+/* close once the output queue is all sent, from any callback */
+static void
+evnt_linger(
+ struct conn_struct *io_c)
+{
+  /* no more requests are read, only the queue is sent */
+  io_c->flags |= CONN_F_LINGER;
+  conn_buf_release(io_c);
+  bknd_mod(io_c->fd, BKND_OUT);
+  evnt_timer_add(&(io_c->timer), EVNT_REQTIMEOUT);
+}
 
-  /* map poll array index to buffer index */
-  map_poll_buf[polld_count] = i;
 
-  /* append fd onto polld array */
-  polld_array[polld_count].fd = in_fd;
-  polld_array[polld_count].events = POLLIN;
-  polld_array[polld_count].revents = 0;
+/*****************/
+/* evnt_policy() */
+/*****************/
+/* set what happens when in_fd's output queue is over budget */
+/*  EVNT_DROP closes the client, EVNT_LATEST keeps only the */
+/*  message being sent and the newest one */
+/* return: 0 on success, -1 not found */
+int
+evnt_policy(
+ int in_fd,
+ int in_policy)
+{
+struct conn_struct *c = NULL;
 
-  polld_count += 1;
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->kind != CONN_HTTP)) {
+    return(-1);
+  }
+  c->out_policy = in_policy;
 
   return(0);
 }
 
 
 /***************/
-/* polld_rem() */
+/* evnt_send() */
 /***************/
-/* return: 0 on success, -1 error */
-static int
-polld_rem(
- int in_fd)
+/* send in_buf to in_fd without blocking */
+/*  what the socket does not take now is queued and sent */
+/*  by the event loop when the socket is writable again */
+/*  a client that falls too far behind is handled by its policy */
+/* return: 0 on success (sent or queued), -1 connection dropped */
+int
+evnt_send(
+ int in_fd,
+ const char *in_buf,
+ size_t in_len)
 {
-int i = 0;
-int m = 0;
+struct conn_struct *c = NULL;
+ssize_t nw = 0;
+int was_empty = 0;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->kind != CONN_HTTP) || (c->flags & CONN_F_DEAD)) {
+    return(-1);
+  }
 
-  /* find file_descriptor */
-  for (i = listen_count; i < polld_count; i++) {
-    if (polld_array[i].fd == in_fd) break;
+  /* a shared SSE frame or a body part way out counts as waiting output */
+  was_empty = (c->out_off == c->out_len) && (c->sse_frame == NULL) && (c->ref_len == 0);
+
+  if (was_empty) {
+    /* nothing waiting, try the socket directly */
+    nw = sckt_write(in_fd, in_buf, in_len);
+    if (nw == (-1)) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+        c->out_errno = errno;
+        evnt_drop(in_fd);
+        return(-1);
+      }
+      nw = 0;
+    }
+    if (nw == in_len) {
+      return(0);
+    }
+    in_buf += nw;
+    in_len -= nw;
+  } else if (c->out_policy == EVNT_LATEST) {
+    /* coalesce, whatever waits behind the message in flight is stale */
+    c->out_len = c->out_frame;
   }
-  if (i == polld_count) {
-    fprintf(stderr, "polld_rem: descriptor not found\n");
+
+  if (conn_out_push(c, in_buf, in_len) == (-1)) {
+    fprintf(stderr, "evnt_send: client exceeds output queue, dropped\n");
+    evnt_drop(in_fd);
     return(-1);
   }
 
-  m = map_poll_buf[i];
+  if (was_empty) {
+    c->out_frame = c->out_len;
+    /* now also wait for the socket to be writable */
+    bknd_mod(in_fd, (c->flags & CONN_F_LINGER) ? BKND_OUT : (BKND_IN | BKND_OUT));
+  }
 
-  /* de-activate buffer associated with fd */
-  fd_buf[m].fd = (-1);
-  fd_buf[m].pos = 0;
-  fd_buf[m].buf[0] = '\0';
+  return(0);
+}
 
-  /* remove, compact polld array by overwriting and shifting down */
-  polld_count -= 1;
-  while (i < polld_count) {
 
-    polld_array[i].fd = polld_array[i+1].fd;
-    polld_array[i].events = polld_array[i+1].events;
-    polld_array[i].revents = polld_array[i+1].revents;
+/****************/
+/* evnt_error() */
+/****************/
+/* why evnt_send() dropped in_fd, told once */
+/*  its other failures, a full queue or a connection already */
+/*  dropped, were not of a write and leave errno as it was */
+/* return: errno of the failed write, 0 none or already told */
+int
+evnt_error(
+ int in_fd)
+{
+struct conn_struct *c = NULL;
+int e = 0;
 
-    map_poll_buf[i] = map_poll_buf[i+1];
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->kind != CONN_HTTP)) {
+    return(0);
+  }
+  e = c->out_errno;
+  c->out_errno = 0;
 
-    i += 1;
+  return(e);
+}
+
+
+/*******************/
+/* evnt_send_ref() */
+/*******************/
+/* send in_head then in_body to in_fd, without copying the body */
+/*  both go in one gather write, what the socket does not take now */
+/*  is sent by the event loop, the head from the output queue */
+/*  and the body from where it lies, so in_body must stay valid */
+/*  and unchanged until in_done(in_arg) is called, which it is */
+/*  once, when the body has gone or the connection has, */
+/*  in_done may be NULL for a body that is never released */
+/*  nothing more is sent to in_fd until the body has gone, */
+/*  pipelined requests are held back until then */
+/* return: 0 on success (sent or pending), -1 connection dropped */
+int
+evnt_send_ref(
+ int in_fd,
+ const char *in_head,
+ size_t in_head_len,
+ const char *in_body,
+ size_t in_body_len,
+ void (*in_done)(void *),
+ void *in_arg)
+{
+struct conn_struct *c = NULL;
+struct iovec iov[2];
+ssize_t nw = 0;
+int was_empty = 0;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->kind != CONN_HTTP) || (c->flags & CONN_F_DEAD) || (c->ref_len > 0)) {
+    if (in_done != NULL) in_done(in_arg);
+    return(-1);
   }
 
+  was_empty = (c->out_off == c->out_len) && (c->sse_frame == NULL);
+
+  if (was_empty) {
+    iov[0].iov_base = (void *)in_head;
+    iov[0].iov_len = in_head_len;
+    iov[1].iov_base = (void *)in_body;
+    iov[1].iov_len = in_body_len;
+    nw = sckt_writev(in_fd, iov, 2);
+    if (nw == (-1)) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+        if (in_done != NULL) in_done(in_arg);
+        evnt_drop(in_fd);
+        return(-1);
+      }
+      nw = 0;
+    }
+    if ((size_t)nw == in_head_len + in_body_len) {
+      if (in_done != NULL) in_done(in_arg);
+      return(0);
+    }
+  }
+
+  /* the rest of the head is small, and queued */
+  if ((size_t)nw < in_head_len) {
+    if (conn_out_push(c, in_head + nw, in_head_len - nw) == (-1)) {
+      fprintf(stderr, "evnt_send_ref: client exceeds output queue, dropped\n");
+      if (in_done != NULL) in_done(in_arg);
+      evnt_drop(in_fd);
+      return(-1);
+    }
+    if (was_empty) c->out_frame = c->out_len;
+    nw = 0;
+  } else {
+    nw -= in_head_len;
+  }
+
+  if ((size_t)nw < in_body_len) {
+    c->ref = in_body + nw;
+    c->ref_len = in_body_len - nw;
+    c->ref_done = in_done;
+    c->ref_arg = in_arg;
+  } else if (in_done != NULL) {
+    in_done(in_arg);
+  }
+
+  /* stop reading requests until it has all gone */
+  bknd_mod(in_fd, BKND_OUT);
+
   return(0);
 }
 
 
+/*********************/
+/* evnt_wait_write() */
+/*********************/
+/* also wait for in_fd to be writable, for callers */
+/*  that keep their own pending output, such as sse_util.c */
+void
+evnt_wait_write(
+ int in_fd)
+{
+struct conn_struct *c = NULL;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->kind != CONN_HTTP)) {
+    return;
+  }
+
+  bknd_mod(in_fd, (c->flags & CONN_F_LINGER) ? BKND_OUT : (BKND_IN | BKND_OUT));
+}
+
+
+/****************/
+/* evnt_flush() */
+/****************/
+/* socket is writable, send queued output */
+static void
+evnt_flush(
+ struct conn_struct *io_c)
+{
+ssize_t nw = 0;
+int fd = io_c->fd;
+
+  /* a shared SSE frame part way out is mid-stream, it goes first */
+  if ((io_c->sse_frame != NULL) && (sse_pump(fd, 0) != 0)) {
+    return;
+  }
+
+  while (io_c->out_off < io_c->out_len) {
+    nw = sckt_write(fd, &(io_c->out[io_c->out_off]), io_c->out_len - io_c->out_off);
+    if (nw == (-1)) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+        evnt_drop(fd);
+      }
+      return;
+    }
+    io_c->out_off += nw;
+    /* message in flight finished, the next one is in flight */
+    if (io_c->out_off >= io_c->out_frame) {
+      io_c->out_frame = io_c->out_len;
+    }
+  }
+
+  /* all sent */
+  conn_out_release(io_c);
+
+  /* a body sent by reference follows the queue, */
+  /*  each part the client takes gives it more time */
+  while (io_c->ref_len > 0) {
+    nw = sckt_write(fd, io_c->ref, io_c->ref_len);
+    if (nw == (-1)) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+        evnt_drop(fd);
+      }
+      return;
+    }
+    io_c->ref += nw;
+    io_c->ref_len -= nw;
+    evnt_timer_add(&(io_c->timer), EVNT_REQTIMEOUT);
+  }
+  conn_ref_release(io_c);
+
+  /* a latest-value SSE listener may have newer frames to catch up on */
+  if ((io_c->sse_sub != NULL) && (sse_pump(fd, 1) != 0)) {
+    return;
+  }
+
+  if (io_c->flags & CONN_F_LINGER) {
+    evnt_drop(fd);
+  } else {
+    bknd_mod(fd, BKND_IN);
+    /* an idle keep-alive connection, waiting for its next request */
+    if ((io_c->sse_sub == NULL) && (io_c->buf == NULL)) {
+      evnt_timer_add(&(io_c->timer), EVNT_IDLETIMEOUT);
+    }
+  }
+}
+
+
+/*****************/
+/* evnt_finish() */
+/*****************/
+/* the response is complete, close once its output is all sent */
+static void
+evnt_finish(
+ struct conn_struct *io_c)
+{
+  if ((io_c->out_off == io_c->out_len) && (io_c->ref_len == 0)) {
+    evnt_close(io_c->fd);
+    return;
+  }
+
+  evnt_linger(io_c);
+}
+
+
 /***************/
 /* evnt_init() */
 /***************/
@@ -190,12 +929,12 @@ evnt_init(
  unsigned int in_max_connections)
 {
 struct sigaction sa;
-int i = 0;
 
   /* register signal action handler for SIGINT */
+  /*  not restarted, so a wait with no timeout returns to the loop */
   sa.sa_handler = interruptHandler;
   sigemptyset(&sa.sa_mask);
-  sa.sa_flags = SA_RESTART;
+  sa.sa_flags = 0;
   if (sigaction(SIGINT, &sa, NULL) == (-1)) {
     fprintf(stderr, "evnt_init: sigaction() error for SIGINT\n");
   }
@@ -203,60 +942,290 @@ int i = 0;
     fprintf(stderr, "evnt_init: sigaction() error for SIGTERM\n");
   }
 
+  /* writes to a client that went away return EPIPE, */
+  /*  instead of the default SIGPIPE ending the server */
+  sa.sa_handler = SIG_IGN;
+  if (sigaction(SIGPIPE, &sa, NULL) == (-1)) {
+    fprintf(stderr, "evnt_init: sigaction() error for SIGPIPE\n");
+  }
+
   /* input checking */
-  max_connections = in_max_connections;
+  /*  every worker is given the same limit, for all of them */
+  __atomic_store_n(&max_connections, in_max_connections, __ATOMIC_RELAXED);
   if (in_fd4 < 0 && in_fd6 < 0) {
     fprintf(stderr, "evnt_init: no listen sockets\n");
     return(-1);
-  } else if (in_fd4 >= 0 && in_fd6 >= 0) {
-    listen_count = 2;
-    polld_size = max_connections + 2;
-  } else {
-    listen_count = 1;
-    polld_size = max_connections + 1;
   }
 
-  /* allocate polld_array */
-  polld_array = malloc(sizeof(struct pollfd) * polld_size);
-  if (polld_array == NULL) {
-    fprintf(stderr, "evnt_init: malloc() for poll error\n");
+  /* timers, for timeouts and deferred work */
+  if (timr_init() == (-1)) {
+    return(-1);
+  }
+
+  /* connection table, indexed by descriptor */
+  /*  it and the backend start small and grow with the connections, */
+  /*  so a high limit costs nothing until it is used */
+  if (conn_init() == (-1)) {
+    return(-1);
+  }
+
+  /* readiness backend */
+  if (bknd_init(EVNT_BATCH) == (-1)) {
+    return(-1);
+  }
+
+  /* this thread's mailbox, woken through its pipe */
+  if (worker_join() == (-1)) {
+    return(-1);
+  }
+  if (conn_add(self->wake_fd[0], CONN_WAKE) == NULL) return(-1);
+  if (bknd_add(self->wake_fd[0], BKND_IN) == (-1)) return(-1);
+
+  /* the reserve, for when descriptors run out */
+  spare_fd = open("/dev/null", O_RDONLY);
+  if (spare_fd == (-1)) {
+    fprintf(stderr, "evnt_init: open() error\n");
     return(-1);
   }
-  polld_count = 0;
+
   /* and put in listen file descriptors */
+  listen_count = 0;
   if (in_fd4 >= 0) {
-    polld_array[polld_count].fd = in_fd4;
-    polld_array[polld_count].events = POLLIN;
-    polld_count += 1;
+    if (conn_add(in_fd4, CONN_LISTEN) == NULL) return(-1);
+    if (bknd_add(in_fd4, BKND_IN) == (-1)) return(-1);
+    listen_fd[listen_count] = in_fd4;
+    listen_count += 1;
   }
   if (in_fd6 >= 0) {
-    polld_array[polld_count].fd = in_fd6;
-    polld_array[polld_count].events = POLLIN;
-    polld_count += 1;
+    if (conn_add(in_fd6, CONN_LISTEN) == NULL) return(-1);
+    if (bknd_add(in_fd6, BKND_IN) == (-1)) return(-1);
+    listen_fd[listen_count] = in_fd6;
+    listen_count += 1;
   }
 
-  /* allocate for map from polld array index to buffer index */
-  /*  and read buffers */
-  map_poll_buf = malloc(sizeof(signed int) * polld_size);
-  if (map_poll_buf == NULL) {
-    fprintf(stderr, "evnt_init: malloc() for map error\n");
-    return(-1);
+  fprintf(stderr, "evnt_init: using %s backend\n", bknd_name());
+
+  return(0);
+}
+
+
+/****************/
+/* evnt_serve() */
+/****************/
+/* answer the complete requests in io_c's buffer, in order */
+/*  a client may send its next requests before the first is answered */
+/* return: as http_handle(), for the last request handled */
+static int
+evnt_serve(
+ struct conn_struct *io_c)
+{
+int fd = io_c->fd;
+int code = 0;
+
+  while (1) {
+    code = http_handle(fd);
+    if (code != 1) {
+      return(code);
+    }
+
+    /* the callback may have given up on the connection */
+    if ((conn_get(fd) != io_c) || (io_c->flags & CONN_F_DEAD)) {
+      return(code);
+    }
+
+    conn_buf_consume(io_c, io_c->req.head_len + io_c->req.body_len);
+    if (io_c->ref_len > 0) {
+      /* a body is part way out, the next request waits for it */
+      /*  and the client has time to take it */
+      evnt_timer_add(&(io_c->timer), EVNT_REQTIMEOUT);
+      return(code);
+    }
+    if (io_c->buf == NULL) {
+      /* all answered, wait for the next request */
+      evnt_timer_add(&(io_c->timer), EVNT_IDLETIMEOUT);
+      return(code);
+    }
+
+    /* the next request has started */
+    evnt_timer_add(&(io_c->timer), EVNT_REQTIMEOUT);
   }
-  for (i = 0; i < polld_size; i++) {
-    map_poll_buf[i] = (-1);
+}
+
+
+/*****************/
+/* evnt_served() */
+/*****************/
+/* after evnt_serve(), in_code as it returned, in_eof set when the */
+/*  client has closed its side: keep io_c, or close it once answered */
+static void
+evnt_served(
+ struct conn_struct *io_c,
+ int in_code,
+ int in_eof)
+{
+struct conn_struct *c = NULL;
+int fd = io_c->fd;
+
+  c = conn_get(fd);
+  if ((c != io_c) || (c->flags & CONN_F_DEAD)) {
+    return;
   }
-  fd_buf = malloc(sizeof(struct fd_buf_struct) * max_connections);
-  if (fd_buf == NULL) {
-    fprintf(stderr, "evnt_init: malloc() for fd_buf error\n");
-    return(-1);
+
+  if (c->flags & CONN_F_WAIT) {
+    /* parked, keep any request pipelined behind this one */
+    /*  for evnt_resume(), an empty buffer goes back to the pool */
+    conn_buf_consume(c, c->req.head_len + c->req.body_len);
+    if (in_eof) evnt_drop(fd);
+    return;
   }
-  for (i = 0; i < max_connections; i++) {
-    fd_buf[i].fd = (-1);
-    fd_buf[i].buf[0] = '\0';
-    fd_buf[i].pos = 0;
+
+  if (c->sse_sub != NULL) {
+    /* answered and now an SSE listener, */
+    /*  return its buffer so listeners hold none */
+    /*  and it has no request left to time out, */
+    /*  its timer is now the heartbeat's, see sse_sub() */
+    conn_buf_release(c);
+    if (in_eof) evnt_drop(fd);
+    return;
   }
 
-  return(0);
+  if ((in_code < 0) && (conn_buf_room(c) == 0)) {
+    fprintf(stderr, "evnt_served: read buffer exceeded\n");
+    in_code = 0;
+  }
+
+  if ((in_code == 0) || in_eof) {
+    /* close, after the responses have been sent */
+    /*  also once a client that closed its side has its answers */
+    evnt_finish(c);
+  }
+}
+
+
+/***************/
+/* evnt_recv() */
+/***************/
+/* socket is readable, read requests and hand them to http_handle */
+static void
+evnt_recv(
+ struct conn_struct *io_c)
+{
+struct conn_struct *c = io_c;
+char scratch[256];
+ssize_t nr = 0;
+int fd = io_c->fd;
+int close_code = 0;
+int idle = 0;
+int rem = 0;
+
+  if ((c->sse_sub != NULL) && !(c->flags & CONN_F_WAIT)) {
+    /* SSE listeners hold no read buffer, */
+    /*  anything they send is discarded, only watching for close */
+    do {
+      nr = sckt_read(fd, scratch, sizeof(scratch));
+    } while (nr > 0);
+    if ((nr == (-1)) && (errno == EAGAIN)) {
+      return;
+    }
+    if (nr == (-1)) {
+      /* the peer is gone, or the kernel gave up on it */
+      sse_reap(fd, errno);
+      return;
+    }
+    evnt_drop(fd);
+    return;
+  }
+
+  /* read into buffer, taken from the pool as needed */
+  /*  a keep-alive connection between requests holds none */
+  idle = (c->buf == NULL);
+  nr = 0;
+  while ((rem = conn_buf_room(c)) > 0) {
+    nr = sckt_read(fd, &(c->buf[c->pos]), rem);
+    if (nr <= 0) break;
+    c->pos += nr;
+  }
+  if (rem == (-1)) {
+    evnt_drop(fd);
+    return;
+  }
+  c->buf[c->pos] = '\0'; /* zero terminate string */
+
+  /* has read until nr is -1 (EAGAIN or error) */
+  /*  or 0 (client closed connection or buf full) */
+
+  if ((nr == (-1)) && (errno != EAGAIN)) {
+    fprintf(stderr, "evnt_recv: read() error\n");
+    evnt_drop(fd);
+    return;
+  }
+  if ((nr == 0) && (rem > 0) && (c->pos == 0)) {
+    /* client closed connection, between requests */
+    evnt_drop(fd);
+    return;
+  }
+
+  if (c->flags & CONN_F_WAIT) {
+    /* a long-poll request is parked, what follows it is kept */
+    /*  and served once it is answered, see evnt_resume() */
+    if ((nr == 0) && (rem > 0)) {
+      evnt_drop(fd);
+    } else if (rem == 0) {
+      fprintf(stderr, "evnt_recv: read buffer exceeded\n");
+      evnt_drop(fd);
+    }
+    return;
+  }
+
+  /* a new request has started, it has its own time to arrive */
+  if (idle && (c->pos > 0)) {
+    evnt_timer_add(&(c->timer), EVNT_REQTIMEOUT);
+  }
+
+  close_code = evnt_serve(c); /* 0 close, -1 keep-alive or incomplete, */
+                              /*  1 answered, may serve another */
+
+  evnt_served(c, close_code, (nr == 0) && (rem > 0));
+}
+
+
+/*****************/
+/* evnt_resume() */
+/*****************/
+/* a connection whose timer was taken over, by sse_util.c, */
+/*  is handed back, to wait for its next request */
+/*  or, if that was its last, to be closed once its answer is sent, */
+/*  so call it after the answer is sent or queued */
+/*  requests the client sent while it waited are served now */
+void
+evnt_resume(
+ int in_fd)
+{
+struct conn_struct *c = NULL;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->kind != CONN_HTTP)) {
+    return;
+  }
+
+  evnt_timer_cancel(&(c->timer));
+  evnt_timer_init(&(c->timer), evnt_expire, c);
+  if (c->flags & CONN_F_LAST) {
+    if ((c->out_off == c->out_len) && (c->ref_len == 0)) {
+      evnt_drop(in_fd);
+    } else {
+      evnt_linger(c);
+    }
+    return;
+  }
+  if (c->buf != NULL) {
+    /* pipelined behind the answered one, already read */
+    /*  so no readable event is coming for them */
+    evnt_timer_add(&(c->timer), EVNT_REQTIMEOUT);
+    evnt_served(c, evnt_serve(c), 0);
+    return;
+  }
+  evnt_timer_add(&(c->timer), EVNT_IDLETIMEOUT);
 }
 
 
@@ -266,108 +1235,103 @@ int i = 0;
 int
 evnt_loop(void)
 {
-char *buf = NULL;
-ssize_t nr = 0;
+struct bknd_event ready[EVNT_BATCH];
+struct conn_struct *c = NULL;
+int held = 0;
 int i = 0;
-int poll_status = 0;
+int n = 0;
 int acpt_fd = 0;
 int fd = 0;
-int close_code = 0;
-int rem = 0;
-unsigned int m = 0;
-unsigned int p = 0;
 
-  while(stop_server == 0) {
+  while(__atomic_load_n(&stop_server, __ATOMIC_SEQ_CST) == 0) {
 
-    poll_status = poll(polld_array, polld_count, 100);
+    /* only descriptors with events are returned */
+    /*  so the cost of a wakeup follows the number ready */
+    /*  and with no timer armed it sleeps until one is */
+    n = bknd_wait(ready, EVNT_BATCH, timr_timeout());
 
-    if (poll_status == (-1)  ) {
-      /* either poll() error */
-      /*  or poll() interrupted by SIGINT, interruptHandler called */
-      /*  and control returned to poll(), with errno set to EINTR */
-      if (errno != EINTR) {
-        fprintf(stderr, "evnt_loop: poll() error\n");
-        stop_server = 1;
-      }
-    } else if (poll_status == 0) {
-      /* timed out, idle */
-    } else {
-      /* event to handle */
+    if (n == (-1)) {
+      fprintf(stderr, "evnt_loop: wait error\n");
+      evnt_stop();
+    }
 
-      /* loop through all the poll descriptors */
-      for (i = 0; i < polld_count; i++) {
+    for (i = 0; i < n; i++) {
 
-        /* skip descriptors without events */
-        if (polld_array[i].revents == 0) {
-          continue;
-        }
+      fd = ready[i].fd;
 
-        if (i < listen_count) {
-          /* handle connection on listen socket */
+      /* an earlier event in this batch may have closed it */
+      c = conn_get(fd);
+      if (c == NULL) {
+        continue;
+      }
 
-          acpt_fd = sckt_accept(polld_array[i].fd);
-          if (acpt_fd == (-1)) {
+      if (c->kind == CONN_LISTEN) {
+        /* handle connection on listen socket */
+
+        acpt_fd = sckt_accept(fd);
+        if (acpt_fd == (-1)) {
+          /* out of descriptors, or the client already gone, */
+          /*  costs that client only */
+          if ((errno == EMFILE) || (errno == ENFILE)) {
+            evnt_shed(fd);
+          } else if ((errno != ENOBUFS) &&
+           (errno != ENOMEM) && (errno != ECONNABORTED) && (errno != EAGAIN) &&
+           (errno != EINTR)) {
             fprintf(stderr, "evnt_loop: accept() error\n");
-            stop_server = 1;
-          } else {
-            if (polld_add(acpt_fd) == (-1)) {
-              sckt_close(acpt_fd);
-            }
+            evnt_stop();
           }
-
         } else {
-          /* handle non-listen socket event */
-
-          /* read into buffer */
-          fd = polld_array[i].fd;
-          m = map_poll_buf[i];
-          p = fd_buf[m].pos;
-          buf = &(fd_buf[m].buf[p]);
-          rem = (RBUFSIZE -1) - p;
-          while ((nr = sckt_read(fd, buf, rem)) > 0) {
-            rem -= nr;
-            buf += nr;
-            fd_buf[m].pos += nr;
-          }
-          *buf = '\0'; /* zero terminate string */
-
-          /* has read until nr is -1 (EAGAIN or error) */
-          /*  or 0 (client closed connection or buf full) */
-
-          close_code = 0; /* default is 0 close, -1 for keep-alive */
-                          /* +1 for client already closed socket */
-
-          if (nr == (-1)) {
-            if (errno == EAGAIN) {
-              close_code = http_handle(fd_buf[m].buf, fd_buf[m].fd);
-            } else {
-              fprintf(stderr, "evnt_loop: read() error\n");
-            }
-          } else {
-            if (rem > 0) {
-              /* client closed connection */
-              close_code = 1;
-            } else {
-              fprintf(stderr, "evnt_loop: read buffer exceeded\n");
-            }
+          if (polld_add(acpt_fd) == (-1)) {
+            sckt_close(acpt_fd);
           }
+        }
 
-          if (close_code >= 0) {
-            if (close_code == 0) {
-              sckt_close(polld_array[i].fd);
-            }
-            /* definitely remove from poll array */
-            polld_rem(polld_array[i].fd);
-            /* no way to know if SSE or not, try to remove */
-            sse_rem(polld_array[i].fd);
-          }
+        continue;
+      }
 
+      if (c->kind == CONN_WAKE) {
+        /* messages from other threads, or a stop */
+        evnt_mail();
+        evnt_reap();
+        continue;
+      }
+
+      /* handle non-listen socket event */
+
+      if (ready[i].events & BKND_DONE) {
+        /* a queued SSE send completed, continue it, */
+        /*  or close the connection if that was waiting for it */
+        sse_done(fd, ready[i].res);
+        if (c->flags & CONN_F_DEAD) {
+          evnt_close(fd);
         }
+        evnt_reap();
+        continue;
+      }
+
+      /* writable, or error to discover, send what is queued */
+      held = (c->ref_len > 0);
+      if ((ready[i].events & (BKND_OUT | BKND_ERR)) &&
+          ((c->out_off < c->out_len) || (c->sse_frame != NULL) || held)) {
+        evnt_flush(c);
+      }
 
+      /* readable, unless closing or a body is part way out */
+      /*  once that has gone, requests that were held back are served */
+      if (!(c->flags & (CONN_F_DEAD | CONN_F_LINGER)) && (c->ref_len == 0) &&
+          ((ready[i].events & (BKND_IN | BKND_ERR)) || (held && (c->pos > 0)))) {
+        evnt_recv(c);
       }
 
+      /* close this connection, or any a callback gave up on */
+      evnt_reap();
+
     }
-    
+
+    /* timers due by now, then close any connection they gave up on */
+    timr_run();
+    evnt_reap();
+
   }
 
   return(0);
@@ -380,16 +1344,66 @@ unsigned int p = 0;
 void
 evnt_end(void)
 {
-int i = 0;
+struct evnt_msg_struct *m = NULL;
+struct conn_struct *c = NULL;
+int drained = 0;
+int fd = 0;
+
+  /* sends still with the kernel are cancelled and waited for, */
+  /*  before the frames they read are freed with their connections */
+  /*  should any not finish, their connections, and frames, are */
+  /*  left, not freed */
+  drained = (bknd_drain() == 0);
+
+  for (fd = 0; fd < conn_size(); fd++) {
+    c = conn_get(fd);
+    if ((c != NULL) && (c->kind == CONN_HTTP)) {
+      if (drained) c->flags &= ~CONN_F_RING;
+      evnt_close(fd);
+    }
+  }
 
-  i = listen_count;
-  while (i < polld_count) {
-    sckt_close(polld_array[i].fd);
-    polld_rem(polld_array[i].fd);
-    i += 1;
+  bknd_end();
+  conn_end();
+  free(dead_fd);
+  dead_fd = NULL;
+  dead_size = 0;
+  if (spare_fd != (-1)) close(spare_fd);
+  spare_fd = -1;
+
+  /* leave the worker slot, mail still queued is dropped */
+  /*  a thread may still be posting to it, so its mailbox */
+  /*  and wake pipe are kept until evnt_free() */
+  if (self != NULL) {
+    __atomic_store_n(&(self->active), 0, __ATOMIC_RELEASE);
+    while ((m = mbox_pop(self)) != NULL) free(m);
+    self = NULL;
   }
+}
+
+
+/***************/
+/* evnt_free() */
+/***************/
+/* once every worker has ended and no thread posts any more, */
+/*  release the mailboxes and wake pipes */
+void
+evnt_free(void)
+{
+struct evnt_worker_struct *w = NULL;
+struct evnt_msg_struct *m = NULL;
+int count = 0;
+int i = 0;
+
+  pthread_mutex_lock(&worker_lock);
+  count = worker_count;
+  __atomic_store_n(&worker_count, 0, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&worker_lock);
 
-  free(polld_array);
-  free(map_poll_buf);
-  free(fd_buf);
+  for (i = 0; i < count; i++) {
+    w = &worker_tab[i];
+    while ((m = mbox_pop(w)) != NULL) free(m);
+    close(w->wake_fd[0]);
+    close(w->wake_fd[1]);
+  }
 }
@@ -19,10 +19,75 @@
 #ifndef evnt_util_h
 #define evnt_util_h
 
+#include <stddef.h>
+
+/* state kept per worker, each worker thread runs its own event loop */
+/*  over its own listen sockets, connections, timers and eventsources */
+#ifndef EVNT_LOCAL
+#define EVNT_LOCAL __thread
+#endif
+
+/* most worker threads */
+#ifndef EVNT_MAXWORKERS
+#define EVNT_MAXWORKERS 64
+#endif
+
+/* timer, storage owned by the caller, see evnt_timr.c */
+/*  arm and cancel are O(1), a timer is one-shot and may re-arm itself */
+struct evnt_timer_struct {
+ struct evnt_timer_struct *next;
+ struct evnt_timer_struct *prev;
+ unsigned long expire; /* wheel tick */
+ int level;            /* wheel level, -1 when not armed */
+ void (*f)(void *);
+ void *arg;
+};
+
+/* output queue policies, for a client over its budget */
+#define EVNT_DROP   0 /* close the client */
+#define EVNT_LATEST 1 /* keep only the newest message waiting */
+
 int evnt_init(int in_fd4, int in_fd6, unsigned int in_max_connections);
 
 int evnt_loop(void);
 
+void evnt_close(int in_fd);
+
+int evnt_drop(int in_fd);
+
+void evnt_resume(int in_fd);
+
+int evnt_policy(int in_fd, int in_policy);
+
+unsigned int evnt_load(void);
+
+unsigned int evnt_retry_after(void);
+
+int evnt_send(int in_fd, const char *in_buf, size_t in_len);
+
+int evnt_error(int in_fd);
+
+int evnt_send_ref(int in_fd, const char *in_head, size_t in_head_len, const char *in_body, size_t in_body_len,
+ void (*in_done)(void *), void *in_arg);
+
+void evnt_wait_write(int in_fd);
+
+int evnt_post_all(void (*in_f)(void *), const void *in_data, size_t in_len);
+
+void evnt_stop(void);
+
+void evnt_timer_init(struct evnt_timer_struct *io_t, void (*in_f)(void *), void *in_arg);
+
+void evnt_timer_add(struct evnt_timer_struct *io_t, unsigned long in_ms);
+
+void evnt_timer_cancel(struct evnt_timer_struct *io_t);
+
+int evnt_timer_pending(const struct evnt_timer_struct *in_t);
+
+unsigned long evnt_timer_now(void);
+
 void evnt_end(void);
 
+void evnt_free(void);
+
 #endif
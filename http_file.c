@@ -0,0 +1,866 @@
+/* http_file.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* static file cache */
+/*  every file of a known type in the directory is read at startup */
+/*  and kept with ready response heads, identity and gzip, */
+/*  and brotli when built with -DHTTP_BROTLI */
+/*  a compressed variant is kept only when it is smaller */
+/*  head and body go out in one gather write, neither is copied again */
+/*  a file over FILE_ZMAX is mapped instead, its identity body */
+/*  is the file itself, so it must be replaced by rename, */
+/*  not rewritten in place, while served */
+/* each variant has a strong ETag, from a hash of the file */
+/*  and the encoding, so a client that has it is answered 304 */
+/*  Cache-Control: no-cache has clients revalidate every load, */
+/*  which is one small request when nothing has changed */
+/* the cache is one table, built before worker threads start and */
+/*  rebuilt whole by file_reload() when the directory changes, */
+/*  then swapped in, a response in flight holds a reference to */
+/*  the table it started with, which is freed after the last one */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+/* POSIX headers */
+#include <strings.h> /* strncasecmp */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+/*  POSIX Issue 5 */
+#include <pthread.h>
+
+/* zlib, in base on OpenBSD */
+#include <zlib.h>
+#if defined(HTTP_BROTLI)
+#include <brotli/encode.h>
+#endif
+
+/* Local headers */
+#include "http_util.h"
+#include "http_file.h"
+#include "evnt_util.h"
+
+/* Macros */
+/* the file served for "/" */
+#ifndef FILEINDEX
+#define FILEINDEX "root.html"
+#endif
+
+/* largest file compressed, larger ones are sent as they are */
+#ifndef FILE_ZMAX
+#define FILE_ZMAX (1024 * 1024)
+#endif
+
+/* variants of a file, by content coding */
+#define FILE_IDENTITY 0
+#define FILE_GZIP     1
+#define FILE_BR       2
+#define FILE_VARS     3
+
+/* File scope variables */
+/* External variables */
+/* External functions */
+
+/* Structures and unions */
+
+/* one content coding of a file, as ready to send responses */
+struct file_var_struct {
+ char *head;         /* of the 200 response, HEAD is answered with it */
+ size_t head_len;
+ const char *body;   /* copy of the file, mapping of a large one, or compressed */
+ size_t body_len;
+ char *not_mod;      /* 304 response */
+ size_t not_mod_len;
+ char etag[32];      /* quoted */
+ unsigned int etag_len;
+};
+
+struct file_struct {
+ char *name;
+ int mapped; /* identity body is a mapping of the file, not a copy */
+ struct file_var_struct var[FILE_VARS]; /* head NULL when not kept */
+};
+
+/* every file of the directory, as loaded at one time */
+struct file_tab_struct {
+ unsigned int refs; /* one while current, and one per response in flight */
+ unsigned int count;
+ struct file_struct *file;
+};
+
+/* the current table, file_lock guards taking a reference to it */
+static struct file_tab_struct *file_cur = NULL;
+static pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
+static char file_dir[1024];
+
+/* types served, anything else in the directory, */
+/*  such as the log and presets, is not */
+struct file_type_struct {
+ const char *ext;
+ const char *type;
+ int compress;
+};
+static const struct file_type_struct file_types[] = {
+ { ".html", "text/html; charset=utf-8", 1 },
+ { ".css",  "text/css; charset=utf-8", 1 },
+ { ".js",   "text/javascript; charset=utf-8", 1 },
+ { ".json", "application/json", 1 },
+ { ".svg",  "image/svg+xml", 1 },
+ { ".ico",  "image/x-icon", 1 },
+ { ".png",  "image/png", 0 },
+ { ".jpg",  "image/jpeg", 0 },
+ { NULL, NULL, 0 }
+};
+
+static const char *file_codings[FILE_VARS] = { NULL, "gzip", "br" };
+
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/***************/
+/* file_type() */
+/***************/
+/* return: type for in_name, by its extension, NULL if not served */
+static const struct file_type_struct *
+file_type(
+ const char *in_name)
+{
+size_t name_len = 0;
+size_t ext_len = 0;
+int i = 0;
+
+  name_len = strlen(in_name);
+  for (i = 0; file_types[i].ext != NULL; i++) {
+    ext_len = strlen(file_types[i].ext);
+    if ((name_len > ext_len) && (strcmp(&(in_name[name_len - ext_len]), file_types[i].ext) == 0)) {
+      return(&(file_types[i]));
+    }
+  }
+
+  return(NULL);
+}
+
+
+/***************/
+/* file_gzip() */
+/***************/
+/* return: gzip of in_buf, length in out_len, NULL on error */
+static char *
+file_gzip(
+ const char *in_buf,
+ size_t in_len,
+ size_t *out_len)
+{
+z_stream z;
+char *out = NULL;
+uLong bound = 0;
+
+  memset(&z, 0, sizeof(z));
+  /* 15 bit window, plus 16 for a gzip header and trailer */
+  if (deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+    fprintf(stderr, "file_gzip: deflateInit2() error\n");
+    return(NULL);
+  }
+
+  bound = deflateBound(&z, in_len);
+  out = malloc(bound);
+  if (out == NULL) {
+    fprintf(stderr, "file_gzip: malloc() error\n");
+    deflateEnd(&z);
+    return(NULL);
+  }
+
+  z.next_in = (Bytef *)in_buf;
+  z.avail_in = in_len;
+  z.next_out = (Bytef *)out;
+  z.avail_out = bound;
+  if (deflate(&z, Z_FINISH) != Z_STREAM_END) {
+    fprintf(stderr, "file_gzip: deflate() error\n");
+    deflateEnd(&z);
+    free(out);
+    return(NULL);
+  }
+  *out_len = z.total_out;
+  deflateEnd(&z);
+
+  return(out);
+}
+
+
+#if defined(HTTP_BROTLI)
+/*****************/
+/* file_brotli() */
+/*****************/
+/* return: brotli of in_buf, length in out_len, NULL on error */
+static char *
+file_brotli(
+ const char *in_buf,
+ size_t in_len,
+ size_t *out_len)
+{
+char *out = NULL;
+size_t bound = 0;
+
+  bound = BrotliEncoderMaxCompressedSize(in_len);
+  if (bound == 0) return(NULL);
+  out = malloc(bound);
+  if (out == NULL) {
+    fprintf(stderr, "file_brotli: malloc() error\n");
+    return(NULL);
+  }
+
+  *out_len = bound;
+  if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+   in_len, (const uint8_t *)in_buf, out_len, (uint8_t *)out)) {
+    fprintf(stderr, "file_brotli: BrotliEncoderCompress() error\n");
+    free(out);
+    return(NULL);
+  }
+
+  return(out);
+}
+#endif
+
+
+/**************/
+/* file_var() */
+/**************/
+/* build the responses of one variant, in_body of in_len bytes, */
+/*  which it keeps, in_hash of the identity body makes the ETag */
+/* return: 0 on success, -1 error */
+static int
+file_var(
+ struct file_var_struct *out_v,
+ const struct file_type_struct *in_type,
+ int in_coding,
+ unsigned long long in_hash,
+ const char *in_body,
+ size_t in_len)
+{
+char head[512];
+char coding[64];
+int len = 0;
+
+  /* the coding is part of the tag, each variant is a different entity */
+  if (in_coding == FILE_IDENTITY) {
+    out_v->etag_len = snprintf(out_v->etag, sizeof(out_v->etag), "\"%016llx\"", in_hash);
+    coding[0] = '\0';
+  } else {
+    out_v->etag_len = snprintf(out_v->etag, sizeof(out_v->etag), "\"%016llx-%s\"", in_hash, file_codings[in_coding]);
+    snprintf(coding, sizeof(coding), "Content-Encoding: %s\r\n", file_codings[in_coding]);
+  }
+
+  len = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n"
+   "Content-Length: %lu\r\nETag: %s\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n%s\r\n",
+   in_type->type, (unsigned long)in_len, out_v->etag, coding);
+  out_v->head = malloc(len);
+  if (out_v->head == NULL) {
+    fprintf(stderr, "file_var: malloc() error\n");
+    return(-1);
+  }
+  memcpy(out_v->head, head, len);
+  out_v->head_len = len;
+
+  len = snprintf(head, sizeof(head), "HTTP/1.1 304 Not Modified\r\n"
+   "ETag: %s\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n\r\n", out_v->etag);
+  out_v->not_mod = malloc(len);
+  if (out_v->not_mod == NULL) {
+    fprintf(stderr, "file_var: malloc() error\n");
+    free(out_v->head);
+    out_v->head = NULL;
+    return(-1);
+  }
+  memcpy(out_v->not_mod, head, len);
+  out_v->not_mod_len = len;
+
+  out_v->body = in_body;
+  out_v->body_len = in_len;
+
+  return(0);
+}
+
+
+/***************/
+/* file_read() */
+/***************/
+/* return: a copy of in_size bytes of in_fd, NULL on error */
+static char *
+file_read(
+ int in_fd,
+ size_t in_size)
+{
+char *buf = NULL;
+size_t got = 0;
+ssize_t n = 0;
+
+  buf = malloc(in_size);
+  if (buf == NULL) {
+    fprintf(stderr, "file_read: malloc() error\n");
+    return(NULL);
+  }
+
+  while (got < in_size) {
+    n = read(in_fd, &(buf[got]), in_size - got);
+    if ((n == (-1)) && (errno == EINTR)) continue;
+    if (n <= 0) {
+      fprintf(stderr, "file_read: read() %s\n", (n == 0) ? "short" : "error");
+      free(buf);
+      return(NULL);
+    }
+    got += (size_t)n;
+  }
+
+  return(buf);
+}
+
+
+/***************/
+/* file_drop() */
+/***************/
+/* release a body file_load() read or mapped */
+static void
+file_drop(
+ char *in_body,
+ size_t in_size,
+ int in_mapped)
+{
+  if (in_size == 0) return;
+  if (in_mapped) {
+    munmap(in_body, in_size);
+  } else {
+    free(in_body);
+  }
+}
+
+
+/***************/
+/* file_load() */
+/***************/
+/* read or map in_path and add it to io_tab as in_name */
+/* return: 0 on success, -1 error */
+static int
+file_load(
+ struct file_tab_struct *io_tab,
+ const char *in_path,
+ const char *in_name,
+ const struct file_type_struct *in_type)
+{
+struct file_struct *t = NULL;
+struct file_struct *f = NULL;
+char *body = "";
+char *z = NULL;
+size_t z_len = 0;
+unsigned long long h = 14695981039346656037ULL;
+size_t i = 0;
+struct stat st;
+size_t size = 0;
+int fd = 0;
+int mapped = 0;
+
+  /* the size is the opened file's, a stat() before the open */
+  /*  may be of one since truncated or replaced */
+  fd = open(in_path, O_RDONLY);
+  if (fd == (-1)) {
+    fprintf(stderr, "file_load: open() error %s\n", in_path);
+    return(-1);
+  }
+  if ((fstat(fd, &st) == (-1)) || !S_ISREG(st.st_mode)) {
+    fprintf(stderr, "file_load: fstat() error %s\n", in_path);
+    close(fd);
+    return(-1);
+  }
+  size = (size_t)st.st_size;
+
+  /* up to FILE_ZMAX read into a copy of its own, so the tag, */
+  /*  the compressed variants and the bytes sent are all one version */
+  /*  however the file is written meanwhile, larger ones are mapped, */
+  /*  their pages are the kernel's to keep or drop */
+  if (size == 0) {
+    close(fd);
+  } else if (size <= FILE_ZMAX) {
+    body = file_read(fd, size);
+    close(fd);
+    if (body == NULL) {
+      fprintf(stderr, "file_load: file_read() error %s\n", in_path);
+      return(-1);
+    }
+  } else {
+    body = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (body == MAP_FAILED) {
+      fprintf(stderr, "file_load: mmap() error %s\n", in_path);
+      return(-1);
+    }
+    mapped = 1;
+  }
+
+  t = realloc(io_tab->file, sizeof(struct file_struct) * (io_tab->count + 1));
+  if (t == NULL) {
+    fprintf(stderr, "file_load: realloc() error\n");
+    file_drop(body, size, mapped);
+    return(-1);
+  }
+  io_tab->file = t;
+  f = &(io_tab->file[io_tab->count]);
+  memset(f, 0, sizeof(*f));
+  f->name = malloc(strlen(in_name) + 1);
+  if (f->name == NULL) {
+    fprintf(stderr, "file_load: malloc() error\n");
+    file_drop(body, size, mapped);
+    return(-1);
+  }
+  strcpy(f->name, in_name);
+  f->mapped = mapped;
+
+  /* FNV-1a, 64 bit */
+  for (i = 0; i < size; i++) {
+    h ^= (unsigned char)body[i];
+    h *= 1099511628211ULL;
+  }
+
+  if (file_var(&(f->var[FILE_IDENTITY]), in_type, FILE_IDENTITY, h, body, size) == (-1)) {
+    free(f->name);
+    file_drop(body, size, mapped);
+    return(-1);
+  }
+
+  /* a compressed variant keeps its buffer as its body */
+  if (in_type->compress && (size <= FILE_ZMAX)) {
+    z = file_gzip(body, size, &z_len);
+    if ((z != NULL) && ((z_len >= size) ||
+     (file_var(&(f->var[FILE_GZIP]), in_type, FILE_GZIP, h, z, z_len) == (-1)))) {
+      free(z);
+    }
+#if defined(HTTP_BROTLI)
+    z = file_brotli(body, size, &z_len);
+    if ((z != NULL) && ((z_len >= size) ||
+     (file_var(&(f->var[FILE_BR]), in_type, FILE_BR, h, z, z_len) == (-1)))) {
+      free(z);
+    }
+#endif
+  }
+
+  io_tab->count += 1;
+
+  return(0);
+}
+
+
+/*****************/
+/* file_accept() */
+/*****************/
+/* whether the Accept-Encoding value in_v lists in_coding, */
+/*  or "*", with a q-value above zero */
+/* return: 1 acceptable, 0 not */
+static int
+file_accept(
+ const char *in_v,
+ unsigned int in_len,
+ const char *in_coding)
+{
+size_t coding_len = 0;
+unsigned int i = 0;
+unsigned int start = 0;
+unsigned int len = 0;
+int found = 0; /* 0 not listed, 1 listed, 2 listed as "*" */
+int zero = 0;
+int star = 0;
+
+  coding_len = strlen(in_coding);
+  while (i < in_len) {
+    while ((i < in_len) && ((in_v[i] == ' ') || (in_v[i] == '\t') || (in_v[i] == ','))) i++;
+    start = i;
+    while ((i < in_len) && (in_v[i] != ',') && (in_v[i] != ';') && (in_v[i] != ' ') && (in_v[i] != '\t')) i++;
+    len = i - start;
+
+    /* a q-value of 0, 0.0 and so on refuses the coding */
+    zero = 0;
+    while ((i < in_len) && (in_v[i] != ',')) {
+      if (((in_v[i] == 'q') || (in_v[i] == 'Q')) && (i + 2 < in_len) && (in_v[i + 1] == '=')) {
+        i += 2;
+        zero = (in_v[i] == '0');
+        while ((i < in_len) && ((in_v[i] == '0') || (in_v[i] == '.'))) i++;
+        if ((i < in_len) && isdigit((unsigned char)in_v[i])) zero = 0;
+        continue;
+      }
+      i++;
+    }
+
+    if ((len == coding_len) && (strncasecmp(&(in_v[start]), in_coding, len) == 0)) {
+      found = 1;
+      if (zero) return(0);
+    } else if ((len == 1) && (in_v[start] == '*')) {
+      star = zero ? (-1) : 1;
+    }
+  }
+
+  if (found) return(1);
+  return(star == 1);
+}
+
+
+/****************/
+/* file_match() */
+/****************/
+/* whether the If-None-Match value in_v lists in_etag, or is "*" */
+/*  weak tags compare by their opaque part, as If-None-Match allows */
+/* return: 1 matches, 0 not */
+static int
+file_match(
+ const char *in_v,
+ unsigned int in_len,
+ const char *in_etag,
+ unsigned int in_etag_len)
+{
+unsigned int i = 0;
+unsigned int start = 0;
+
+  while (i < in_len) {
+    while ((i < in_len) && ((in_v[i] == ' ') || (in_v[i] == '\t') || (in_v[i] == ','))) i++;
+    if (i >= in_len) break;
+    if (in_v[i] == '*') return(1);
+    if ((i + 1 < in_len) && (in_v[i] == 'W') && (in_v[i + 1] == '/')) i += 2;
+    start = i;
+    if ((i < in_len) && (in_v[i] == '"')) {
+      i++;
+      while ((i < in_len) && (in_v[i] != '"')) i++;
+      if (i < in_len) i++;
+    } else {
+      while ((i < in_len) && (in_v[i] != ',')) i++;
+    }
+    if ((i - start == in_etag_len) && (memcmp(&(in_v[start]), in_etag, in_etag_len) == 0)) {
+      return(1);
+    }
+  }
+
+  return(0);
+}
+
+
+/***************/
+/* file_find() */
+/***************/
+/* return: file of in_tab named in_name, NULL if none */
+static struct file_struct *
+file_find(
+ struct file_tab_struct *in_tab,
+ const char *in_name,
+ unsigned int in_len)
+{
+unsigned int i = 0;
+
+  /* a handful of files, looked for in turn */
+  for (i = 0; i < in_tab->count; i++) {
+    if ((strlen(in_tab->file[i].name) == in_len) && (memcmp(in_tab->file[i].name, in_name, in_len) == 0)) {
+      return(&(in_tab->file[i]));
+    }
+  }
+
+  return(NULL);
+}
+
+
+/***************/
+/* file_free() */
+/***************/
+/* release in_tab and everything its files hold */
+static void
+file_free(
+ struct file_tab_struct *in_tab)
+{
+struct file_var_struct *v = NULL;
+unsigned int i = 0;
+int k = 0;
+
+  for (i = 0; i < in_tab->count; i++) {
+    for (k = 0; k < FILE_VARS; k++) {
+      v = &(in_tab->file[i].var[k]);
+      if (v->head == NULL) continue;
+      free(v->head);
+      free(v->not_mod);
+      /* the identity body was read or mapped, the others compressed */
+      if (k != FILE_IDENTITY) {
+        free((char *)v->body);
+      } else {
+        file_drop((char *)v->body, v->body_len, in_tab->file[i].mapped);
+      }
+    }
+    free(in_tab->file[i].name);
+  }
+  free(in_tab->file);
+  free(in_tab);
+}
+
+
+/****************/
+/* file_unref() */
+/****************/
+/* drop a reference to table in_arg, freeing it after the last */
+/*  as evnt_send_ref() release function, on any worker thread */
+static void
+file_unref(
+ void *in_arg)
+{
+struct file_tab_struct *t = in_arg;
+
+  if (__atomic_sub_fetch(&(t->refs), 1, __ATOMIC_ACQ_REL) == 0) {
+    file_free(t);
+  }
+}
+
+
+/***************/
+/* file_hold() */
+/***************/
+/* return: the current table, with a reference taken for the caller */
+static struct file_tab_struct *
+file_hold(void)
+{
+struct file_tab_struct *t = NULL;
+
+  pthread_mutex_lock(&file_lock);
+  t = file_cur;
+  __atomic_add_fetch(&(t->refs), 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&file_lock);
+
+  return(t);
+}
+
+
+/***************/
+/* file_scan() */
+/***************/
+/* load every served file of the directory into a new table */
+/* return: the table, with one reference, NULL on error */
+static struct file_tab_struct *
+file_scan(void)
+{
+const struct file_type_struct *type = NULL;
+struct file_tab_struct *t = NULL;
+struct dirent *e = NULL;
+struct stat st;
+DIR *d = NULL;
+char path[sizeof(file_dir) + 256];
+
+  t = calloc(1, sizeof(struct file_tab_struct));
+  if (t == NULL) {
+    fprintf(stderr, "file_scan: calloc() error\n");
+    return(NULL);
+  }
+  t->refs = 1;
+
+  d = opendir(file_dir);
+  if (d == NULL) {
+    fprintf(stderr, "file_scan: opendir() error %s\n", file_dir);
+    free(t);
+    return(NULL);
+  }
+
+  while ((e = readdir(d)) != NULL) {
+    if (e->d_name[0] == '.') continue;
+    type = file_type(e->d_name);
+    if (type == NULL) continue;
+
+    snprintf(path, sizeof(path), "%s/%s", file_dir, e->d_name);
+    if ((stat(path, &st) == (-1)) || !S_ISREG(st.st_mode)) continue;
+
+    file_load(t, path, e->d_name, type);
+  }
+  closedir(d);
+
+  /* the root page is required */
+  if (file_find(t, FILEINDEX, strlen(FILEINDEX)) == NULL) {
+    fprintf(stderr, "file_scan: %s/%s not found\n", file_dir, FILEINDEX);
+    file_free(t);
+    return(NULL);
+  }
+
+  return(t);
+}
+
+
+/***************/
+/* file_same() */
+/***************/
+/* return: 1 in_a and in_b have the same files, by name and tag, 0 not */
+static int
+file_same(
+ struct file_tab_struct *in_a,
+ struct file_tab_struct *in_b)
+{
+struct file_struct *f = NULL;
+struct file_var_struct *v = NULL;
+unsigned int i = 0;
+
+  if (in_a->count != in_b->count) return(0);
+
+  for (i = 0; i < in_a->count; i++) {
+    f = file_find(in_b, in_a->file[i].name, strlen(in_a->file[i].name));
+    if (f == NULL) return(0);
+    v = &(in_a->file[i].var[FILE_IDENTITY]);
+    if (strcmp(f->var[FILE_IDENTITY].etag, v->etag) != 0) return(0);
+  }
+
+  return(1);
+}
+
+
+/**************/
+/* file_get() */
+/**************/
+/* handles HTTP request GET and HEAD of a file, the prefix route */
+/*  the rest of the path names the file, none is the root page */
+/* as a HTTP callback function: */
+/*  return:  1 answered, socket may serve another request */
+static int
+file_get(
+ const char *in_req,
+ int in_fd)
+{
+struct file_tab_struct *t = NULL;
+struct file_struct *f = NULL;
+struct file_var_struct *v = NULL;
+const char *name = NULL;
+const char *hv = NULL;
+unsigned int name_len = 0;
+unsigned int hv_len = 0;
+int k = 0;
+
+  name = http_param(in_fd, "*", &name_len);
+  if ((name == NULL) || (name_len == 0)) {
+    name = FILEINDEX;
+    name_len = strlen(FILEINDEX);
+  }
+
+  /* the table is held until the body has been sent */
+  t = file_hold();
+  f = file_find(t, name, name_len);
+  if (f == NULL) {
+    file_unref(t);
+    fprintf(stderr, "file_get: file not found, %.*s\n", (int)name_len, name);
+    return(http_404(in_req, in_fd));
+  }
+
+  /* brotli, then gzip, then identity, the first the client takes */
+  v = &(f->var[FILE_IDENTITY]);
+  hv = http_header(in_fd, "Accept-Encoding", &hv_len);
+  if (hv != NULL) {
+    for (k = FILE_VARS - 1; k > FILE_IDENTITY; k--) {
+      if ((f->var[k].head != NULL) && file_accept(hv, hv_len, file_codings[k])) {
+        v = &(f->var[k]);
+        break;
+      }
+    }
+  }
+
+  hv = http_header(in_fd, "If-None-Match", &hv_len);
+  if ((hv != NULL) && file_match(hv, hv_len, v->etag, v->etag_len)) {
+    evnt_send(in_fd, v->not_mod, v->not_mod_len);
+    file_unref(t);
+    return(1);
+  }
+
+  if (in_req[0] == 'H') {
+    evnt_send(in_fd, v->head, v->head_len);
+    file_unref(t);
+  } else {
+    evnt_send_ref(in_fd, v->head, v->head_len, v->body, v->body_len, file_unref, t);
+  }
+
+  return(1);
+}
+
+
+/***************/
+/* file_init() */
+/***************/
+/* load the files of in_dir and register their route */
+/* return: 0 on success, -1 error */
+int
+file_init(
+ const char *in_dir)
+{
+  snprintf(file_dir, sizeof(file_dir), "%s", in_dir);
+  file_cur = file_scan();
+  if (file_cur == NULL) return(-1);
+
+  if (http_callback("GET", "/*", file_get) == (-1)) return(-1);
+  if (http_callback("HEAD", "/*", file_get) == (-1)) return(-1);
+
+  return(0);
+}
+
+
+/*****************/
+/* file_reload() */
+/*****************/
+/* load the directory again and, if any file differs, */
+/*  swap the new table in, the old one goes with its last response */
+/*  one caller at a time, off the event loops, as it maps and */
+/*  compresses every file */
+/* return: 1 swapped, 0 nothing changed, -1 error, old table kept */
+int
+file_reload(void)
+{
+struct file_tab_struct *t = NULL;
+struct file_tab_struct *old = NULL;
+
+  t = file_scan();
+  if (t == NULL) return(-1);
+
+  /* only this caller changes file_cur, so reading it here is safe */
+  if (file_same(file_cur, t)) {
+    file_unref(t);
+    return(0);
+  }
+
+  pthread_mutex_lock(&file_lock);
+  old = file_cur;
+  file_cur = t;
+  pthread_mutex_unlock(&file_lock);
+  file_unref(old);
+
+  return(1);
+}
+
+
+/*****************/
+/* file_served() */
+/*****************/
+/* return: 1 a file named in_name would be served, 0 not */
+int
+file_served(
+ const char *in_name)
+{
+  return(file_type(in_name) != NULL);
+}
@@ -0,0 +1,378 @@
+/* http_rout.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* route matcher for HTTP requests */
+/*  a trie of path segments, one node per segment */
+/*  a node finds its literal children by a hash of the segment, */
+/*  so a path is matched in time proportional to its length, */
+/*  however many routes there are */
+/* a pattern segment may be */
+/*  literal   /radio_preset */
+/*  parameter /{index}, any one non-empty segment, by name */
+/*  prefix    *, last only, any rest of the path, even none */
+/* literal children are tried before a parameter, */
+/*  and a parameter before a prefix */
+/* routes are registered at startup, before worker threads, */
+/*  after which the trie is only read */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* POSIX headers */
+
+/* Local headers */
+#include "http_util.h"
+#include "http_rout.h"
+
+/* Macros */
+/* first size of a node's literal child table, a power of two */
+#define ROUT_CHILDREN 4
+
+/* File scope variables */
+/* External variables */
+/* External functions */
+
+/* Structures and unions */
+struct rout_node {
+ char *seg;                      /* literal segment, parameter name */
+ unsigned int seg_len;
+ unsigned int hash;              /* of the literal segment */
+ struct rout_node **child;       /* literal children, open addressed */
+ unsigned int child_size;        /* power of two, 0 when none */
+ unsigned int child_count;
+ struct rout_node *param;        /* parameter child */
+ int (*f[ROUT_METHODS])(const char *, int);      /* path ends here */
+ int (*prefix[ROUT_METHODS])(const char *, int); /* path ends here, or below */
+};
+
+/* the root stands for the empty path before the first '/' */
+static struct rout_node rout_root;
+
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/***************/
+/* rout_hash() */
+/***************/
+/* FNV-1a */
+static unsigned int
+rout_hash(
+ const char *in_seg,
+ unsigned int in_len)
+{
+unsigned int h = 2166136261U;
+unsigned int i = 0;
+
+  for (i = 0; i < in_len; i++) {
+    h ^= (unsigned char)in_seg[i];
+    h *= 16777619U;
+  }
+
+  return(h);
+}
+
+
+/****************/
+/* rout_child() */
+/****************/
+/* return: literal child of in_n for in_seg, NULL if none */
+static struct rout_node *
+rout_child(
+ struct rout_node *in_n,
+ const char *in_seg,
+ unsigned int in_len,
+ unsigned int in_hash)
+{
+struct rout_node *c = NULL;
+unsigned int i = 0;
+
+  if (in_n->child_size == 0) return(NULL);
+
+  i = in_hash & (in_n->child_size - 1);
+  while ((c = in_n->child[i]) != NULL) {
+    if ((c->hash == in_hash) && (c->seg_len == in_len) &&
+     (memcmp(c->seg, in_seg, in_len) == 0)) {
+      return(c);
+    }
+    i = (i + 1) & (in_n->child_size - 1);
+  }
+
+  return(NULL);
+}
+
+
+/*****************/
+/* rout_insert() */
+/*****************/
+/* put in_c in io_n's literal child table, growing it past half full */
+/* return: 0 on success, -1 error */
+static int
+rout_insert(
+ struct rout_node *io_n,
+ struct rout_node *in_c)
+{
+struct rout_node **t = NULL;
+unsigned int size = 0;
+unsigned int i = 0;
+unsigned int k = 0;
+
+  if ((io_n->child_count + 1) * 2 > io_n->child_size) {
+    size = (io_n->child_size > 0) ? io_n->child_size * 2 : ROUT_CHILDREN;
+    t = calloc(size, sizeof(struct rout_node *));
+    if (t == NULL) {
+      fprintf(stderr, "rout_insert: calloc() error\n");
+      return(-1);
+    }
+    for (i = 0; i < io_n->child_size; i++) {
+      if (io_n->child[i] == NULL) continue;
+      k = io_n->child[i]->hash & (size - 1);
+      while (t[k] != NULL) k = (k + 1) & (size - 1);
+      t[k] = io_n->child[i];
+    }
+    free(io_n->child);
+    io_n->child = t;
+    io_n->child_size = size;
+  }
+
+  k = in_c->hash & (io_n->child_size - 1);
+  while (io_n->child[k] != NULL) k = (k + 1) & (io_n->child_size - 1);
+  io_n->child[k] = in_c;
+  io_n->child_count += 1;
+
+  return(0);
+}
+
+
+/***************/
+/* rout_node() */
+/***************/
+/* return: new node for segment in_seg, NULL on error */
+static struct rout_node *
+rout_node(
+ const char *in_seg,
+ unsigned int in_len)
+{
+struct rout_node *n = NULL;
+
+  n = calloc(1, sizeof(struct rout_node));
+  if (n == NULL) {
+    fprintf(stderr, "rout_node: calloc() error\n");
+    return(NULL);
+  }
+  n->seg = malloc(in_len + 1);
+  if (n->seg == NULL) {
+    fprintf(stderr, "rout_node: malloc() error\n");
+    free(n);
+    return(NULL);
+  }
+  memcpy(n->seg, in_seg, in_len);
+  n->seg[in_len] = '\0';
+  n->seg_len = in_len;
+  n->hash = rout_hash(in_seg, in_len);
+
+  return(n);
+}
+
+
+/**************/
+/* rout_add() */
+/**************/
+/* register in_f for in_method on paths matching in_pattern */
+/*  in_pattern starts with '/', see the top of this file */
+/* return: 0 on success, -1 error (invalid, or already registered) */
+int
+rout_add(
+ int in_method,
+ const char *in_pattern,
+ int (*in_f)(const char *, int))
+{
+struct rout_node *n = &rout_root;
+struct rout_node *c = NULL;
+const char *seg = NULL;
+unsigned int params = 0;
+unsigned int len = 0;
+int (**slot)(const char *, int) = NULL;
+
+  if ((in_method <= 0) || (in_method >= ROUT_METHODS) || (in_pattern[0] != '/')) {
+    fprintf(stderr, "rout_add: invalid route %s\n", in_pattern);
+    return(-1);
+  }
+
+  seg = in_pattern;
+  while (*seg == '/') {
+    seg += 1;
+    len = strcspn(seg, "/");
+
+    if ((len == 1) && (seg[0] == '*')) {
+      /* prefix, the rest of the path is for the callback */
+      if (seg[1] != '\0') {
+        fprintf(stderr, "rout_add: prefix not last in route %s\n", in_pattern);
+        return(-1);
+      }
+      slot = &(n->prefix[in_method]);
+      break;
+    }
+
+    if ((len > 2) && (seg[0] == '{') && (seg[len - 1] == '}')) {
+      /* parameter, its name is kept on its node */
+      params += 1;
+      if (params > HTTP_MAXPARAMS) {
+        fprintf(stderr, "rout_add: too many parameters in route %s\n", in_pattern);
+        return(-1);
+      }
+      c = n->param;
+      if (c == NULL) {
+        c = rout_node(&(seg[1]), len - 2);
+        if (c == NULL) return(-1);
+        n->param = c;
+      } else if ((c->seg_len != len - 2) || (memcmp(c->seg, &(seg[1]), len - 2) != 0)) {
+        fprintf(stderr, "rout_add: parameter named differently in route %s\n", in_pattern);
+        return(-1);
+      }
+    } else {
+      c = rout_child(n, seg, len, rout_hash(seg, len));
+      if (c == NULL) {
+        c = rout_node(seg, len);
+        if (c == NULL) return(-1);
+        if (rout_insert(n, c) == (-1)) {
+          free(c->seg);
+          free(c);
+          return(-1);
+        }
+      }
+    }
+
+    n = c;
+    seg += len;
+  }
+
+  if (slot == NULL) slot = &(n->f[in_method]);
+  if (*slot != NULL) {
+    fprintf(stderr, "rout_add: route %s already registered\n", in_pattern);
+    return(-1);
+  }
+  *slot = in_f;
+
+  return(0);
+}
+
+
+/****************/
+/* rout_match() */
+/****************/
+/* match the path from in_pos to in_end below node in_n */
+/*  in_buf[in_pos] is the '/' before the next segment */
+/* return: 0 found, callback in out_f, -1 no route */
+static int
+rout_match(
+ struct rout_node *in_n,
+ int in_method,
+ const char *in_buf,
+ unsigned int in_pos,
+ unsigned int in_end,
+ struct http_req_struct *io_req,
+ int (**out_f)(const char *, int))
+{
+struct rout_node *c = NULL;
+unsigned int seg = 0;
+unsigned int end = 0;
+unsigned short count = io_req->param_count;
+
+  if (in_pos >= in_end) {
+    if (in_n->f[in_method] != NULL) {
+      *out_f = in_n->f[in_method];
+      return(0);
+    }
+    seg = in_end;
+  } else {
+    seg = in_pos + 1;
+    for (end = seg; (end < in_end) && (in_buf[end] != '/'); end++);
+
+    /* literal segment */
+    c = rout_child(in_n, &(in_buf[seg]), end - seg, rout_hash(&(in_buf[seg]), end - seg));
+    if ((c != NULL) && (rout_match(c, in_method, in_buf, end, in_end, io_req, out_f) == 0)) {
+      return(0);
+    }
+
+    /* parameter, recorded, and forgotten again if the rest fails */
+    c = in_n->param;
+    if ((c != NULL) && (end > seg) && (count < HTTP_MAXPARAMS)) {
+      io_req->param[count].name = c->seg;
+      io_req->param[count].value = seg;
+      io_req->param[count].value_len = end - seg;
+      io_req->param_count = count + 1;
+      if (rout_match(c, in_method, in_buf, end, in_end, io_req, out_f) == 0) {
+        return(0);
+      }
+      io_req->param_count = count;
+    }
+  }
+
+  /* prefix, the rest of the path is parameter "*" */
+  if ((in_n->prefix[in_method] != NULL) && (count < HTTP_MAXPARAMS)) {
+    io_req->param[count].name = "*";
+    io_req->param[count].value = seg;
+    io_req->param[count].value_len = in_end - seg;
+    io_req->param_count = count + 1;
+    *out_f = in_n->prefix[in_method];
+    return(0);
+  }
+
+  return(-1);
+}
+
+
+/***************/
+/* rout_find() */
+/***************/
+/* find the route for the in_len byte path at in_buf[in_path] */
+/*  parameters matched are recorded in io_req, */
+/*  as offsets into in_buf */
+/* return: 0 found, callback in out_f, -1 no route */
+int
+rout_find(
+ int in_method,
+ const char *in_buf,
+ unsigned int in_path,
+ unsigned int in_len,
+ struct http_req_struct *io_req,
+ int (**out_f)(const char *, int))
+{
+  io_req->param_count = 0;
+
+  if ((in_method <= 0) || (in_method >= ROUT_METHODS) ||
+   (in_len == 0) || (in_buf[in_path] != '/')) {
+    return(-1);
+  }
+
+  if (rout_match(&rout_root, in_method, in_buf, in_path, in_path + in_len, io_req, out_f) == (-1)) {
+    io_req->param_count = 0;
+    return(-1);
+  }
+
+  return(0);
+}
@@ -0,0 +1,35 @@
+/* http_rout.h */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* route matcher, for http_util.c only */
+/*  routes are registered with http_callback(), declared in http_util.h */
+
+#ifndef http_rout_h
+#define http_rout_h
+
+#include "http_util.h"
+
+/* method codes of http_util.c run from 1 to this, less one */
+#define ROUT_METHODS 9
+
+int rout_add(int in_method, const char *in_pattern, int (*in_f)(const char *, int));
+
+int rout_find(int in_method, const char *in_buf, unsigned int in_path, unsigned int in_len,
+ struct http_req_struct *io_req, int (**out_f)(const char *, int));
+
+#endif
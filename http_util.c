@@ -24,35 +24,31 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 
 /* POSIX headers */
 
 /* Local headers */
 #include "http_util.h"
+#include "http_rout.h"
+#include "http_file.h"
 #include "sckt_util.h"
+#include "conn_util.h"
+#include "evnt_util.h"
 
 /* Macros */
-#ifndef ROOTHTMLPATH
-#define ROOTHTMLPATH "/var/tunerd/root.html"
+/* directory of root.html and other files served */
+#ifndef HTMLDIR
+#define HTMLDIR "/var/tunerd"
 #endif
 #define MAXURISIZE 8192
 
 /* File scope variables */
-static char *root_resp = NULL;
-static int root_size = 0;
 
 /* External variables */
 /* External functions */
 
 /* Structures and unions */
-struct cb_struct {
-  int method;
-  char path_match[MAXURISIZE+1];
-  int (*f)(const char*, int);
-};
-static struct cb_struct cb[16];
-static int cb_count = 0;
-
 enum HTTP_methods {
  OPTIONS = 1,
  GET = 2,
@@ -64,6 +60,25 @@ enum HTTP_methods {
  CONNECT = 8
 };
 
+/* request parser states, in order of a request's bytes */
+enum HTTP_parse_states {
+ P_METHOD = 0,
+ P_PATH_SP,
+ P_PATH,
+ P_VERSION_SP,
+ P_VERSION,
+ P_LINE_LF,
+ P_HDR_START,
+ P_HDR_NAME,
+ P_HDR_OWS,
+ P_HDR_VALUE,
+ P_HDR_LF,
+ P_END_LF,
+ P_DONE,
+ P_ERROR,
+ P_MANY    /* more header lines than HTTP_MAXHEADERS */
+};
+
 /* Signal catching functions */
 
 
@@ -77,65 +92,46 @@ enum HTTP_methods {
 int
 http_init(void)
 {
-FILE *fp = NULL;
-char resp_head[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: ";
-char content_len_str[8];
-char *p = NULL;
-int head_len = 0;
-long file_size = 0;
-size_t nread = 0;
-
-  /* load the root HTML document into memory, prepended with HTTP header */
-
-  /* length of HTML */
-  fp = fopen(ROOTHTMLPATH, "r");
-  if (fp == NULL) {
-    fprintf(stderr, "http_init: fopen() error %s\n", ROOTHTMLPATH);
-    return(-1);
-  }
-  fseek(fp, 0L, SEEK_END);
-  file_size = ftell(fp);
-
-  head_len = strlen(resp_head); /* known at compile time */
-  head_len += snprintf(content_len_str, 8, "%ld", file_size);
-  head_len += 4; /* /r/n/r/n */
+  /* the root page, and any other files, are served from memory */
+  return(file_init(HTMLDIR));
+}
 
-  root_size = head_len + file_size;
 
-  /* malloc enough memory */ 
-  root_resp = malloc(sizeof(char) * root_size );
-  if (root_resp == NULL) {
-    fprintf(stderr, "http_init: malloc() error root HTML\n");
-    fclose(fp);
-    return(-1);
-  }
-  root_resp[0] = '\0';
-
-  /* write into memory */
-  /*  HTTP header */
-  strcat(root_resp, resp_head);
-  strcat(root_resp, content_len_str);
-  strcat(root_resp, "\r\n\r\n");
-
-  /*  HTML document */
-  p = &(root_resp[head_len]);
-  fseek(fp, 0L, SEEK_SET);
-  nread = fread(p, sizeof(char), file_size, fp);
-  if (nread != file_size) {
-    fprintf(stderr, "http_init: fread() error %s\n", ROOTHTMLPATH);
-  }
+/*****************/
+/* http_reload() */
+/*****************/
+/* load the files served again, after they have changed */
+/*  responses in flight finish with the files they started with */
+/* return: 1 files changed, 0 unchanged, -1 error, old files kept */
+int
+http_reload(void)
+{
+  return(file_reload());
+}
 
-  fclose(fp);
 
-  if (nread != file_size) return(-1);
-  return(0);
+/*****************/
+/* http_served() */
+/*****************/
+/* return: 1 a file named in_name in the directory would be served, 0 not */
+int
+http_served(
+ const char *in_name)
+{
+  return(file_served(in_name));
 }
 
 
 /*******************/
 /* http_callback() */
 /*******************/
-/* register callback */
+/* register callback, at startup before worker threads */
+/*  it returns as http_handle(), 1 when it has answered */
+/*  and the connection may serve another request */
+/* in_path_match is a literal path, such as "/radio_freq", */
+/*  and may have parameter segments, "/radio_preset/{index}", */
+/*  read with http_param(), or end in a prefix segment "*", */
+/*  when http_param() of "*" is the rest of the path */
 /* in_method and in_path_match MUST BE NULL TERMINATED BY CALLER */
 /*  or else badness */
 /* return: 0 on success, -1 error */
@@ -145,182 +141,569 @@ http_callback(
  const char *in_path_match,
  int (*in_f)(const char *, int))
 {
-size_t path_len = 0;
+int method = 0;
 
-  if (strncmp(in_method, "GET", 3) == 0) cb[cb_count].method = GET;
-  else if (strncmp(in_method, "POST", 4) == 0) cb[cb_count].method = POST;
-  else if (strncmp(in_method, "HEAD", 4) == 0) cb[cb_count].method = HEAD;
+  if (strncmp(in_method, "GET", 3) == 0) method = GET;
+  else if (strncmp(in_method, "POST", 4) == 0) method = POST;
+  else if (strncmp(in_method, "HEAD", 4) == 0) method = HEAD;
   else {
-    cb[cb_count].method = 0;
     return(-1);
   }
 
-  path_len = strlen(in_path_match);
-  if (path_len > MAXURISIZE) {
-    fprintf(stderr, "http_callback: warning: callback path exceeds maximum URI size\n");
-    path_len = MAXURISIZE; 
+  if (strlen(in_path_match) > MAXURISIZE) {
+    fprintf(stderr, "http_callback: callback path exceeds maximum URI size\n");
+    return(-1);
   }
 
-  strncpy(cb[cb_count].path_match, in_path_match, path_len);
-  (cb[cb_count].path_match)[path_len] = '\0';
-  cb[cb_count].f = in_f;
-  cb_count += 1;
-
-  return(0);
+  return(rout_add(method, in_path_match, in_f));
 }
 
 
-/***************/
-/* http_root() */
-/***************/
-/* return: -1 keep alive socket */
-/*          0 close socket */
+/**************/
+/* http_403() */
+/**************/
+/* return 0 close socket */
 int
-http_root(
+http_403(
  const char *in_req,
  int in_fd)
 {
+char resp[] = "HTTP/1.1 403 Forbidden\r\nContent-length: 0\r\nConnection: close\r\n\r\n";
 
-  sckt_write(in_fd, root_resp, root_size);
+  evnt_send(in_fd, resp, strlen(resp));
+   /* strlen() of string literal should be constant at compile time */
 
   return(0);
 }
 
 
 /**************/
-/* http_403() */
+/* http_404() */
 /**************/
-/* return 0 close socket */
+/* return 1 answered, socket may serve another request */
 int
-http_403(
+http_404(
  const char *in_req,
  int in_fd)
 {
-char resp[] = "HTTP/1.1 403 Forbidden\r\nContent-length: 0\r\nConnection: close\r\n\r\n";
+char resp[] = "HTTP/1.1 404 Not Found\r\nContent-length: 0\r\n\r\n";
 
-  sckt_write(in_fd, resp, strlen(resp));
+  evnt_send(in_fd, resp, strlen(resp));
    /* strlen() of string literal should be constant at compile time */
 
-  return(0);
+  return(1);
 }
 
 
 /**************/
-/* http_404() */
+/* http_431() */
 /**************/
 /* return 0 close socket */
 int
-http_404(
+http_431(
  const char *in_req,
  int in_fd)
 {
-char resp[] = "HTTP/1.1 404 Not Found\r\nContent-length: 0\r\nConnection: close\r\n\r\n";
+char resp[] = "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-length: 0\r\nConnection: close\r\n\r\n";
 
-  sckt_write(in_fd, resp, strlen(resp));
+  evnt_send(in_fd, resp, strlen(resp));
    /* strlen() of string literal should be constant at compile time */
 
   return(0);
 }
 
 
+/****************/
+/* http_parse() */
+/****************/
+/* resumable request head parser */
+/*  io_req->scan remembers how far in_buf has been parsed, */
+/*  so each call only looks at bytes that arrived since the last */
+/*  and each byte is examined once */
+/* in_buf need not be NULL terminated, in_len is bytes held */
+/* a request with more than HTTP_MAXHEADERS header lines is refused, */
+/*  not parsed in part, a Content-Length or Connection past the last */
+/*  recorded would otherwise go unseen and the body be misframed */
+/* return: 1 request head complete, 0 need more, -1 invalid request, */
+/*  -2 too many header lines */
+int
+http_parse(
+ const char *in_buf,
+ unsigned int in_len,
+ struct http_req_struct *io_req)
+{
+struct http_hdr_struct *h = NULL;
+unsigned int i = 0;
+int st = 0;
+char ch = 0;
+
+  st = io_req->state;
+  if (st == P_DONE) return(1);
+  if (st == P_ERROR) return(-1);
+  if (st == P_MANY) return(-2);
+
+  /* the header being parsed, when in a header state */
+  if (io_req->hdr_count < HTTP_MAXHEADERS) {
+    h = &(io_req->hdr[io_req->hdr_count]);
+  }
+
+  for (i = io_req->scan; (i < in_len) && (st != P_DONE) && (st != P_ERROR) && (st != P_MANY); i++) {
+    ch = in_buf[i];
+
+    switch (st) {
+      case P_METHOD:
+        if (ch == ' ') {
+          io_req->method_len = i;
+          st = (i > 0) ? P_PATH_SP : P_ERROR;
+        } else if ((ch < 'A') || (ch > 'Z')) {
+          st = P_ERROR;
+        }
+        break;
+      case P_PATH_SP:
+        if (ch == '\r' || ch == '\n') {
+          st = P_ERROR;
+        } else if (ch != ' ') {
+          io_req->path = i;
+          st = P_PATH;
+        }
+        break;
+      case P_PATH:
+        if (ch == ' ') {
+          io_req->path_len = i - io_req->path;
+          st = P_VERSION_SP;
+        } else if (ch == '\r' || ch == '\n') {
+          /* no HTTP version, HTTP/0.9 is not served */
+          st = P_ERROR;
+        }
+        break;
+      case P_VERSION_SP:
+        if (ch == '\r' || ch == '\n') {
+          st = P_ERROR;
+        } else if (ch != ' ') {
+          io_req->version = i;
+          st = P_VERSION;
+        }
+        break;
+      case P_VERSION:
+        if (ch == '\r') {
+          io_req->version_len = i - io_req->version;
+          st = P_LINE_LF;
+        } else if (ch == '\n') {
+          io_req->version_len = i - io_req->version;
+          st = P_HDR_START;
+        }
+        break;
+      case P_LINE_LF:
+      case P_HDR_LF:
+        st = (ch == '\n') ? P_HDR_START : P_ERROR;
+        break;
+      case P_HDR_START:
+        if (ch == '\r') {
+          st = P_END_LF;
+        } else if (ch == '\n') {
+          io_req->head_len = i + 1;
+          st = P_DONE;
+        } else if (ch == ' ' || ch == '\t' || ch == ':') {
+          /* obsolete line folding, or no name */
+          st = P_ERROR;
+        } else if (h == NULL) {
+          st = P_MANY;
+        } else {
+          h->name = i;
+          st = P_HDR_NAME;
+        }
+        break;
+      case P_HDR_NAME:
+        if (ch == ':') {
+          h->name_len = i - h->name;
+          st = P_HDR_OWS;
+        } else if (ch == '\r' || ch == '\n' || ch == ' ' || ch == '\t') {
+          st = P_ERROR;
+        }
+        break;
+      case P_HDR_OWS:
+        if (ch == ' ' || ch == '\t') break;
+        h->value = i;
+        h->value_len = 0;
+        /* fall through, first character of value */
+      case P_HDR_VALUE:
+        if (ch == '\r' || ch == '\n') {
+          io_req->hdr_count += 1;
+          h = (io_req->hdr_count < HTTP_MAXHEADERS) ? &(io_req->hdr[io_req->hdr_count]) : NULL;
+          st = (ch == '\r') ? P_HDR_LF : P_HDR_START;
+        } else {
+          st = P_HDR_VALUE;
+          /* value length to the last non-blank, trailing blanks trimmed */
+          if ((ch != ' ') && (ch != '\t')) {
+            h->value_len = i + 1 - h->value;
+          }
+        }
+        break;
+      case P_END_LF:
+        if (ch == '\n') {
+          io_req->head_len = i + 1;
+          st = P_DONE;
+        } else {
+          st = P_ERROR;
+        }
+        break;
+    }
+  }
+
+  io_req->scan = i;
+  io_req->state = st;
+
+  if (st == P_DONE) return(1);
+  if (st == P_ERROR) return(-1);
+  if (st == P_MANY) return(-2);
+  return(0);
+}
+
+
+/*****************/
+/* http_header() */
+/*****************/
+/* for callbacks, find header in_name (case insensitive) */
+/*  in the request being handled on in_fd */
+/* return: pointer to value, not NULL terminated, length in out_len */
+/*  NULL if header not present */
+const char *
+http_header(
+ int in_fd,
+ const char *in_name,
+ unsigned int *out_len)
+{
+struct conn_struct *c = NULL;
+struct http_req_struct *r = NULL;
+size_t name_len = 0;
+int i = 0;
+int k = 0;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->buf == NULL) || (c->req.state != P_DONE)) {
+    return(NULL);
+  }
+  r = &(c->req);
+
+  name_len = strlen(in_name);
+  for (i = 0; i < r->hdr_count; i++) {
+    if (r->hdr[i].name_len != name_len) continue;
+    for (k = 0; k < name_len; k++) {
+      if (tolower((unsigned char)c->buf[r->hdr[i].name + k]) != tolower((unsigned char)in_name[k])) break;
+    }
+    if (k == name_len) {
+      *out_len = r->hdr[i].value_len;
+      return(&(c->buf[r->hdr[i].value]));
+    }
+  }
+
+  return(NULL);
+}
+
+
+/****************/
+/* http_param() */
+/****************/
+/* for callbacks, find path parameter in_name, from the route */
+/*  that matched the request being handled on in_fd */
+/* return: pointer to value, not NULL terminated, length in out_len */
+/*  NULL if the route has no such parameter */
+const char *
+http_param(
+ int in_fd,
+ const char *in_name,
+ unsigned int *out_len)
+{
+struct conn_struct *c = NULL;
+struct http_req_struct *r = NULL;
+int i = 0;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->buf == NULL) || (c->req.state != P_DONE)) {
+    return(NULL);
+  }
+  r = &(c->req);
+
+  for (i = 0; i < r->param_count; i++) {
+    if (strcmp(r->param[i].name, in_name) == 0) {
+      *out_len = r->param[i].value_len;
+      return(&(c->buf[r->param[i].value]));
+    }
+  }
+
+  return(NULL);
+}
+
+
+/****************/
+/* http_query() */
+/****************/
+/* for callbacks, find query parameter in_name, after the '?' */
+/*  of the path of the request being handled on in_fd */
+/*  the value is as sent, not percent decoded */
+/* return: pointer to value, not NULL terminated, length in out_len */
+/*  NULL if the query has no such parameter */
+const char *
+http_query(
+ int in_fd,
+ const char *in_name,
+ unsigned int *out_len)
+{
+struct conn_struct *c = NULL;
+const char *p = NULL;
+const char *end = NULL;
+const char *eq = NULL;
+const char *amp = NULL;
+size_t name_len = 0;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->buf == NULL) || (c->req.state != P_DONE)) {
+    return(NULL);
+  }
+
+  p = &(c->buf[c->req.path]);
+  end = p + c->req.path_len;
+  p = memchr(p, '?', end - p);
+  if (p == NULL) {
+    return(NULL);
+  }
+
+  name_len = strlen(in_name);
+  for (p += 1; p < end; p = amp + 1) {
+    amp = memchr(p, '&', end - p);
+    if (amp == NULL) amp = end;
+    eq = memchr(p, '=', amp - p);
+    if (eq == NULL) eq = amp;
+    if (((size_t)(eq - p) == name_len) && (memcmp(p, in_name, name_len) == 0)) {
+      *out_len = (eq < amp) ? (amp - eq - 1) : 0;
+      return((eq < amp) ? (eq + 1) : eq);
+    }
+  }
+
+  return(NULL);
+}
+
+
+/********************/
+/* http_has_token() */
+/********************/
+/* return: 1 if the comma separated in_value lists in_token */
+/*  (case insensitive), 0 if not */
+static int
+http_has_token(
+ const char *in_value,
+ unsigned int in_len,
+ const char *in_token)
+{
+size_t token_len = 0;
+unsigned int i = 0;
+unsigned int k = 0;
+
+  token_len = strlen(in_token);
+  while (i < in_len) {
+    while ((i < in_len) && ((in_value[i] == ' ') || (in_value[i] == '\t') || (in_value[i] == ','))) i++;
+    for (k = 0; (k < token_len) && (i + k < in_len); k++) {
+      if (tolower((unsigned char)in_value[i + k]) != in_token[k]) break;
+    }
+    if ((k == token_len) && ((i + k == in_len) || (in_value[i + k] == ',') ||
+     (in_value[i + k] == ' ') || (in_value[i + k] == '\t'))) {
+      return(1);
+    }
+    while ((i < in_len) && (in_value[i] != ',')) i++;
+  }
+
+  return(0);
+}
+
+
+/***************/
+/* http_keep() */
+/***************/
+/* whether the client will send another request on in_fd */
+/*  HTTP/1.1 keeps the connection unless it asks to close, */
+/*  HTTP/1.0 is always closed, its keep-alive is not offered */
+/* return: 1 keep, 0 close */
+static int
+http_keep(
+ int in_fd)
+{
+struct conn_struct *c = NULL;
+const char *v = NULL;
+unsigned int len = 0;
+
+  c = conn_get(in_fd);
+  if ((c->req.version_len != 8) || (strncmp(&(c->buf[c->req.version]), "HTTP/1.1", 8) != 0)) {
+    return(0);
+  }
+
+  v = http_header(in_fd, "Connection", &len);
+  if ((v != NULL) && http_has_token(v, len, "close")) {
+    return(0);
+  }
+
+  return(1);
+}
+
+
+/***************/
+/* http_body() */
+/***************/
+/* find the length of the request body, from Content-Length */
+/*  a body must fit in the read buffer after the head */
+/*  and chunked bodies are not accepted */
+/* return: 0 on success, -1 invalid or too large */
+static int
+http_body(
+ int in_fd,
+ struct http_req_struct *io_req)
+{
+const char *v = NULL;
+unsigned long body = 0;
+unsigned int len = 0;
+unsigned int i = 0;
+
+  io_req->body_len = 0;
+
+  if (http_header(in_fd, "Transfer-Encoding", &len) != NULL) {
+    return(-1);
+  }
+
+  v = http_header(in_fd, "Content-Length", &len);
+  if (v == NULL) {
+    return(0);
+  }
+  if (len == 0) {
+    return(-1);
+  }
+  for (i = 0; i < len; i++) {
+    if (!isdigit((unsigned char)v[i])) return(-1);
+    body = body * 10 + (v[i] - '0');
+    if (body >= RBUFSIZE) return(-1);
+  }
+  if (io_req->head_len + body >= RBUFSIZE) {
+    return(-1);
+  }
+
+  io_req->body_len = body;
+
+  return(0);
+}
+
+
 /*****************/
 /* http_handle() */
 /*****************/
-/* caller IS EXPECTED TO HAVE in_req BE NULL TERMINATED */
+/* parse what has arrived on in_fd so far */
+/*  and once the request head and body are complete, dispatch it */
+/*  the request is the first head_len + body_len bytes of the buffer, */
+/*  any bytes after it are the next, pipelined, request */
 /* return: */
-/*  -1 for keep alive socket */
+/*  -1 for keep alive socket, request incomplete or socket taken over */
 /*   0 for close socket */
+/*   1 for answered, socket may serve another request */
 int
 http_handle(
- const char *in_req,
  int in_fd)
 {
-char path[MAXURISIZE+1];
-size_t in_req_len = 0;
+struct conn_struct *c = NULL;
+struct http_req_struct *r = NULL;
+const char *in_req = NULL;
+const char *path = NULL;
+int (*f)(const char *, int) = NULL;
 int method_code = 0;
 int path_len = 0;
+int status = 0;
+int keep = 0;
 int i = 0;
-int close_flag = 0;
-int p1 = 0;
-int p2 = 0;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->buf == NULL)) {
+    return(0);
+  }
+  in_req = c->buf;
+  r = &(c->req);
 
   /* wait until HTTP request header complete */
   /*  return to event loop, keep connection open */
-  if (strstr(in_req, "\r\n\r\n") == NULL) {
+  status = http_parse(c->buf, c->pos, r);
+  if (status == 0) {
     return(-1);
   }
+  if (status == (-1)) {
+    fprintf(stderr, "http_handle: HTTP request invalid\n");
+    http_403(in_req, in_fd);
+    return(0);
+  }
+  if (status == (-2)) {
+    fprintf(stderr, "http_handle: HTTP request has over %d header lines\n", HTTP_MAXHEADERS);
+    http_431(in_req, in_fd);
+    return(0);
+  }
 
-  in_req_len = strlen(in_req);
+  /* wait for the body, if there is one */
+  if (http_body(in_fd, r) == (-1)) {
+    fprintf(stderr, "http_handle: HTTP request body invalid or too large\n");
+    http_403(in_req, in_fd);
+    return(0);
+  }
+  if (c->pos < r->head_len + r->body_len) {
+    return(-1);
+  }
+  keep = http_keep(in_fd);
 
   /* get method */
-  if (strncmp(in_req, "GET ", 4) == 0) method_code = GET;
-  else if (strncmp(in_req, "POST ", 5) == 0) method_code = POST;
-  else if (strncmp(in_req, "HEAD ", 5) == 0) method_code = HEAD;
+  if ((r->method_len == 3) && (strncmp(in_req, "GET", 3) == 0)) method_code = GET;
+  else if ((r->method_len == 4) && (strncmp(in_req, "POST", 4) == 0)) method_code = POST;
+  else if ((r->method_len == 4) && (strncmp(in_req, "HEAD", 4) == 0)) method_code = HEAD;
   else {
     fprintf(stderr, "http_handle: HTTP request method invalid\n");
     http_403(in_req, in_fd);
     return(0);
   }
 
-  /* find delimits of Request-URI */
-
-  /* skip over method to find start of Request-URI */
-  /*  by above, guaranteed to have a space after GET or POST or HEAD */
-  p1 = 0;
-  while (in_req[p1] != ' ') p1++;
-  while (in_req[p1] == ' ') p1++;
-
-  /* find end of Request-URI */
-  /*  from now on out, need to make sure don't exceed buffer */
-  p2 = p1;
-  while ((in_req[p2] != ' ')  && (p2 < in_req_len)) p2++;
-  if (p2 == in_req_len) {
-    fprintf(stderr, "http_handle: HTTP request URI invalid - no space after URI\n");
-    http_403(in_req, in_fd);
-    return(0);
-  }
+  path = &(in_req[r->path]);
+  path_len = r->path_len;
 
   /* need path, skip transport://host:port */
-  if (strncmp(&in_req[p1], "http://", 7) == 0) {
+  if ((path_len >= 7) && (strncmp(path, "http://", 7) == 0)) {
     /* is an absoluteURI, so parse to get path(and params) */
-    p1 += 7;
-    while ((in_req[p1] != '/') && (p1 < p2)) p1++;
-    if (p1 == p2) {
+    path += 7;
+    path_len -= 7;
+    while ((path_len > 0) && (*path != '/')) {
+      path++;
+      path_len--;
+    }
+    if (path_len == 0) {
       fprintf(stderr, "http_handle: HTTP request URI invalid - incomplete absolute path\n");
       http_403(in_req, in_fd);
       return(0);
     }
   }
 
-  /* p1 is first char of path, p2 is first space after path */
-  path_len = p2 - p1;
-  if (path_len <= MAXURISIZE) { 
-    strncpy(path, &(in_req[p1]), path_len);
-    path[path_len] = '\0';
-  } else {
+  if (path_len > MAXURISIZE) {
     fprintf(stderr, "http_handle: HTTP request path exceeds %d\n", MAXURISIZE);
     http_403(in_req, in_fd);
     return(0);
   }
 
-  if ((method_code == GET) && (strncmp(path, "/", 2) == 0)) {
-    /* respond with root HTML and return 0 to close socket */
-    http_root(in_req, in_fd);
-    return(0);
-  }
+  /* the query string is not part of the route */
+  for (i = 0; (i < path_len) && (path[i] != '?'); i++);
 
-  for (i = 0; i < cb_count; i++) {
-    if (method_code == cb[i].method) {
-      /* include checking null character at end of path, for exact match */
-      if (strncmp(cb[i].path_match, path, path_len+1) == 0) {
-        close_flag = cb[i].f(in_req, in_fd);
-        return(close_flag);
-      }
-    }
+  if (rout_find(method_code, in_req, path - in_req, i, r, &f) == 0) {
+    status = f(in_req, in_fd);
+  } else {
+    /* not found */
+    fprintf(stderr, "http_handle: HTTP request URI not found, %.*s\n", path_len, path);
+    status = http_404(in_req, in_fd);
   }
 
-  /* not found, error and return 0 to close socket */
-  fprintf(stderr, "http_handle: HTTP request URI not found, %s\n", path);
-  http_404(in_req, in_fd);
-  return(0);
+  /* answered, close unless the client will send more */
+  if ((status == 1) && !keep) {
+    return(0);
+  }
+  /* left waiting, a parked long-poll, it is closed once answered */
+  if ((status == (-1)) && !keep) {
+    c->flags |= CONN_F_LAST;
+  }
+  return(status);
 }
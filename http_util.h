@@ -19,12 +19,70 @@
 #ifndef http_util_h
 #define http_util_h
 
+/* most header lines per request, one with more is answered 431 */
+#ifndef HTTP_MAXHEADERS
+#define HTTP_MAXHEADERS 24
+#endif
+
+/* most path parameters a route may have */
+#ifndef HTTP_MAXPARAMS
+#define HTTP_MAXPARAMS 4
+#endif
+
+/* one header line, as offsets into the request buffer */
+struct http_hdr_struct {
+ unsigned short name;
+ unsigned short name_len;
+ unsigned short value;
+ unsigned short value_len;
+};
+
+/* one path parameter, matched by the route */
+/*  the value is an offset into the request buffer */
+struct http_param_struct {
+ const char *name;
+ unsigned short value;
+ unsigned short value_len;
+};
+
+/* incremental request parser state, kept per connection */
+/*  offsets are into the connection's read buffer, */
+/*  which is why RBUFSIZE may not exceed 65535 */
+struct http_req_struct {
+ unsigned short state;
+ unsigned short scan;       /* bytes of buffer already parsed */
+ unsigned short method;
+ unsigned short method_len; /* method starts at 0 */
+ unsigned short path;
+ unsigned short path_len;
+ unsigned short version;
+ unsigned short version_len;
+ unsigned short head_len;   /* through the blank line */
+ unsigned short body_len;   /* from Content-Length, follows the head */
+ unsigned short hdr_count;
+ struct http_hdr_struct hdr[HTTP_MAXHEADERS];
+ unsigned short param_count;
+ struct http_param_struct param[HTTP_MAXPARAMS];
+};
+
 int http_init(void);
 
+int http_reload(void);
+
+int http_served(const char *in_name);
+
+int http_parse(const char *in_buf, unsigned int in_len, struct http_req_struct *io_req);
+
 int http_callback(const char *in_method, const char *in_path_match, int (*in_f)(const char*,int) );
 
-int http_root(const char *in_req, int in_fd);
+int http_404(const char *in_req, int in_fd);
+
+const char *http_header(int in_fd, const char *in_name, unsigned int *out_len);
+
+const char *http_param(int in_fd, const char *in_name, unsigned int *out_len);
+
+const char *http_query(int in_fd, const char *in_name, unsigned int *out_len);
 
-int http_handle(const char *in_req, int in_fd);
+int http_handle(int in_fd);
 
 #endif
@@ -27,14 +27,20 @@
 
 /* POSIX headers */
 /*  POSIX Issue 1 */
-#include <unistd.h> /* fork, setsid, chdir */
+#include <unistd.h> /* fork, setsid, chdir, getopt */
 #include <fcntl.h>
+#include <signal.h>
+/*  POSIX Issue 4 */
+#include <sys/resource.h> /* getrlimit, setrlimit */
+/*  POSIX Issue 5 */
+#include <pthread.h>
 
 /* Local headers */
 #include "sckt_util.h"
 #include "evnt_util.h"
 #include "http_util.h"
 #include "sse_util.h"
+#include "watch_util.h"
 
 #include "tunerd.h"
 
@@ -47,11 +53,42 @@
 #define LOGPATH "/var/tunerd/tunerd.log"
 #endif
 
+/* most HTTP connections, over all workers */
+/*  tables grow up to it as clients arrive, -c overrides */
 #ifndef MAXCONNECTIONS
-#define MAXCONNECTIONS 32 
+#define MAXCONNECTIONS 1024
+#endif
+
+/* most connections waiting to be accepted, per listen socket */
+/*  -b overrides */
+#ifndef BACKLOG
+#define BACKLOG 128
+#endif
+
+/* descriptors besides connections: stdio, log, listen sockets, */
+/*  wake pipes and backends, for each worker */
+#ifndef FDSPARE
+#define FDSPARE 64
+#endif
+
+/* event loop threads, each with its own listen sockets and connections */
+/*  -w on the command line overrides */
+#ifndef WORKERS
+#define WORKERS 1
+#endif
+
+/* milliseconds between readings of the tuner's signal, 0 for none */
+/*  -s overrides */
+#ifndef SAMPLEMS
+#define SAMPLEMS 1000
 #endif
 
 /* File scope variables */
+/* set from the command line, before workers start */
+static unsigned int max_connections = MAXCONNECTIONS;
+static int backlog = BACKLOG;
+static unsigned int sample_ms = SAMPLEMS;
+
 /* External variables */
 /* External functions */
 /* Structures and unions */
@@ -78,12 +115,69 @@ time_t time_val;
 }
 
 
+/******************/
+/* raise_nofile() */
+/******************/
+/* raise the descriptor limit, as far as allowed, */
+/*  to hold in_max connections */
+static void
+raise_nofile(
+ unsigned int in_max)
+{
+struct rlimit rl;
+rlim_t need = 0;
+
+  if (getrlimit(RLIMIT_NOFILE, &rl) == (-1)) {
+    fprintf(stderr, "raise_nofile: getrlimit() error\n");
+    return;
+  }
+
+  need = (rlim_t)in_max + FDSPARE;
+  if (rl.rlim_cur >= need) return;
+
+  if ((rl.rlim_max != RLIM_INFINITY) && (rl.rlim_max < need)) {
+    fprintf(stderr, "raise_nofile: hard limit %lu is below %lu descriptors\n",
+     (unsigned long)rl.rlim_max, (unsigned long)need);
+    need = rl.rlim_max;
+  }
+  rl.rlim_cur = need;
+  if (setrlimit(RLIMIT_NOFILE, &rl) == (-1)) {
+    fprintf(stderr, "raise_nofile: setrlimit() error\n");
+  }
+}
+
+
 /**********/
 /* init() */
 /**********/
+/* once, before any worker starts */
+/* return: 0 success, -1 error */
+static int
+init(void)
+{
+int status = 0;
+
+  /* every connection is a descriptor */
+  raise_nofile(max_connections);
+
+  status = http_init();
+  if (status == (-1)) {
+    return(status);
+  }
+
+  status = tunerd_init(sample_ms);
+
+  return(status);
+}
+
+
+/*****************/
+/* worker_init() */
+/*****************/
+/* in each worker thread */
 /* return: 0 success, -1 error */
 static int
-init(
+worker_init(
  int *io_fd4,
  int *io_fd6)
 {
@@ -92,20 +186,15 @@ int t4 = -1;
 int t6 = -1;
 
   /* set up sockets for listening */
-  t4 = sckt4_listen("0.0.0.0", 80);
-  t6 = sckt6_listen("::0", 80);
-
-  /* initialize eventloop functions */
-  status = evnt_init(t4, t6, MAXCONNECTIONS);
-  if (status == (-1)) {
-    return(status);
-  }
+  t4 = sckt4_listen("0.0.0.0", 80, backlog);
+  t6 = sckt6_listen("::0", 80, backlog);
 
   /* return file descriptors back to calling function */
   *io_fd4 = t4;
   *io_fd6 = t6;
 
-  status = http_init();
+  /* initialize eventloop functions */
+  status = evnt_init(t4, t6, max_connections);
   if (status == (-1)) {
     return(status);
   }
@@ -115,7 +204,7 @@ int t6 = -1;
     return(status);
   }
 
-  status = tunerd_init();
+  status = tunerd_worker_init();
 
   return(status);
 }
@@ -130,12 +219,40 @@ end(
  int in_fd6)
 {
   evnt_end();
+  sse_end();
 
   if (in_fd4 >= 0) sckt_close(in_fd4);
   if (in_fd6 >= 0) sckt_close(in_fd6);
 }
 
 
+/************/
+/* worker() */
+/************/
+/* thread start routine, runs one event loop until the server stops */
+static void *
+worker(
+ void *in_arg)
+{
+int status = 0;
+int fd4 = -1;
+int fd6 = -1;
+
+  status = worker_init(&fd4, &fd6);
+
+  if (status == 0) {
+    evnt_loop();
+  } else {
+    /* one worker failing takes the others down */
+    evnt_stop();
+  }
+
+  end(fd4, fd6);
+
+  return(NULL);
+}
+
+
 /**********/
 /* main() */
 /**********/
@@ -145,12 +262,61 @@ main(
  char *argv[])
 {
 FILE *fp = NULL; /* for stderr = log file */
+pthread_t *tid = NULL;
+sigset_t block;
+sigset_t old;
 pid_t pid = 0;
 char timestamp[32];
+char *ep = NULL;
+long workers = WORKERS;
+long n = 0;
+unsigned long reaped = 0;
+unsigned long reaped_ms = 0;
+unsigned long reaped_max = 0;
 int fd = 0;
 int status = 0;
-int fd4 = 0;
-int fd6 = 0;
+int opt = 0;
+int i = 0;
+
+  /* options */
+  while ((opt = getopt(argc, argv, "b:c:s:w:")) != (-1)) {
+    switch (opt) {
+      case 'b':
+        n = strtol(optarg, &ep, 10);
+        if ((*ep != '\0') || (n < 1) || (n > 65535)) {
+          fprintf(stderr, "main: -b takes a backlog of 1 to 65535\n");
+          return(EXIT_FAILURE);
+        }
+        backlog = n;
+        break;
+      case 'c':
+        n = strtol(optarg, &ep, 10);
+        if ((*ep != '\0') || (n < 1) || (n > 1000000)) {
+          fprintf(stderr, "main: -c takes 1 to 1000000 connections\n");
+          return(EXIT_FAILURE);
+        }
+        max_connections = n;
+        break;
+      case 's':
+        n = strtol(optarg, &ep, 10);
+        if ((*ep != '\0') || (n < 0) || (n > 3600000)) {
+          fprintf(stderr, "main: -s takes 0 to 3600000 milliseconds\n");
+          return(EXIT_FAILURE);
+        }
+        sample_ms = n;
+        break;
+      case 'w':
+        workers = strtol(optarg, &ep, 10);
+        if ((*ep != '\0') || (workers < 1) || (workers > EVNT_MAXWORKERS)) {
+          fprintf(stderr, "main: -w takes 1 to %d workers\n", EVNT_MAXWORKERS);
+          return(EXIT_FAILURE);
+        }
+        break;
+      default:
+        fprintf(stderr, "usage: tunerd [-b backlog] [-c connections] [-s sample_ms] [-w workers]\n");
+        return(EXIT_FAILURE);
+    }
+  }
 
   /* daemon */
   /* fork */
@@ -200,13 +366,57 @@ int fd6 = 0;
 
 
   /* main program */
-  status = init(&fd4, &fd6);
+  status = init();
 
   if (status == 0) {
-    status = evnt_loop();
+    /* each worker listens on a socket of its own, on the same port */
+    if ((workers > 1) && !sckt_reuseport()) {
+      fprintf(stderr, "main: no SO_REUSEPORT on this system, running 1 worker\n");
+      workers = 1;
+    }
+    tid = calloc(workers, sizeof(pthread_t));
+    if (tid == NULL) {
+      fprintf(stderr, "main: calloc() error\n");
+      workers = 1;
+    }
+
+    /* SIGINT and SIGTERM are taken by the main thread only, */
+    /*  its handler wakes the others */
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    for (i = 1; i < workers; i++) {
+      if (pthread_create(&tid[i], NULL, worker, NULL) != 0) {
+        fprintf(stderr, "main: pthread_create() error\n");
+        break;
+      }
+    }
+    workers = i;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    /* the main thread is worker 0 */
+    worker(NULL);
+
+    for (i = 1; i < workers; i++) {
+      pthread_join(tid[i], NULL);
+    }
+    free(tid);
   }
 
-  end(fd4, fd6);
+  /* the threads that post to the workers stop before */
+  /*  the workers' mailboxes go */
+  watch_end();
+  tunerd_end();
+  evnt_free();
+
+  /* listeners that went away without a word, such as a tablet */
+  /*  put to sleep, and how long they held their connection */
+  sse_stats(&reaped, &reaped_ms, &reaped_max);
+  if (reaped > 0) {
+    fprintf(stderr, "main: %lu dead SSE listeners reaped, silent %lu ms on average, %lu ms at most\n",
+     reaped, reaped_ms / reaped, reaped_max);
+  }
 
   filltimestring(timestamp);
   fprintf(stderr, "%s tunerd: shutting down\n", timestamp);
@@ -0,0 +1,247 @@
+/* meter_util.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+/* POSIX headers */
+
+/* Local headers */
+#include "meter_util.h"
+
+/* Macros */
+/* readings kept, a power of 2, an hour of them at one a second */
+#ifndef METER_SIZE
+#define METER_SIZE 4096
+#endif
+#define METER_MASK (METER_SIZE - 1)
+
+/* File scope variables */
+/*  a slot's seq is the number of its reading, counted from 1, */
+/*  0 while it is being written, so a reader that finds it */
+/*  the same before and after taking the reading has a whole one */
+/*  (a seqlock per slot), every field is read and written atomically */
+struct meter_slot_struct {
+ unsigned long long seq;
+ unsigned long long ms;
+ unsigned int packed; /* kHz, signal + 1 and stereo + 1, see meter_put() */
+};
+static struct meter_slot_struct meter_ring[METER_SIZE];
+static unsigned long long meter_count = 0; /* readings ever put */
+
+/* External variables */
+/* External functions */
+/* Structures and unions */
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/***************/
+/* meter_now() */
+/***************/
+/* return: milliseconds on the monotonic clock, 0 on error */
+unsigned long long
+meter_now(void)
+{
+struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == (-1)) {
+    fprintf(stderr, "meter_now: clock_gettime() error\n");
+    return(0);
+  }
+
+  return((unsigned long long)ts.tv_sec * 1000 + (unsigned long long)ts.tv_nsec / 1000000);
+}
+
+
+/***************/
+/* meter_put() */
+/***************/
+/* add a reading, taken now, replacing the oldest once the ring is full */
+/*  from the one writing thread only */
+void
+meter_put(
+ unsigned long in_kHz,
+ int in_signal,
+ int in_stereo)
+{
+struct meter_slot_struct *s = NULL;
+unsigned long long n = 0;
+unsigned int packed = 0;
+
+  /* kHz in the low 20 bits, up to 1048 MHz, signal + 1 in the next 8, */
+  /*  stereo + 1 in the 2 above */
+  packed = (unsigned int)(in_kHz & 0xFFFFF) |
+   ((unsigned int)((in_signal + 1) & 0xFF) << 20) |
+   ((unsigned int)((in_stereo + 1) & 0x3) << 28);
+
+  n = __atomic_load_n(&meter_count, __ATOMIC_RELAXED);
+  s = &(meter_ring[n & METER_MASK]);
+
+  __atomic_store_n(&(s->seq), 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&(s->ms), meter_now(), __ATOMIC_RELAXED);
+  __atomic_store_n(&(s->packed), packed, __ATOMIC_RELAXED);
+  __atomic_store_n(&(s->seq), n + 1, __ATOMIC_RELEASE);
+
+  __atomic_store_n(&meter_count, n + 1, __ATOMIC_RELEASE);
+}
+
+
+/***************/
+/* meter_get() */
+/***************/
+/* copy out the newest readings, at most in_max, oldest first */
+/*  one overwritten while it was copied is left out */
+/* return: readings copied */
+unsigned int
+meter_get(
+ struct meter_sample *out_sample,
+ unsigned int in_max)
+{
+struct meter_slot_struct *s = NULL;
+unsigned long long n = 0;
+unsigned long long i = 0;
+unsigned long long seq = 0;
+unsigned long long ms = 0;
+unsigned int packed = 0;
+unsigned int count = 0;
+
+  n = __atomic_load_n(&meter_count, __ATOMIC_ACQUIRE);
+  if (in_max > METER_SIZE) in_max = METER_SIZE;
+  i = (n > in_max) ? n - in_max : 0;
+
+  for (; i < n; i++) {
+    s = &(meter_ring[i & METER_MASK]);
+    seq = __atomic_load_n(&(s->seq), __ATOMIC_ACQUIRE);
+    ms = __atomic_load_n(&(s->ms), __ATOMIC_RELAXED);
+    packed = __atomic_load_n(&(s->packed), __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if ((seq != i + 1) || (__atomic_load_n(&(s->seq), __ATOMIC_RELAXED) != seq)) {
+      continue;
+    }
+    out_sample[count].ms = ms;
+    out_sample[count].kHz = packed & 0xFFFFF;
+    out_sample[count].signal = (int)((packed >> 20) & 0xFF) - 1;
+    out_sample[count].stereo = (int)((packed >> 28) & 0x3) - 1;
+    count += 1;
+  }
+
+  return(count);
+}
+
+
+/******************/
+/* meter_series() */
+/******************/
+/* the readings since in_since (0 for all kept) until now, */
+/*  taken together into in_points spans of equal time, oldest first */
+/*  spans with no reading are left out */
+/* return: points filled, -1 on error */
+int
+meter_series(
+ struct meter_point *out_point,
+ unsigned int in_points,
+ unsigned long long in_since)
+{
+struct meter_sample *sample = NULL;
+struct meter_point *p = NULL;
+unsigned long long now = 0;
+unsigned long long span = 0;
+unsigned int count = 0;
+unsigned int points = 0;
+unsigned int i = 0;
+unsigned int k = 0;
+unsigned int last = 0;
+long sum = 0;
+unsigned int told = 0;
+unsigned int stereo = 0;
+unsigned int heard = 0;
+
+  if (in_points == 0) return(0);
+
+  sample = malloc(sizeof(struct meter_sample) * METER_SIZE);
+  if (sample == NULL) {
+    fprintf(stderr, "meter_series: malloc() error\n");
+    return(-1);
+  }
+  count = meter_get(sample, METER_SIZE);
+  now = meter_now();
+
+  /* the readings before in_since are skipped */
+  for (i = 0; (i < count) && (sample[i].ms < in_since); i++) {
+  }
+  if (i == count) {
+    free(sample);
+    return(0);
+  }
+  if (in_since == 0) in_since = sample[i].ms;
+  span = now - in_since + 1;
+
+  /* each span in turn, from the readings in it */
+  last = in_points;
+  for (; i < count; i++) {
+    k = (unsigned int)((sample[i].ms - in_since) * in_points / span);
+    if (k >= in_points) k = in_points - 1;
+    if (k != last) {
+      if (last != in_points) {
+        p->signal = (told > 0) ? (int)(sum / told) : (-1);
+        p->stereo = (heard > 0) ? (stereo * 2 >= heard) : (-1);
+      }
+      p = &(out_point[points]);
+      points += 1;
+      p->min = (-1);
+      p->max = (-1);
+      p->count = 0;
+      sum = 0;
+      told = 0;
+      stereo = 0;
+      heard = 0;
+      last = k;
+    }
+    p->ms = sample[i].ms;
+    p->kHz = sample[i].kHz;
+    p->count += 1;
+    if (sample[i].signal >= 0) {
+      sum += sample[i].signal;
+      told += 1;
+      if ((p->min == (-1)) || (sample[i].signal < p->min)) p->min = sample[i].signal;
+      if (sample[i].signal > p->max) p->max = sample[i].signal;
+    }
+    if (sample[i].stereo >= 0) {
+      stereo += (unsigned int)sample[i].stereo;
+      heard += 1;
+    }
+  }
+  if (p != NULL) {
+    p->signal = (told > 0) ? (int)(sum / told) : (-1);
+    p->stereo = (heard > 0) ? (stereo * 2 >= heard) : (-1);
+  }
+
+  free(sample);
+
+  return((int)points);
+}
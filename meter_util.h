@@ -0,0 +1,54 @@
+/* meter_util.h */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* signal meter, a history of the tuner's signal readings */
+/*  a fixed ring, written by one thread, the one that owns the tuner, */
+/*  and read by any number of others without a lock, */
+/*  a reader never waits on the writer, nor the writer on readers */
+
+#ifndef meter_util_h
+#define meter_util_h
+
+/* one reading */
+struct meter_sample {
+ unsigned long long ms; /* when, on the monotonic clock, see meter_now() */
+ unsigned long kHz;
+ int signal; /* 0 to 100, -1 the tuner cannot tell */
+ int stereo; /* 1 or 0, -1 the tuner cannot tell */
+};
+
+/* readings taken together, for a shorter series */
+struct meter_point {
+ unsigned long long ms; /* of the last reading in it */
+ unsigned long kHz;     /* of the last reading in it */
+ int signal;            /* average, -1 none told */
+ int min;
+ int max;
+ int stereo;            /* 1 most readings were stereo, 0 not, -1 none told */
+ unsigned int count;
+};
+
+unsigned long long meter_now(void);
+
+void meter_put(unsigned long in_kHz, int in_signal, int in_stereo);
+
+unsigned int meter_get(struct meter_sample *out_sample, unsigned int in_max);
+
+int meter_series(struct meter_point *out_point, unsigned int in_points, unsigned long long in_since);
+
+#endif
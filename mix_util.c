@@ -39,6 +39,14 @@
 /* Feature test switches */
 /* #define _POSIX_C_SOURCE 200112L */
 
+/* the audio(4) mixer of OpenBSD and NetBSD */
+/*  elsewhere the mixer is left as it is, set it with the system's tools */
+#if !defined(MIX_AUDIOIO) && (defined(__OpenBSD__) || defined(__NetBSD__))
+#define MIX_AUDIOIO
+#endif
+
+#if defined(MIX_AUDIOIO)
+
 /* System headers */
 /* C language headers */
 #include <stdlib.h>
@@ -474,3 +482,44 @@ int status = 0;
   status = mixset(mix_files_str);
   return(status);
 }
+
+#else
+
+/* Local headers */
+#include "mix_util.h"
+
+/* Functions */
+
+/**************/
+/* mix_init() */
+/**************/
+/* return: 0, there is no mixer to set */
+int
+mix_init(void)
+{
+  return(0);
+}
+
+
+/***************/
+/* mix_radio() */
+/***************/
+/* return: 0, there is no mixer to set */
+int
+mix_radio(void)
+{
+  return(0);
+}
+
+
+/***************/
+/* mix_files() */
+/***************/
+/* return: 0, there is no mixer to set */
+int
+mix_files(void)
+{
+  return(0);
+}
+
+#endif
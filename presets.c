@@ -50,46 +50,169 @@ short preset_cur = 0;
 /* Functions */
 
 
-/**********/
-/* read() */
-/**********/
+/******************/
+/* presets_load() */
+/******************/
+/* read the presets file into a new table, of out_size entries */
+/*  with out_count used, the current presets are left alone */
 /* return 0 on success, -1 on error */
-static int
-presets_read(void)
+int
+presets_load(
+ long **out_preset,
+ unsigned short *out_size,
+ unsigned short *out_count)
 {
 FILE *fp = NULL;
+long *p = NULL;
+long *t = NULL;
 char line[256];
-int i;
+unsigned short size = 16;
+unsigned short count = 0;
+
+  p = (long*) malloc(sizeof(long) * size);
+  if (p == NULL) {
+    fprintf(stderr, "presets_load: malloc() error\n");
+    return(-1);
+  }
 
   fp = fopen(PRESETSPATH, "r");
   if (fp == NULL) {
-    fprintf(stderr, "presets_read: fopen() error %s\n", PRESETSPATH);
+    fprintf(stderr, "presets_load: fopen() error %s\n", PRESETSPATH);
+    free(p);
     return(-1);
   }
 
   line[0] = '\0';
-  i = 0;
   while (fgets(line, 255, fp) != NULL) {
-    if (i >= preset_size) {
-      preset_size *= 2;
-      preset = (long*) realloc(preset, sizeof(long) * preset_size);
-      if (preset == NULL) {
-        fprintf(stderr, "presets_read: realloc() error\n");
+    if (count >= size) {
+      size *= 2;
+      t = (long*) realloc(p, sizeof(long) * size);
+      if (t == NULL) {
+        fprintf(stderr, "presets_load: realloc() error\n");
+        fclose(fp);
+        free(p);
         return(-1);
       }
+      p = t;
     }
-    if (sscanf(line, "%ld", &preset[i]) > 0) {
-      preset_count += 1;
-      i += 1;
+    if (sscanf(line, "%ld", &p[count]) > 0) {
+      count += 1;
     }
   }
   if (ferror(fp)) {
-    fprintf(stderr, "presets_read: fgets() error presets.txt\n");
+    fprintf(stderr, "presets_load: fgets() error presets.txt\n");
+    fclose(fp);
+    free(p);
     return(-1);
   }
 
   fclose(fp);
 
+  *out_preset = p;
+  *out_size = size;
+  *out_count = count;
+
+  return(0);
+}
+
+
+/******************/
+/* presets_swap() */
+/******************/
+/* replace the presets with a table from presets_load(), which it keeps */
+/*  the current preset is found again by its frequency, wherever */
+/*  the new table has it, or is none if the station is gone */
+/*  called under the lock that guards the presets */
+/* return 1 presets changed, 0 they are the same */
+int
+presets_swap(
+ long *in_preset,
+ unsigned short in_size,
+ unsigned short in_count)
+{
+long cur = -1;
+short i;
+
+  if ((in_count == preset_count) &&
+   ((in_count == 0) || (memcmp(in_preset, preset, sizeof(long) * in_count) == 0))) {
+    free(in_preset);
+    return(0);
+  }
+
+  if ((preset_cur >= 0) && (preset_cur < preset_count)) cur = preset[preset_cur];
+
+  free(preset);
+  preset = in_preset;
+  preset_size = in_size;
+  preset_count = in_count;
+  preset_cur = -1;
+  for (i = 0; (cur != -1) && (i < preset_count); i++) {
+    if (preset[i] == cur) {
+      preset_cur = i;
+      break;
+    }
+  }
+
+  return(1);
+}
+
+
+/******************/
+/* presets_file() */
+/******************/
+/* return 1 in_name is the name of the presets file, 0 not */
+int
+presets_file(
+ const char *in_name)
+{
+const char *name = NULL;
+
+  name = strrchr(PRESETSPATH, '/');
+  name = (name == NULL) ? PRESETSPATH : name + 1;
+
+  return(strcmp(in_name, name) == 0);
+}
+
+
+/******************/
+/* presets_save() */
+/******************/
+/* write a new presets file, in_count presets from in_preset */
+/*  written aside and renamed over the old, so no reader sees half */
+/* return 0 on success, -1 on error */
+int
+presets_save(
+ const long *in_preset,
+ unsigned short in_count)
+{
+FILE *fp = NULL;
+unsigned short i;
+int status = 0;
+
+  fp = fopen(PRESETSPATH ".new", "w");
+  if (fp == NULL) {
+    fprintf(stderr, "presets_save: fopen() error %s\n", PRESETSPATH ".new");
+    return(-1);
+  }
+
+  for (i = 0; i < in_count; i++) {
+    fprintf(fp, "%ld\n", in_preset[i]);
+  }
+
+  if (ferror(fp)) status = (-1);
+  if (fclose(fp) == EOF) status = (-1);
+  if (status == (-1)) {
+    fprintf(stderr, "presets_save: fprintf() error %s\n", PRESETSPATH ".new");
+    remove(PRESETSPATH ".new");
+    return(-1);
+  }
+
+  if (rename(PRESETSPATH ".new", PRESETSPATH) == (-1)) {
+    fprintf(stderr, "presets_save: rename() error %s\n", PRESETSPATH);
+    remove(PRESETSPATH ".new");
+    return(-1);
+  }
+
   return(0);
 }
 
@@ -137,11 +260,12 @@ presets_init(void)
     return(-1);
   }
 
-  preset = (long*) malloc(sizeof(long) * 16);
-  preset_size = 16;
-  preset_count = 0;
-
-  presets_read();
+  if (presets_load(&preset, &preset_size, &preset_count) == (-1)) {
+    /* none yet, the file may be written later */
+    preset = (long*) malloc(sizeof(long) * 16);
+    preset_size = 16;
+    preset_count = 0;
+  }
 
   preset_cur = -1;
 
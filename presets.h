@@ -21,6 +21,14 @@
 
 int presets_init(void);
 
+int presets_load(long **out_preset, unsigned short *out_size, unsigned short *out_count);
+
+int presets_swap(long *in_preset, unsigned short in_size, unsigned short in_count);
+
+int presets_save(const long *in_preset, unsigned short in_count);
+
+int presets_file(const char *in_name);
+
 void presets_end(void);
 
 long presets_next(void);
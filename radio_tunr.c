@@ -0,0 +1,563 @@
+/* radio_tunr.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* backend selection, one of RADIO_RADIOIO, RADIO_V4L2, RADIO_SIM */
+#if !defined(RADIO_RADIOIO) && !defined(RADIO_V4L2) && !defined(RADIO_SIM)
+#if defined(__OpenBSD__) || defined(__NetBSD__)
+#define RADIO_RADIOIO
+#elif defined(__linux__)
+#define RADIO_V4L2
+#else
+#define RADIO_SIM
+#endif
+#endif
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+/* POSIX headers */
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#if defined(RADIO_SIM)
+#include <time.h> /* nanosleep() */
+#endif
+
+/* non POSIX headers */
+#if defined(RADIO_RADIOIO)
+#include <sys/ioctl.h>
+#include <sys/radioio.h>
+#elif defined(RADIO_V4L2)
+#include <sys/ioctl.h>
+#include <sys/time.h> /* struct timeval, in videodev2.h */
+#include <linux/videodev2.h>
+#endif
+
+/* Local headers */
+#include "radio_tunr.h"
+
+/* Macros */
+#if defined(RADIO_RADIOIO)
+#ifndef RADIODEV
+#define RADIODEV "/dev/radio"
+#endif
+#elif defined(RADIO_V4L2)
+#ifndef RADIODEV
+#define RADIODEV "/dev/radio0"
+#endif
+#else
+/* the simulated tuner */
+/*  microseconds a set, and a read, of the tuner take, */
+/*  a card's tuner is programmed over i2c, then its PLL settles */
+#ifndef RADIO_SIMDELAY
+#define RADIO_SIMDELAY 20000
+#endif
+#ifndef RADIO_SIMREAD
+#define RADIO_SIMREAD 1000
+#endif
+/* the stations on the air, kHz:strength, strength 0 to 100 */
+#ifndef RADIO_SIMSTATIONS
+#define RADIO_SIMSTATIONS \
+ "88300:35 89700:90 90900:70 92500:85 92900:60 94100:25 95700:95 " \
+ "96100:55 97300:20 99500:90 100700:80 101100:65 102500:75 103300:50 " \
+ "104100:85 104500:45 105700:70 106500:30 107300:60"
+#endif
+/* strength is lost linearly, all of it this many kHz off a station */
+#ifndef RADIO_SIMWIDTH
+#define RADIO_SIMWIDTH 200
+#endif
+/* a reading wanders this much either side of the model */
+#ifndef RADIO_SIMNOISE
+#define RADIO_SIMNOISE 3
+#endif
+/* strength at which the stereo pilot is detected */
+#ifndef RADIO_SIMSTEREO
+#define RADIO_SIMSTEREO 50
+#endif
+#define SIM_STATIONS 64
+#endif
+
+/* File scope variables */
+/*  the tuner, opened once and kept open, */
+/*  with the settings last read from or written to it */
+static int tunr_fd = (-1);
+
+#if defined(RADIO_RADIOIO)
+static struct radio_info tunr_cache;
+#elif defined(RADIO_V4L2)
+static unsigned long tunr_unit = 0; /* frequency units per MHz */
+#else
+static int sim_open = 0;
+static unsigned long sim_freq = 99500; /* survives a close, as a card's */
+static unsigned int sim_seed = 1;
+static unsigned int sim_count = 0;
+static unsigned long sim_kHz[SIM_STATIONS];
+static int sim_strength[SIM_STATIONS];
+#endif
+
+/* External variables */
+/* External functions */
+/* Structures and unions */
+/* Signal catching functions */
+
+/* Functions */
+
+#if defined(RADIO_RADIOIO)
+
+/* radioio, the radio(4) driver layer of OpenBSD and NetBSD */
+/*  one radio_info struct is read, changed and written back */
+
+/***************/
+/* tunr_open() */
+/***************/
+/* open the tuner, if it is not, and read its settings into the cache */
+/*  return 0 on success, -1 on error */
+int
+tunr_open(void)
+{
+  if (tunr_fd >= 0) {
+    return(0);
+  }
+
+  /* open /dev/radio in read/write mode */
+  tunr_fd = open(RADIODEV, O_RDWR);
+  if (tunr_fd < 0) {
+    fprintf(stderr, "tunr_open: open() error %s\n", RADIODEV);
+    return(-1);
+  }
+
+  /* fill the cache with current values, once, not for every change */
+  if (ioctl(tunr_fd, RIOCGINFO, &tunr_cache) == -1) {
+    fprintf(stderr, "tunr_open: ioctl() error reading radio_info_struct\n");
+    tunr_close();
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/***************/
+/* tunr_init() */
+/***************/
+/* unmuted, in radio mode, at in_kHz */
+/*  return 0 on success, -1 on error */
+int
+tunr_init(
+ unsigned long in_kHz)
+{
+  /* change the desired values, leaving others as they are */
+  tunr_cache.mute = 0; /* 0=false */
+  tunr_cache.tuner_mode = RADIO_TUNER_MODE_RADIO;
+  tunr_cache.freq = in_kHz;
+
+  if (ioctl(tunr_fd, RIOCSINFO, &tunr_cache) == -1) {
+    fprintf(stderr, "tunr_init: ioctl() error setting radio_info_struct\n");
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/***************/
+/* tunr_freq() */
+/***************/
+/*  return 0 on success, -1 on error */
+int
+tunr_freq(
+ unsigned long in_kHz)
+{
+  tunr_cache.freq = in_kHz;
+
+  if (ioctl(tunr_fd, RIOCSINFO, &tunr_cache) == -1) {
+    fprintf(stderr, "tunr_freq: ioctl() error setting radio_info_struct\n");
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/***************/
+/* tunr_read() */
+/***************/
+/* the driver tells signal and stereo as yes or no, if the card can */
+/*  return 0 on success, -1 on error */
+int
+tunr_read(
+ struct tunr_state *out_state)
+{
+  if (ioctl(tunr_fd, RIOCGINFO, &tunr_cache) == -1) {
+    fprintf(stderr, "tunr_read: ioctl() error reading radio_info_struct\n");
+    return(-1);
+  }
+
+  out_state->freq = tunr_cache.freq;
+  out_state->signal = (-1);
+  if (tunr_cache.caps & RADIO_CAPS_DETECT_SIGNAL) {
+    out_state->signal = (tunr_cache.info & RADIO_INFO_SIGNAL) ? 100 : 0;
+  }
+  out_state->stereo = (-1);
+  if (tunr_cache.caps & RADIO_CAPS_DETECT_STEREO) {
+    out_state->stereo = (tunr_cache.info & RADIO_INFO_STEREO) ? 1 : 0;
+  }
+
+  return(0);
+}
+
+
+/***************/
+/* tunr_name() */
+/***************/
+const char *
+tunr_name(void)
+{
+  return("radioio");
+}
+
+#elif defined(RADIO_V4L2)
+
+/* Video4Linux2 radio, tuner 0 of /dev/radio0 */
+/*  frequencies are in units of 62.5 kHz, or 62.5 Hz for a tuner */
+/*  with V4L2_TUNER_CAP_LOW, as every FM tuner driver now has */
+
+/***************/
+/* tunr_open() */
+/***************/
+/* open the tuner, if it is not, and learn its frequency unit */
+/*  return 0 on success, -1 on error */
+int
+tunr_open(void)
+{
+struct v4l2_tuner tuner;
+
+  if (tunr_fd >= 0) {
+    return(0);
+  }
+
+  tunr_fd = open(RADIODEV, O_RDWR);
+  if (tunr_fd < 0) {
+    fprintf(stderr, "tunr_open: open() error %s\n", RADIODEV);
+    return(-1);
+  }
+
+  memset(&tuner, 0, sizeof(tuner));
+  tuner.index = 0;
+  if (ioctl(tunr_fd, VIDIOC_G_TUNER, &tuner) == -1) {
+    fprintf(stderr, "tunr_open: ioctl() error reading v4l2_tuner\n");
+    tunr_close();
+    return(-1);
+  }
+  tunr_unit = (tuner.capability & V4L2_TUNER_CAP_LOW) ? 16000 : 16;
+
+  return(0);
+}
+
+
+/***************/
+/* tunr_init() */
+/***************/
+/* unmuted, at in_kHz */
+/*  return 0 on success, -1 on error */
+int
+tunr_init(
+ unsigned long in_kHz)
+{
+struct v4l2_control control;
+
+  /* not every driver has a mute control, those play when tuned */
+  memset(&control, 0, sizeof(control));
+  control.id = V4L2_CID_AUDIO_MUTE;
+  control.value = 0; /* 0=false */
+  if ((ioctl(tunr_fd, VIDIOC_S_CTRL, &control) == -1) && (errno != EINVAL)) {
+    fprintf(stderr, "tunr_init: ioctl() error unmuting\n");
+    return(-1);
+  }
+
+  return(tunr_freq(in_kHz));
+}
+
+
+/***************/
+/* tunr_freq() */
+/***************/
+/*  return 0 on success, -1 on error */
+int
+tunr_freq(
+ unsigned long in_kHz)
+{
+struct v4l2_frequency frequency;
+
+  memset(&frequency, 0, sizeof(frequency));
+  frequency.tuner = 0;
+  frequency.type = V4L2_TUNER_RADIO;
+  frequency.frequency = (__u32)(in_kHz * tunr_unit / 1000);
+
+  if (ioctl(tunr_fd, VIDIOC_S_FREQUENCY, &frequency) == -1) {
+    fprintf(stderr, "tunr_freq: ioctl() error setting v4l2_frequency\n");
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/***************/
+/* tunr_read() */
+/***************/
+/* the driver tells signal as 0 to 65535, and stereo as a subchannel */
+/*  return 0 on success, -1 on error */
+int
+tunr_read(
+ struct tunr_state *out_state)
+{
+struct v4l2_frequency frequency;
+struct v4l2_tuner tuner;
+
+  memset(&frequency, 0, sizeof(frequency));
+  frequency.tuner = 0;
+  if (ioctl(tunr_fd, VIDIOC_G_FREQUENCY, &frequency) == -1) {
+    fprintf(stderr, "tunr_read: ioctl() error reading v4l2_frequency\n");
+    return(-1);
+  }
+  memset(&tuner, 0, sizeof(tuner));
+  tuner.index = 0;
+  if (ioctl(tunr_fd, VIDIOC_G_TUNER, &tuner) == -1) {
+    fprintf(stderr, "tunr_read: ioctl() error reading v4l2_tuner\n");
+    return(-1);
+  }
+
+  out_state->freq = (unsigned long)frequency.frequency * 1000 / tunr_unit;
+  out_state->signal = (int)(tuner.signal * 100 / 65535);
+  out_state->stereo = (tuner.rxsubchans & V4L2_TUNER_SUB_STEREO) ? 1 : 0;
+
+  return(0);
+}
+
+
+/***************/
+/* tunr_name() */
+/***************/
+const char *
+tunr_name(void)
+{
+  return("v4l2");
+}
+
+#else
+
+/* a simulated tuner, in process */
+/*  a set or read takes as long as a card's would, */
+/*  and the signal is modeled on a band of stations, */
+/*  so the HTTP/SSE path is exercised as with a card */
+
+/***************/
+/* sim_delay() */
+/***************/
+/* stand in for the time of an ioctl */
+/*  none at all, not even a sleep's slack, when it takes no time */
+static void
+sim_delay(
+ long in_usec)
+{
+struct timespec ts;
+
+  if (in_usec <= 0) {
+    return;
+  }
+
+  ts.tv_sec = in_usec / 1000000;
+  ts.tv_nsec = (in_usec % 1000000) * 1000;
+  while ((nanosleep(&ts, &ts) == -1) && (errno == EINTR)) {
+  }
+}
+
+
+/***************/
+/* sim_parse() */
+/***************/
+/* read the stations from RADIO_SIMSTATIONS */
+static void
+sim_parse(void)
+{
+const char *s = RADIO_SIMSTATIONS;
+char *end = NULL;
+unsigned long kHz = 0;
+long strength = 0;
+
+  sim_count = 0;
+  while ((*s != '\0') && (sim_count < SIM_STATIONS)) {
+    kHz = strtoul(s, &end, 10);
+    if ((end == s) || (*end != ':')) {
+      break;
+    }
+    s = end + 1;
+    strength = strtol(s, &end, 10);
+    if (end == s) {
+      break;
+    }
+    s = end;
+    while (*s == ' ') {
+      s++;
+    }
+    if (strength < 0) strength = 0;
+    if (strength > 100) strength = 100;
+    sim_kHz[sim_count] = kHz;
+    sim_strength[sim_count] = (int)strength;
+    sim_count += 1;
+  }
+}
+
+
+/****************/
+/* sim_signal() */
+/****************/
+/* the strongest station heard at in_kHz, with a little noise */
+static int
+sim_signal(
+ unsigned long in_kHz)
+{
+unsigned int i = 0;
+unsigned long off = 0;
+int heard = 0;
+int best = 0;
+unsigned int x = sim_seed;
+
+  for (i = 0; i < sim_count; i++) {
+    off = (in_kHz > sim_kHz[i]) ? in_kHz - sim_kHz[i] : sim_kHz[i] - in_kHz;
+    if (off >= RADIO_SIMWIDTH) {
+      continue;
+    }
+    heard = sim_strength[i] * (int)(RADIO_SIMWIDTH - off) / RADIO_SIMWIDTH;
+    if (heard > best) best = heard;
+  }
+
+  /* xorshift, repeatable from run to run */
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  sim_seed = x;
+  if (best > 0) {
+    best += (int)(x % (2 * RADIO_SIMNOISE + 1)) - RADIO_SIMNOISE;
+  }
+  if (best < 0) best = 0;
+  if (best > 100) best = 100;
+
+  return(best);
+}
+
+
+/***************/
+/* tunr_open() */
+/***************/
+/*  return 0 on success */
+int
+tunr_open(void)
+{
+  if (sim_open) {
+    return(0);
+  }
+
+  sim_parse();
+  sim_open = 1;
+  fprintf(stderr, "tunr_open: simulated tuner, %u stations, %d us to tune\n",
+   sim_count, RADIO_SIMDELAY);
+
+  return(0);
+}
+
+
+/***************/
+/* tunr_init() */
+/***************/
+/*  return 0 on success */
+int
+tunr_init(
+ unsigned long in_kHz)
+{
+  return(tunr_freq(in_kHz));
+}
+
+
+/***************/
+/* tunr_freq() */
+/***************/
+/*  return 0 on success */
+int
+tunr_freq(
+ unsigned long in_kHz)
+{
+  sim_delay(RADIO_SIMDELAY);
+  sim_freq = in_kHz;
+
+  return(0);
+}
+
+
+/***************/
+/* tunr_read() */
+/***************/
+/*  return 0 on success */
+int
+tunr_read(
+ struct tunr_state *out_state)
+{
+  sim_delay(RADIO_SIMREAD);
+  out_state->freq = sim_freq;
+  out_state->signal = sim_signal(sim_freq);
+  out_state->stereo = (out_state->signal >= RADIO_SIMSTEREO) ? 1 : 0;
+
+  return(0);
+}
+
+
+/***************/
+/* tunr_name() */
+/***************/
+const char *
+tunr_name(void)
+{
+  return("simulated");
+}
+
+#endif
+
+
+/****************/
+/* tunr_close() */
+/****************/
+/* close the tuner, it keeps playing the station last set */
+void
+tunr_close(void)
+{
+  if (tunr_fd >= 0) {
+    close(tunr_fd);
+    tunr_fd = (-1);
+  }
+#if defined(RADIO_SIM)
+  sim_open = 0;
+#endif
+}
@@ -0,0 +1,47 @@
+/* radio_tunr.h */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* tuner backend for the radio utilities */
+/*  radioio on OpenBSD, V4L2 radio on Linux, a simulator everywhere else */
+/*  compile with -DRADIO_SIM to use the simulator on any system, */
+/*  so tunerd runs, and can be load tested, without a tuner card */
+/*  callers serialize, there is one tuner */
+
+#ifndef radio_tunr_h
+#define radio_tunr_h
+
+/* what the tuner reports */
+struct tunr_state {
+ unsigned long freq; /* kHz */
+ int signal; /* strength 0 to 100, -1 the tuner cannot tell */
+ int stereo; /* 1 stereo pilot detected, 0 not, -1 the tuner cannot tell */
+};
+
+int tunr_open(void);
+
+int tunr_init(unsigned long in_kHz);
+
+int tunr_freq(unsigned long in_kHz);
+
+int tunr_read(struct tunr_state *out_state);
+
+const char *tunr_name(void);
+
+void tunr_close(void);
+
+#endif
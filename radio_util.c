@@ -23,18 +23,12 @@
 /* C language headers */
 #include <stdlib.h>
 #include <stdio.h>
-#include <math.h> /* lrint() */
 
 /* POSIX headers */
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/types.h>
-
 /* non POSIX headers */
-#include <sys/ioctl.h>
-#include <sys/radioio.h>
 
 /* Local headers */
+#include "radio_tunr.h"
 #include "radio_util.h"
 
 /* Macros */
@@ -46,6 +40,35 @@
 
 /* Functions */
 
+/***************/
+/* radio_set() */
+/***************/
+/* make one change to the tuner, opening it if it is not open */
+/*  on error the tuner is reopened, its settings read again, */
+/*  and the change retried once */
+/*  return 0 on success, -1 on error */
+static int
+radio_set(
+ int (*in_set)(unsigned long),
+ unsigned long in_arg)
+{
+int tries = 0;
+
+  for (tries = 0; tries < 2; tries++) {
+    if (tunr_open() == (-1)) {
+      return(-1);
+    }
+    if (in_set(in_arg) == 0) {
+      return(0);
+    }
+    /* the device may have gone away and come back, start over */
+    tunr_close();
+  }
+
+  return(-1);
+}
+
+
 /****************/
 /* radio_init() */
 /****************/
@@ -54,35 +77,15 @@
 int
 radio_init(void)
 {
-struct radio_info radio_info_struct;
-int radio_fd = 0;
-int status = 0;
-
-  /* open /dev/radio in read/write mode */
-  radio_fd = open("/dev/radio", O_RDWR);
-  if (radio_fd < 0) {
-    fprintf(stderr, "radio_init: open() error /dev/radio\n");
-    return(-1);
-  }
+  fprintf(stderr, "radio_init: using %s tuner\n", tunr_name());
 
-  /* first, fill struct radio_info with current values */
-  status = ioctl(radio_fd, RIOCGINFO, &radio_info_struct);
-  if (status != -1) {
-    /* change the desired values, leaving others as they are */
-    radio_info_struct.mute = 0; /* 0=false */
-    radio_info_struct.tuner_mode = RADIO_TUNER_MODE_RADIO;
-    radio_info_struct.freq = 99500; /* kHz */
-    status = ioctl(radio_fd, RIOCSINFO, &radio_info_struct);
-    if (status == -1) {
-      fprintf(stderr, "radio_init: ioctl() error setting radio_info_struct\n");
-    }
-  } else {
-    fprintf(stderr, "radio_init: ioctl() error reading radio_info_struct\n");
+  /* unmuted, in radio mode */
+  if (radio_set(tunr_init, 99500) == (-1)) {
+    fprintf(stderr, "radio_init: tuner not set\n");
+    return(-1);
   }
 
-  close(radio_fd);
-
-  return(status);
+  return(0);
 }
 
 
@@ -90,15 +93,12 @@ int status = 0;
 /* radio_frequency() */
 /*********************/
 /* freq as integer in kHz */
+/*  the tuner stays open, so a change is the one set ioctl */
 /*  return 0 on success, -1 on error */
 int
 radio_frequency(
  unsigned long in_kHz)
 {
-struct radio_info radio_info_struct;
-int radio_fd = 0;
-int status = 0;
-
 unsigned long kHz = in_kHz;
 
   /* input checking */
@@ -108,27 +108,45 @@ unsigned long kHz = in_kHz;
     kHz = 108000;
   }
 
-  /* open /dev/radio in read/write mode */
-  radio_fd = open("/dev/radio", O_RDWR);
-  if (radio_fd < 0) {
-    fprintf(stderr, "radio_frequency: open() error /dev/radio\n");
+  if (radio_set(tunr_freq, kHz) == (-1)) {
+    fprintf(stderr, "radio_frequency: tuner not set\n");
     return(-1);
   }
 
-  /* first, fill struct radio_info with current values */
-  status = ioctl(radio_fd, RIOCGINFO, &radio_info_struct);
-  if (status != -1) {
-    /* change the desired values, leaving others as they are */
-    radio_info_struct.freq = kHz;
-    status = ioctl(radio_fd, RIOCSINFO, &radio_info_struct);
-    if (status == -1) {
-      fprintf(stderr, "radio_frequency: ioctl() error setting radio_info_struct\n");
-    }
-  } else {
-    fprintf(stderr, "radio_frequency: ioctl() error reading radio_info_struct\n");
+  return(0);
+}
+
+
+/******************/
+/* radio_signal() */
+/******************/
+/* read the tuner's signal strength, 0 to 100, and stereo, 1 or 0 */
+/*  either is -1 when the tuner cannot tell */
+/*  return 0 on success, -1 on error */
+int
+radio_signal(
+ int *out_signal,
+ int *out_stereo)
+{
+struct tunr_state state;
+
+  if ((tunr_open() == (-1)) || (tunr_read(&state) == (-1))) {
+    fprintf(stderr, "radio_signal: tuner not read\n");
+    return(-1);
   }
+  *out_signal = state.signal;
+  *out_stereo = state.stereo;
+
+  return(0);
+}
 
-  close(radio_fd);
 
-  return(status);
+/***************/
+/* radio_end() */
+/***************/
+/* close the tuner, it keeps playing the station last set */
+void
+radio_end(void)
+{
+  tunr_close();
 }
@@ -19,6 +19,8 @@
 /* radio utility functions for radio software */
 /*  on OpenBSD, using radio driver */
 /*   such as bktr, Brooktree Bt848/849/878/879 PCI cards */
+/*  on Linux, a V4L2 radio device, or a simulated tuner, see radio_tunr.h */
+/*  the device is opened once and kept open */
 
 #ifndef radio_util_h
 #define radio_util_h
@@ -27,4 +29,8 @@ int radio_init(void);
 
 int radio_frequency(unsigned long in_kHz); 
 
+int radio_signal(int *out_signal, int *out_stereo);
+
+void radio_end(void);
+
 #endif
@@ -0,0 +1,225 @@
+/* scan_util.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h> /* nanosleep() */
+
+/* POSIX headers */
+
+/* Local headers */
+#include "radio_util.h"
+#include "scan_util.h"
+
+/* Macros */
+/* the band, in kHz, and the step between frequencies scanned */
+#ifndef SCAN_FIRST
+#define SCAN_FIRST 87500
+#endif
+#ifndef SCAN_LAST
+#define SCAN_LAST 108000
+#endif
+#ifndef SCAN_STEP
+#define SCAN_STEP 100
+#endif
+
+/* milliseconds after tuning before the signal is read, */
+/*  for the tuner to lock and its signal detector to settle */
+#ifndef SCAN_DWELL
+#define SCAN_DWELL 50
+#endif
+
+/* weakest signal, 0 to 100, counted as a station */
+#ifndef SCAN_MIN
+#define SCAN_MIN 20
+#endif
+
+#define SCAN_SAMPLES ((SCAN_LAST - SCAN_FIRST) / SCAN_STEP + 1)
+
+/* File scope variables */
+/*  only used by the thread that owns the tuner */
+static struct scan_sample scan_tab[SCAN_SAMPLES];
+static unsigned int scan_next = 0;
+
+/* External variables */
+/* External functions */
+/* Structures and unions */
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/****************/
+/* scan_start() */
+/****************/
+/* begin again at the bottom of the band */
+void
+scan_start(void)
+{
+  scan_next = 0;
+}
+
+
+/***************/
+/* scan_step() */
+/***************/
+/* tune the next frequency, wait for it to settle, and read its signal */
+/*  return: 1 more steps to go, 0 the band is done, -1 error */
+int
+scan_step(
+ struct scan_sample *out_sample)
+{
+struct scan_sample *s = NULL;
+struct timespec ts;
+
+  if (scan_next >= SCAN_SAMPLES) {
+    return(0);
+  }
+  s = &(scan_tab[scan_next]);
+  s->kHz = SCAN_FIRST + (unsigned long)scan_next * SCAN_STEP;
+
+  if (radio_frequency(s->kHz) == (-1)) {
+    fprintf(stderr, "scan_step: tuner not set\n");
+    return(-1);
+  }
+
+  ts.tv_sec = SCAN_DWELL / 1000;
+  ts.tv_nsec = (SCAN_DWELL % 1000) * 1000000L;
+  while ((nanosleep(&ts, &ts) == -1) && (errno == EINTR)) {
+  }
+
+  if (radio_signal(&(s->signal), &(s->stereo)) == (-1)) {
+    return(-1);
+  }
+  if (s->signal < 0) {
+    fprintf(stderr, "scan_step: tuner does not tell signal strength\n");
+    return(-1);
+  }
+
+  *out_sample = *s;
+  scan_next += 1;
+
+  return((scan_next < SCAN_SAMPLES) ? 1 : 0);
+}
+
+
+/*************/
+/* scan_at() */
+/*************/
+/* return: steps done */
+unsigned int
+scan_at(void)
+{
+  return(scan_next);
+}
+
+
+/****************/
+/* scan_steps() */
+/****************/
+/* return: steps in the band */
+unsigned int
+scan_steps(void)
+{
+  return(SCAN_SAMPLES);
+}
+
+
+/***************/
+/* scan_rank() */
+/***************/
+/* qsort() comparison, strongest first, stereo before mono */
+static int
+scan_rank(
+ const void *in_a,
+ const void *in_b)
+{
+const struct scan_sample *a = in_a;
+const struct scan_sample *b = in_b;
+
+  if (a->signal != b->signal) return(b->signal - a->signal);
+  if (a->stereo != b->stereo) return(b->stereo - a->stereo);
+  return((a->kHz < b->kHz) ? (-1) : (a->kHz > b->kHz));
+}
+
+
+/**************/
+/* scan_kHz() */
+/**************/
+/* qsort() comparison, up the band */
+static int
+scan_kHz(
+ const void *in_a,
+ const void *in_b)
+{
+long a = *(const long *)in_a;
+long b = *(const long *)in_b;
+
+  return((a < b) ? (-1) : (a > b));
+}
+
+
+/*******************/
+/* scan_stations() */
+/*******************/
+/* the stations of the band just scanned, at most in_max of the best */
+/*  a station is a peak of signal, a flat top of equal readings */
+/*  (a tuner that only tells signal or none) is taken at its middle */
+/*  out_kHz is filled up the band, the order presets are stepped in */
+/* return: stations found */
+unsigned int
+scan_stations(
+ long *out_kHz,
+ unsigned int in_max)
+{
+struct scan_sample peak[SCAN_SAMPLES];
+unsigned int count = 0;
+unsigned int i = 0;
+unsigned int j = 0;
+int left = 0;
+int right = 0;
+
+  for (i = 0; i < scan_next; i = j) {
+    /* the run of equal readings starting at i */
+    for (j = i + 1; (j < scan_next) && (scan_tab[j].signal == scan_tab[i].signal); j++) {
+    }
+    left = (i > 0) ? scan_tab[i - 1].signal : (-1);
+    right = (j < scan_next) ? scan_tab[j].signal : (-1);
+    if ((scan_tab[i].signal >= SCAN_MIN) &&
+     (scan_tab[i].signal > left) && (scan_tab[i].signal > right)) {
+      peak[count] = scan_tab[i + (j - 1 - i) / 2];
+      count += 1;
+    }
+  }
+
+  qsort(peak, count, sizeof(peak[0]), scan_rank);
+  if (count > in_max) count = in_max;
+  for (i = 0; i < count; i++) {
+    out_kHz[i] = (long)peak[i].kHz;
+  }
+  qsort(out_kHz, count, sizeof(out_kHz[0]), scan_kHz);
+
+  return(count);
+}
@@ -0,0 +1,43 @@
+/* scan_util.h */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* band scan, one step at a time, on the thread that owns the tuner */
+/*  each step tunes the next frequency of the FM band and reads */
+/*  its signal, at the end the peaks are the stations, ranked */
+
+#ifndef scan_util_h
+#define scan_util_h
+
+/* one frequency, as measured */
+struct scan_sample {
+ unsigned long kHz;
+ int signal; /* 0 to 100 */
+ int stereo; /* 1 or 0, -1 the tuner cannot tell */
+};
+
+void scan_start(void);
+
+int scan_step(struct scan_sample *out_sample);
+
+unsigned int scan_at(void);
+
+unsigned int scan_steps(void);
+
+unsigned int scan_stations(long *out_kHz, unsigned int in_max);
+
+#endif
@@ -19,29 +19,32 @@
 /* Feature test switches */
 #define _POSIX_C_SOURCE 200112L
  /* for POSIX 1003.1-2004, issue 6, sockets */
+#if defined(__linux__)
+#define _DEFAULT_SOURCE /* glibc hides SO_REUSEPORT from strict POSIX */
+#endif
 
 /* System headers */
 /* C language headers */
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
 
 /* POSIX headers */
 /*  issue 1 */
 #include <fcntl.h>      /* fcntl */
 #include <sys/types.h>  /* read, ssize_t */
 #include <unistd.h>     /* close */
+#include <sys/uio.h>    /* writev */
 /*  issue 6 */
 #include <arpa/inet.h>  /* htons, inet_pton */
 #include <netinet/in.h>
+#include <netinet/tcp.h> /* keepalive options, where known */
 #include <sys/socket.h> /* socket, bind, listen, setsockopt */
 
 /* Local headers */
 #include "sckt_util.h"
 
 /* Macros */
-#ifndef BACKLOG
-#define BACKLOG 2
-#endif
 
 /* File scope variables */
 /* External variables */
@@ -51,15 +54,36 @@
 
 /* Functions */
 
+/********************/
+/* sckt_reuseport() */
+/********************/
+/* whether listen sockets may share a port, one per worker */
+/*  without SO_REUSEPORT a second worker's bind() would fail */
+/* return: 1 shared, 0 not */
+int
+sckt_reuseport(void)
+{
+#ifdef SO_REUSEPORT
+  return(1);
+#else
+  return(0);
+#endif
+}
+
+
 /******************/
 /* sckt4_listen() */
 /******************/
 int
 sckt4_listen(
  const char in_ipv4_addr[],
- unsigned short in_port)
+ unsigned short in_port,
+ int in_backlog)
 {
 int filedesc4 = 0;
+#ifdef SO_REUSEPORT
+int reuse = 1;
+#endif
 int fcntl_flags = 0;
 struct sockaddr_in sockaddress4;
 
@@ -87,6 +111,16 @@ struct sockaddr_in sockaddress4;
     return(-1);
   }
 
+#ifdef SO_REUSEPORT
+  /* each worker thread listens on its own socket, on the same port */
+  /*  the kernel spreads new connections among them */
+  if (setsockopt(filedesc4, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(int)) != 0) {
+    fprintf(stderr, "sckt4_listen: setsockopt() error SO_REUSEPORT\n");
+    close(filedesc4);
+    return(-1);
+  }
+#endif
+
   /* bind IPv4 */
   if (bind(filedesc4, (struct sockaddr*)&sockaddress4, sizeof(sockaddress4) ) == -1) {
     fprintf(stderr, "sckt4_listen: bind() error\n");
@@ -95,7 +129,7 @@ struct sockaddr_in sockaddress4;
   }
 
   /* start listening */
-  if (listen(filedesc4, BACKLOG) == -1) {
+  if (listen(filedesc4, in_backlog) == -1) {
     fprintf(stderr, "sckt4_listen: listen() error\n");
     close(filedesc4);
     return(-1);
@@ -111,10 +145,14 @@ struct sockaddr_in sockaddress4;
 int
 sckt6_listen(
  const char in_ipv6_addr[],
- unsigned short in_port)
+ unsigned short in_port,
+ int in_backlog)
 {
 int filedesc6 = 0;
 int v6only = 1;
+#ifdef SO_REUSEPORT
+int reuse = 1;
+#endif
 int fcntl_flags = 0;
 struct sockaddr_in6 sockaddress6;
 
@@ -149,6 +187,15 @@ struct sockaddr_in6 sockaddress6;
     return(-1);
   }
 
+#ifdef SO_REUSEPORT
+  /* one socket per worker, as for IPv4 */
+  if (setsockopt(filedesc6, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(int)) != 0) {
+    fprintf(stderr, "sckt6_listen: setsockopt() error SO_REUSEPORT\n");
+    close(filedesc6);
+    return(-1);
+  }
+#endif
+
   /* bind IPv6 */
   if (bind(filedesc6, (struct sockaddr*)&sockaddress6, sizeof(sockaddress6) ) == -1) {
     fprintf(stderr, "sckt6_listen: bind() error\n");
@@ -157,7 +204,7 @@ struct sockaddr_in6 sockaddress6;
   }
 
   /* start listening */
-  if (listen(filedesc6, BACKLOG) == -1) {
+  if (listen(filedesc6, in_backlog) == -1) {
     fprintf(stderr, "sckt6_listen: listen() error\n");
     close(filedesc6);
     return(-1);
@@ -177,12 +224,31 @@ sckt_accept(
 struct sockaddr_storage sas;
 socklen_t sl_size = 0;
 int acpt_fd = 0;
+int fcntl_flags = 0;
+int e = 0;
 
   sl_size = sizeof(struct sockaddr_storage);
   acpt_fd = accept(in_fd, (struct sockaddr*)&sas, &sl_size);
   if (acpt_fd == -1) {
-    fprintf(stderr, "sckt_acpt: accept() error\n");
+    /* errno is kept for the caller */
+    /*  the listen queue found empty, or the client gone, is not logged */
+    e = errno;
+    if ((e != EAGAIN) && (e != EWOULDBLOCK) && (e != ECONNABORTED) && (e != EINTR)) {
+      fprintf(stderr, "sckt_acpt: accept() error\n");
+    }
+    errno = e;
+    return(acpt_fd);
+  }
+
+  /* make non-blocking, BSDs inherit it from the listen socket */
+  /*  but Linux does not */
+  fcntl_flags = fcntl(acpt_fd, F_GETFL, 0);
+  if (fcntl(acpt_fd, F_SETFL, fcntl_flags | O_NONBLOCK) == -1) {
+    fprintf(stderr, "sckt_acpt: fnctl() O_NONBLOCK error\n");
+    close(acpt_fd);
+    return(-1);
   }
+
   return(acpt_fd);
 }
 
@@ -218,6 +284,84 @@ ssize_t nw = 0;
   return(nw);
 }
 
+
+/*****************/
+/* sckt_writev() */
+/*****************/
+/* gather write, so a head and a body need not be copied together */
+ssize_t
+sckt_writev(
+ int in_fd,
+ const struct iovec *in_iov,
+ int in_count)
+{
+ssize_t nw = 0;
+
+  nw = writev(in_fd, in_iov, in_count);
+  return(nw);
+}
+
+/********************/
+/* sckt_keepalive() */
+/********************/
+/* have the kernel find a peer that is gone without a word, */
+/*  within about in_dead_ms, by keepalive probes when nothing is sent */
+/*  and by giving up on data unacknowledged that long */
+/*  the timings are set where the system allows it per socket, */
+/*  the BSDs only have system wide ones */
+/* return: 0 on success, -1 error */
+int
+sckt_keepalive(
+ int in_fd,
+ unsigned int in_dead_ms)
+{
+int on = 1;
+int v = 0;
+
+  if (setsockopt(in_fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(int)) != 0) {
+    fprintf(stderr, "sckt_keepalive: setsockopt() error SO_KEEPALIVE\n");
+    return(-1);
+  }
+
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+  /* half the time idle, then three probes */
+  v = (in_dead_ms / 2000 > 0) ? in_dead_ms / 2000 : 1;
+  setsockopt(in_fd, IPPROTO_TCP, TCP_KEEPIDLE, &v, sizeof(int));
+  v = (in_dead_ms / 6000 > 0) ? in_dead_ms / 6000 : 1;
+  setsockopt(in_fd, IPPROTO_TCP, TCP_KEEPINTVL, &v, sizeof(int));
+  v = 3;
+  setsockopt(in_fd, IPPROTO_TCP, TCP_KEEPCNT, &v, sizeof(int));
+#endif
+
+#ifdef TCP_USER_TIMEOUT
+  v = in_dead_ms;
+  setsockopt(in_fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &v, sizeof(int));
+#endif
+
+  return(0);
+}
+
+
+/*****************/
+/* sckt_sndbuf() */
+/*****************/
+/* limit the kernel's send buffer for in_fd to about in_size bytes, */
+/*  instead of what it would grow to */
+/* return: 0 on success, -1 error */
+int
+sckt_sndbuf(
+ int in_fd,
+ int in_size)
+{
+  if (setsockopt(in_fd, SOL_SOCKET, SO_SNDBUF, &in_size, sizeof(int)) != 0) {
+    fprintf(stderr, "sckt_sndbuf: setsockopt() error SO_SNDBUF\n");
+    return(-1);
+  }
+
+  return(0);
+}
+
+
 /****************/
 /* sckt_close() */
 /****************/
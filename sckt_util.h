@@ -21,15 +21,20 @@
 
 #include <sys/types.h>
 #include <unistd.h>
+#include <sys/uio.h>
 
 /* for sckt_listen functions, the in_ipvN_addr is passed to inet_pton */
 /*  valid forms vary by architecture */
 /* typical: "127.0.0.1" and "0.0.0.0" work for IPv4 */
 /*  and "::1" and "::0" work for IPv6 */
+/* in_backlog is the most connections waiting to be accepted, */
+/*  the kernel may lower it (somaxconn on Linux, kern.somaxconn on BSD) */
 
-int sckt4_listen(const char in_ipv4_addr[], unsigned short in_port);
+int sckt_reuseport(void);
 
-int sckt6_listen(const char in_ipv6_addr[], unsigned short in_port);
+int sckt4_listen(const char in_ipv4_addr[], unsigned short in_port, int in_backlog);
+
+int sckt6_listen(const char in_ipv6_addr[], unsigned short in_port, int in_backlog);
 
 int sckt_accept(int in_fd);
 
@@ -37,6 +42,12 @@ ssize_t sckt_read(int in_fd, char *buf, size_t size);
 
 ssize_t sckt_write(int in_fd, const char *buf, size_t size);
 
+ssize_t sckt_writev(int in_fd, const struct iovec *in_iov, int in_count);
+
+int sckt_keepalive(int in_fd, unsigned int in_dead_ms);
+
+int sckt_sndbuf(int in_fd, int in_size);
+
 void sckt_close(int in_fd);
 
 #endif
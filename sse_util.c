@@ -24,12 +24,17 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 
 /* POSIX headers */
 
 /* local headers */
 #include "sse_util.h"
 #include "sckt_util.h"
+#include "conn_util.h"
+#include "evnt_util.h"
+#include "evnt_bknd.h"
 
 /*
 This code module will handle sending a message "Data" at a set of open connections
@@ -40,46 +45,449 @@ The code will keep track of the file descriptors for each listening connection
 /*
 functions to:
 - initialize
-- create an eventsource descriptor
-- add a socket to an eventsource
-- send a data string to sockets of the eventsource
-- remove a socket from eventsource
+- open a named topic, and find one by name
+- subscribe a socket to a topic, one socket may have several
+- send a data string to sockets subscribed to the topic
+- send an event, with an id, and keep it for listeners that reconnect
+- replay what a reconnecting listener missed, from its Last-Event-ID
+- remove a socket from all its topics
+- keep idle listeners alive with heartbeats, and reap dead ones
+- park a long-poll request until the topic's next event
 */
 
+/* each topic has a list of its subscriptions, and each connection */
+/*  a list of its own, so a send costs only the topic's subscribers */
+/*  and unsubscribing one is unlinking it, at no search */
+
 /* preprocessor definitions */
-#define MAX_SOCKETS 32 
+/* topics per worker, descriptor 0 is none */
+#ifndef SSE_TOPICS
+#define SSE_TOPICS 16
+#endif
+#define SSE_NAMESIZE 32
+
+/* events kept by each topic for replay to listeners that reconnect */
+#ifndef SSE_RING
+#define SSE_RING 64
+#endif
+
+/* milliseconds a listener may go without a frame, before it is sent */
+/*  a heartbeat, a comment line that browsers ignore */
+#ifndef SSE_HEARTBEAT
+#define SSE_HEARTBEAT 15000
+#endif
+
+/* milliseconds a listener may leave its frames untaken by the socket, */
+/*  or unacknowledged by its peer, before it is taken for dead */
+#ifndef SSE_DEADTIME
+#define SSE_DEADTIME 45000
+#endif
+
+/* milliseconds a listener is told to wait before it reconnects, */
+/*  each its own, from SSE_RETRY to twice that, */
+/*  so after a restart they do not all come back at once */
+#ifndef SSE_RETRY
+#define SSE_RETRY 3000
+#endif
+
+/* milliseconds a long-poll request is parked, at most, */
+/*  before it is told nothing changed, under common proxy timeouts */
+#ifndef SSE_WAIT
+#define SSE_WAIT 25000
+#endif
+
+/* bytes the kernel may hold for a listener, frames are small */
+/*  and a dead one's backlog then waits here, where it is seen */
+#ifndef SSE_SNDBUF
+#define SSE_SNDBUF 16384
+#endif
 
 /* structures */
 
-/* maps listen sockets to eventsource descriptors */
-struct socket_sse_map_struct {
- int count;
- int socket[MAX_SOCKETS];
- int sse[MAX_SOCKETS];
-} socket_sse_map;
+/* a frame of an event */
+/*  serialized once and shared, by reference, by every listener */
+struct sse_frame_struct {
+ unsigned int refs;
+ unsigned long version;
+ unsigned long long id; /* event id, 0 for none */
+ size_t len;
+ char data[];
+};
+
+/* topics and their listeners are per worker thread */
+
+/* one connection subscribed to one topic */
+/*  on both the topic's list and the connection's */
+struct sse_sub_struct {
+ struct sse_topic_struct *topic;
+ struct conn_struct *conn;
+ struct sse_sub_struct *prev;      /* on the topic's list */
+ struct sse_sub_struct *next;
+ struct sse_sub_struct *conn_next; /* on the connection's list */
+ unsigned long version;            /* newest frame of the topic started */
+ int once;                         /* a long-poll request, answered once */
+ unsigned long long since;         /* and the newest event its client has */
+};
+
+/* topics opened by sse_open(), indexed by descriptor */
+struct sse_topic_struct {
+ int open;
+ int mode;
+ char name[SSE_NAMESIZE];
+ struct sse_sub_struct *subs;     /* its subscriptions */
+ unsigned int count;
+ struct sse_sub_struct *waits;    /* its parked long-poll requests */
+ unsigned long version;           /* of newest frame */
+ struct sse_frame_struct *latest; /* newest frame, SSE_LATEST only */
+ struct sse_frame_struct *ring[SSE_RING]; /* newest events, by id */
+ unsigned int ring_first;         /* index of the oldest */
+ unsigned int ring_count;
+ unsigned long long ring_floor;   /* every event after this id is kept */
+};
+static EVNT_LOCAL struct sse_topic_struct sse_topic_tab[SSE_TOPICS];
+
+/* event ids are one sequence for the whole server, */
+/*  so every worker's copy of an event has the same id */
+/*  and a listener may reconnect to any worker */
+/*  they start from the time the server started, shifted up, */
+/*  so ids of a server that restarted are above the old ones */
+static unsigned long long sse_id = 0;
+
+/* listeners reaped as dead, over all workers, */
+/*  and how long they had been silent, in milliseconds */
+static unsigned long sse_reaped = 0;
+static unsigned long sse_reaped_ms = 0;
+static unsigned long sse_reaped_max = 0;
+
+/* per worker, for the jitter of each listener's retry */
+static EVNT_LOCAL unsigned int sse_seed = 0;
+
+
+/*****************/
+/* frame_unref() */
+/*****************/
+static void
+frame_unref(
+ struct sse_frame_struct *f)
+{
+  if (f == NULL) return;
+  f->refs -= 1;
+  if (f->refs == 0) free(f);
+}
+
+
+/***************/
+/* frame_new() */
+/***************/
+/* return: frame of in_len bytes of in_data, one reference, NULL on error */
+static struct sse_frame_struct *
+frame_new(
+ const char *in_data,
+ size_t in_len)
+{
+struct sse_frame_struct *f = NULL;
+
+  f = malloc(sizeof(struct sse_frame_struct) + in_len);
+  if (f == NULL) {
+    fprintf(stderr, "frame_new: malloc() error\n");
+    return(NULL);
+  }
+  f->refs = 1;
+  f->version = 0;
+  f->id = 0;
+  f->len = in_len;
+  memcpy(f->data, in_data, in_len);
+
+  return(f);
+}
+
+
+/***************/
+/* ring_push() */
+/***************/
+/* keep frame f as topic t's newest event, dropping the oldest */
+static void
+ring_push(
+ struct sse_topic_struct *t,
+ struct sse_frame_struct *f)
+{
+struct sse_frame_struct *old = NULL;
+
+  if (t->ring_count == SSE_RING) {
+    old = t->ring[t->ring_first];
+    t->ring_floor = old->id;
+    frame_unref(old);
+    t->ring_first = (t->ring_first + 1) % SSE_RING;
+    t->ring_count -= 1;
+  }
+  f->refs += 1;
+  t->ring[(t->ring_first + t->ring_count) % SSE_RING] = f;
+  t->ring_count += 1;
+}
+
+
+/***************/
+/* ring_last() */
+/***************/
+/* return: id of topic t's newest event, its floor when none are kept */
+static unsigned long long
+ring_last(
+ struct sse_topic_struct *t)
+{
+  if (t->ring_count == 0) {
+    return(t->ring_floor);
+  }
+
+  return(t->ring[(t->ring_first + t->ring_count - 1) % SSE_RING]->id);
+}
+
+
+/*****************/
+/* sse_pending() */
+/*****************/
+/* return: 1 when c has output the socket has not yet taken, 0 not */
+static int
+sse_pending(
+ struct conn_struct *c)
+{
+  return((c->sse_frame != NULL) || (c->out_off < c->out_len) || (c->flags & CONN_F_RING));
+}
+
+
+/**************/
+/* sse_sent() */
+/**************/
+/* a frame is about to go to c, at timer clock in_now */
+static void
+sse_sent(
+ struct conn_struct *c,
+ unsigned long in_now)
+{
+  /* with nothing waiting, all before was taken */
+  if (!sse_pending(c)) c->sse_live = in_now;
+  c->sse_last = in_now;
+}
 
 
 /****************/
-/* sse_unique() */
+/* reap_count() */
 /****************/
+/* count c as a listener found dead at timer clock in_now, */
+/*  by error in_errno, 0 for output untaken too long */
+/*  a peer that reset or closed its end is not dead, only gone */
+static void
+reap_count(
+ struct conn_struct *c,
+ unsigned long in_now,
+ int in_errno)
+{
+unsigned long ms = in_now - c->sse_live;
+unsigned long max = 0;
+
+  if ((in_errno == ECONNRESET) || (in_errno == EPIPE)) {
+    return;
+  }
+  /* the kernel gave up on it, after SSE_DEADTIME unacknowledged */
+  if ((in_errno == ETIMEDOUT) && (ms < SSE_DEADTIME)) {
+    ms = SSE_DEADTIME;
+  }
+
+  __atomic_add_fetch(&sse_reaped, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&sse_reaped_ms, ms, __ATOMIC_RELAXED);
+  max = __atomic_load_n(&sse_reaped_max, __ATOMIC_RELAXED);
+  while ((ms > max) && !__atomic_compare_exchange_n(&sse_reaped_max, &max, ms,
+   0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  fprintf(stderr, "sse_reap: listener %d dead, silent %lu ms\n", c->fd, ms);
+}
+
+
+/***************/
+/* sse_start() */
+/***************/
+/* begin sending shared frame f of subscription sub to its listener, */
+/*  which is idle, what the socket does not take now */
+/*  is sent by sse_pump() later */
+/* return: 0 sent, 1 part sent, -1 connection dropped */
 static int
-sse_unique(void){
-int i;
-int cand = 0;
-int present = 0;
-
-  do {
-    cand += 1;
-    present = 0;
-    for (i = 0; i < socket_sse_map.count; i++) {
-      if (socket_sse_map.sse[i] == cand) {
-        present = -1;
-        break;
+sse_start(
+ struct sse_sub_struct *sub,
+ struct sse_frame_struct *f)
+{
+struct conn_struct *c = sub->conn;
+ssize_t nw = 0;
+
+  sub->version = f->version;
+  sse_sent(c, evnt_timer_now());
+
+  /* with io_uring the send is only queued, so every listener's send */
+  /*  of this frame reaches the kernel together, in one submission */
+  /*  and the frame is held until sse_done() */
+  if (bknd_send(c->fd, f->data, f->len) == 0) {
+    f->refs += 1;
+    c->sse_frame = f;
+    c->sse_sent = 0;
+    c->flags |= CONN_F_RING;
+    return(1);
+  }
+
+  nw = sckt_write(c->fd, f->data, f->len);
+  if (nw == (-1)) {
+    if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+      sse_reap(c->fd, errno);
+      return(-1);
+    }
+    nw = 0;
+  }
+  if (nw == f->len) {
+    return(0);
+  }
+
+  /* hold a reference, not a copy */
+  f->refs += 1;
+  c->sse_frame = f;
+  c->sse_sent = nw;
+  evnt_wait_write(c->fd);
+
+  return(1);
+}
+
+
+/***************/
+/* topic_get() */
+/***************/
+/* return: the open topic of descriptor in_topic, NULL if none */
+static struct sse_topic_struct *
+topic_get(
+ int in_topic)
+{
+  if ((in_topic <= 0) || (in_topic >= SSE_TOPICS) || !sse_topic_tab[in_topic].open) {
+    return(NULL);
+  }
+
+  return(&(sse_topic_tab[in_topic]));
+}
+
+
+/*****************/
+/* wait_answer() */
+/*****************/
+/* answer c's parked long-poll request with in_len bytes of in_resp, */
+/*  or, with NULL, that nothing changed, and let it go, */
+/*  its connection waits for the next request, */
+/*  or is closed once answered if the request was its last */
+static void
+wait_answer(
+ struct conn_struct *c,
+ const char *in_resp,
+ size_t in_len)
+{
+char none[] = "HTTP/1.1 204 No Content\r\nCache-Control: no-store\r\n\r\n";
+int fd = c->fd;
+
+  sse_rem(fd);
+  if (in_resp == NULL) {
+    evnt_send(fd, none, strlen(none));
+  } else {
+    evnt_send(fd, in_resp, in_len);
+  }
+  evnt_resume(fd);
+}
+
+
+/******************/
+/* wait_release() */
+/******************/
+/* answer every long-poll request parked on topic t with frame f, */
+/*  unless its client already has f, */
+/*  in one pass, the response made once for all of them */
+static void
+wait_release(
+ struct sse_topic_struct *t,
+ struct sse_frame_struct *f)
+{
+struct sse_sub_struct *sub = NULL;
+struct sse_sub_struct *next = NULL;
+char *resp = NULL;
+int len = 0;
+
+  if (t->waits == NULL) {
+    return;
+  }
+
+  resp = malloc(f->len + 128);
+  if (resp == NULL) {
+    fprintf(stderr, "wait_release: malloc() error\n");
+    return;
+  }
+  len = snprintf(resp, 128, "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nCache-Control: no-store\r\n"
+   "Content-Length: %lu\r\n\r\n", (unsigned long)f->len);
+  memcpy(&(resp[len]), f->data, f->len);
+  len += f->len;
+
+  for (sub = t->waits; sub != NULL; sub = next) {
+    next = sub->next;
+    if (sub->conn->flags & CONN_F_DEAD) continue;
+    /* parked on a worker this event had not yet reached, */
+    /*  by a client that has it from another */
+    if (sub->since >= f->id) continue;
+    wait_answer(sub->conn, resp, len);
+  }
+
+  free(resp);
+}
+
+
+/**************/
+/* sse_beat() */
+/**************/
+/* timer callback, a listener's heartbeat is due */
+/*  a listener idle for SSE_HEARTBEAT is sent a comment, */
+/*  so its peer, and anything between, sees the stream is alive */
+/*  and the write finds a peer that is not */
+/*  one whose output has waited SSE_DEADTIME is reaped */
+static void
+sse_beat(
+ void *in_arg)
+{
+struct conn_struct *c = in_arg;
+unsigned long now = 0;
+unsigned long idle = 0;
+int e = 0;
+
+  if (c->flags & CONN_F_DEAD) {
+    return;
+  }
+
+  /* a parked long-poll request waited long enough */
+  if (c->sse_sub->once) {
+    wait_answer(c, NULL, 0);
+    return;
+  }
+
+  now = evnt_timer_now();
+
+  if (sse_pending(c)) {
+    if (now - c->sse_live >= SSE_DEADTIME) {
+      sse_reap(c->fd, 0);
+      return;
+    }
+  } else {
+    c->sse_live = now;
+    if (now - c->sse_last >= SSE_HEARTBEAT) {
+      c->sse_last = now;
+      if (evnt_send(c->fd, ":\n\n", 3) == (-1)) {
+        /* dropped, counted only if by a failed write */
+        e = evnt_error(c->fd);
+        if (e != 0) reap_count(c, now, e);
+        return;
       }
     }
-  } while (present == -1);
+  }
 
-  return(cand);
+  /* again when it will have been idle long enough */
+  idle = now - c->sse_last;
+  evnt_timer_add(&(c->timer), (idle < SSE_HEARTBEAT) ? SSE_HEARTBEAT - idle : SSE_HEARTBEAT);
 }
 
 
@@ -90,108 +498,414 @@ int present = 0;
 int
 sse_init(void)
 {
-  socket_sse_map.count = 0;
+unsigned long long none = 0;
+int i = 0;
+
+  memset(sse_topic_tab, 0, sizeof(sse_topic_tab));
+  for (i = 0; i < SSE_TOPICS; i++) {
+    sse_topic_tab[i].mode = SSE_QUEUE;
+  }
+
+  sse_seed = (unsigned int)time(NULL) ^ (unsigned int)(unsigned long)&sse_seed;
+  if (sse_seed == 0) sse_seed = 1;
+
+  /* the first worker starts the sequence */
+  __atomic_compare_exchange_n(&sse_id, &none, (unsigned long long)time(NULL) << 20,
+   0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
 
   return(0);
 }
 
 
+/**************/
+/* sse_open() */
+/**************/
+/* create topic in_name, with no subscribers yet */
+/*  SSE_QUEUE sends every message to every listener, */
+/*  SSE_LATEST only guarantees each listener the newest message */
+/* return: descriptor of new topic, -1 on error */
+int
+sse_open(
+ const char *in_name,
+ int in_mode)
+{
+struct sse_topic_struct *t = NULL;
+int d = 0;
+
+  if ((strlen(in_name) == 0) || (strlen(in_name) >= SSE_NAMESIZE) ||
+   (sse_topic(in_name, strlen(in_name)) != (-1))) {
+    fprintf(stderr, "sse_open: topic name invalid or in use, %s\n", in_name);
+    return(-1);
+  }
+
+  for (d = 1; (d < SSE_TOPICS) && sse_topic_tab[d].open; d++);
+  if (d >= SSE_TOPICS) {
+    fprintf(stderr, "sse_open: exceeded maximum number of topics\n");
+    return(-1);
+  }
+
+  t = &(sse_topic_tab[d]);
+  memset(t, 0, sizeof(*t));
+  t->open = 1;
+  t->mode = in_mode;
+  strcpy(t->name, in_name);
+  /* events from before it opened are not kept */
+  t->ring_floor = __atomic_load_n(&sse_id, __ATOMIC_RELAXED);
+
+  return(d);
+}
+
+
+/***************/
+/* sse_topic() */
+/***************/
+/* find topic in_name, of in_len bytes, not NULL terminated */
+/*  a handful of topics, looked for in turn */
+/* return: its descriptor, -1 if none */
+int
+sse_topic(
+ const char *in_name,
+ unsigned int in_len)
+{
+int d = 0;
+
+  for (d = 1; d < SSE_TOPICS; d++) {
+    if (sse_topic_tab[d].open && (strlen(sse_topic_tab[d].name) == in_len) &&
+     (memcmp(sse_topic_tab[d].name, in_name, in_len) == 0)) {
+      return(d);
+    }
+  }
+
+  return(-1);
+}
+
+
 /*************/
-/* sse_new() */
+/* sub_add() */
 /*************/
-/* takes a socket descriptor and starts a new sse */
-/* return: descriptor of new eventsource, -1 on error */
-int
-sse_new(
- int in_socket)
+/* subscribe c to topic t, a listener, or with in_once a long-poll */
+/*  request, each on its own list of the topic */
+/* return: 0 on success, -1 on error */
+static int
+sub_add(
+ struct sse_topic_struct *t,
+ struct conn_struct *c,
+ int in_once)
 {
-int i = 0;
+struct sse_sub_struct *sub = NULL;
+struct sse_sub_struct **head = NULL;
+
+  if (c->sse_sub == NULL) {
+    /* a new listener, its timer is from now on the heartbeat's */
+    /*  and the kernel watches for its peer going away */
+    evnt_timer_cancel(&(c->timer));
+    evnt_timer_init(&(c->timer), sse_beat, c);
+    evnt_timer_add(&(c->timer), in_once ? SSE_WAIT : SSE_HEARTBEAT);
+    c->sse_last = evnt_timer_now();
+    c->sse_live = c->sse_last;
+    sckt_keepalive(c->fd, SSE_DEADTIME);
+    sckt_sndbuf(c->fd, SSE_SNDBUF);
+  }
 
-  /* sanity checks */
-  i = socket_sse_map.count;
-  if (i >= MAX_SOCKETS) {
-    fprintf(stderr, "sse_new: exceeded maximum number of sockets\n");
-    /* make no changes */
+  sub = malloc(sizeof(struct sse_sub_struct));
+  if (sub == NULL) {
+    fprintf(stderr, "sub_add: malloc() error\n");
     return(-1);
   }
+  sub->topic = t;
+  sub->conn = c;
+  sub->version = t->version;
+  sub->once = in_once;
+  sub->since = 0;
 
-  socket_sse_map.socket[i] = in_socket;
-  socket_sse_map.sse[i] = sse_unique();
+  if (in_once) c->flags |= CONN_F_WAIT;
 
-  /* increment counters */
-  socket_sse_map.count += 1;
+  head = in_once ? &(t->waits) : &(t->subs);
+  sub->prev = NULL;
+  sub->next = *head;
+  if (*head != NULL) (*head)->prev = sub;
+  *head = sub;
+  t->count += 1;
 
-  return(socket_sse_map.sse[i]);
+  sub->conn_next = c->sse_sub;
+  c->sse_sub = sub;
+
+  return(0);
 }
 
 
 /*************/
-/* sse_add() */
+/* sse_sub() */
 /*************/
-/* takes a socket descriptor, and a previously made sse (by sse_new) */
-/* and associates socket to sse */
-/* return: 0 on success, -1 on error (exceed max list size) */
+/* subscribe in_socket to topic in_topic, once however often asked */
+/*  a new listener is sent the current state by its caller, */
+/*  so is up to date with the topic's newest frame */
+/* return: 0 on success, -1 on error */
 int
-sse_add(
- int in_sse_descriptor,
+sse_sub(
+ int in_topic,
  int in_socket)
 {
-int i = 0; 
+struct sse_topic_struct *t = NULL;
+struct sse_sub_struct *sub = NULL;
+struct conn_struct *c = NULL;
 
-  i = socket_sse_map.count;
-  if (i >= MAX_SOCKETS) {
-    fprintf(stderr, "sse_add: exceeded maximum number of sockets\n");
+  t = topic_get(in_topic);
+  c = conn_get(in_socket);
+  if ((t == NULL) || (c == NULL)) {
+    fprintf(stderr, "sse_sub: topic or socket not found\n");
     return(-1);
   }
 
-  socket_sse_map.socket[i] = in_socket;
-  socket_sse_map.sse[i] = in_sse_descriptor;
-
-  /* increment counter */
-  socket_sse_map.count += 1;
+  for (sub = c->sse_sub; sub != NULL; sub = sub->conn_next) {
+    if (sub->topic == t) return(0);
+  }
 
-  return(0);
+  return(sub_add(t, c, 0));
 }
 
 
 /*************/
 /* sse_rem() */
 /*************/
-/* takes a socket descriptor and removes it from the map */
-/* (searches the map for that socket) */
-/* return: 0 on success, -1 on error (not found) */
+/* takes a socket descriptor and removes it from all its topics */
+/*  each subscription is unlinked where it is, with no search */
+/* return: 0 on success, -1 on error (not a listener) */
 int
 sse_rem(
  int in_socket)
 {
-int oldcount = 0;
-int i = 0;
+struct conn_struct *c = NULL;
+struct sse_sub_struct *sub = NULL;
+struct sse_sub_struct *next = NULL;
 
-  oldcount = socket_sse_map.count;
+  c = conn_get(in_socket);
+  if ((c == NULL) || (c->sse_sub == NULL)) {
+    /* socket to remove not found, caller may have been fishing */
+    return(-1);
+  }
 
-  for (i = 0; i < oldcount; i++) {
-    if (socket_sse_map.socket[i] == in_socket) break;
+  for (sub = c->sse_sub; sub != NULL; sub = next) {
+    next = sub->conn_next;
+    if (sub->prev != NULL) sub->prev->next = sub->next;
+    else if (sub->once) sub->topic->waits = sub->next;
+    else sub->topic->subs = sub->next;
+    if (sub->next != NULL) sub->next->prev = sub->prev;
+    sub->topic->count -= 1;
+    free(sub);
   }
-  if (i >= oldcount) {
-    /* socket to remove not found, caller may have been fishing */
+  c->sse_sub = NULL;
+  c->flags &= ~CONN_F_WAIT;
+
+  frame_unref(c->sse_frame);
+  c->sse_frame = NULL;
+
+  return(0);
+}
+
+
+/**************/
+/* sse_reap() */
+/**************/
+/* a listener is found dead, by a read or write failing with in_errno, */
+/*  or, with 0, by output untaken too long, count it and drop it */
+/* return: 0 on success, -1 not found */
+int
+sse_reap(
+ int in_fd,
+ int in_errno)
+{
+struct conn_struct *c = NULL;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->flags & CONN_F_DEAD)) {
     return(-1);
   }
-  while (i < (oldcount-1)) {
-    socket_sse_map.socket[i] = socket_sse_map.socket[i+1];
-    socket_sse_map.sse[i]    = socket_sse_map.sse[i+1];
-    i++;
+
+  if (c->sse_sub != NULL) {
+    reap_count(c, evnt_timer_now(), in_errno);
+  }
+
+  return(evnt_drop(in_fd));
+}
+
+
+/***************/
+/* sse_stats() */
+/***************/
+/* listeners reaped as dead so far, over all workers, */
+/*  with the total and the longest time they had been silent */
+void
+sse_stats(
+ unsigned long *out_reaped,
+ unsigned long *out_ms,
+ unsigned long *out_max_ms)
+{
+  *out_reaped = __atomic_load_n(&sse_reaped, __ATOMIC_RELAXED);
+  *out_ms = __atomic_load_n(&sse_reaped_ms, __ATOMIC_RELAXED);
+  *out_max_ms = __atomic_load_n(&sse_reaped_max, __ATOMIC_RELAXED);
+}
+
+
+/**************/
+/* sse_pump() */
+/**************/
+/* socket is writable, continue a listener */
+/*  first the rest of the frame it is part way through, */
+/*  then, if in_next, the newest frame of each latest-value topic */
+/*  it has not been sent */
+/* return: 0 nothing more to send, 1 still sending, -1 dropped */
+int
+sse_pump(
+ int in_fd,
+ int in_next)
+{
+struct conn_struct *c = NULL;
+struct sse_frame_struct *f = NULL;
+struct sse_sub_struct *sub = NULL;
+struct sse_topic_struct *t = NULL;
+ssize_t nw = 0;
+int status = 0;
+
+  c = conn_get(in_fd);
+  if ((c == NULL) || (c->flags & CONN_F_DEAD)) {
+    return(-1);
+  }
+
+  /* a queued send is still with the kernel, sse_done() continues */
+  if (c->flags & CONN_F_RING) {
+    return(1);
+  }
+
+  f = c->sse_frame;
+  if (f != NULL) {
+    nw = sckt_write(in_fd, &(f->data[c->sse_sent]), f->len - c->sse_sent);
+    if (nw == (-1)) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+        sse_reap(in_fd, errno);
+        return(-1);
+      }
+      return(1);
+    }
+    c->sse_sent += nw;
+    if (c->sse_sent < f->len) {
+      return(1);
+    }
+    c->sse_frame = NULL;
+    c->sse_sent = 0;
+    frame_unref(f);
+  }
+
+  if (!in_next) {
+    return(0);
+  }
+
+  /* skip straight to the newest, however many were missed */
+  for (sub = c->sse_sub; sub != NULL; sub = sub->conn_next) {
+    t = sub->topic;
+    if (sub->once) continue;
+    if ((t->latest == NULL) || (t->latest->version <= sub->version)) continue;
+    status = sse_start(sub, t->latest);
+    if (status != 0) return(status);
   }
-  socket_sse_map.count -= 1;
 
   return(0);
 }
 
 
+/**************/
+/* sse_done() */
+/**************/
+/* a frame send queued by sse_start() completed, in_res is the bytes */
+/*  sent or -errno, continue as sse_pump() would */
+/* return: 0 nothing more to send, 1 still sending, -1 dropped */
+int
+sse_done(
+ int in_fd,
+ int in_res)
+{
+struct conn_struct *c = NULL;
+struct sse_frame_struct *f = NULL;
+
+  c = conn_get(in_fd);
+  if (c == NULL) {
+    return(-1);
+  }
+  c->flags &= ~CONN_F_RING;
+  if (c->flags & CONN_F_DEAD) {
+    return(-1);
+  }
+
+  if (in_res < 0) {
+    if ((in_res != -EAGAIN) && (in_res != -EWOULDBLOCK)) {
+      sse_reap(in_fd, -in_res);
+      return(-1);
+    }
+    in_res = 0;
+  }
+
+  f = c->sse_frame;
+  c->sse_sent += in_res;
+  if (c->sse_sent >= f->len) {
+    c->sse_frame = NULL;
+    c->sse_sent = 0;
+    frame_unref(f);
+  }
+
+  /* the rest of the frame, and anything queued meanwhile, */
+  /*  go out through the readiness path */
+  if ((c->sse_frame != NULL) || (c->out_off < c->out_len)) {
+    evnt_wait_write(in_fd);
+    return(1);
+  }
+
+  return(sse_pump(in_fd, 1));
+}
+
+
+/****************/
+/* sse_latest() */
+/****************/
+/* make frame f, and its reference, the newest of latest-value */
+/*  topic t, and start it to every idle subscriber */
+/* return: 0 on success, -1 a listener was dropped */
+static int
+sse_latest(
+ struct sse_topic_struct *t,
+ struct sse_frame_struct *f)
+{
+struct sse_sub_struct *sub = NULL;
+struct sse_sub_struct *next = NULL;
+struct conn_struct *c = NULL;
+int status = 0;
+
+  t->version += 1;
+  f->version = t->version;
+  frame_unref(t->latest);
+  t->latest = f;
+
+  wait_release(t, f);
+
+  for (sub = t->subs; sub != NULL; sub = next) {
+    next = sub->next;
+    c = sub->conn;
+    if (c->flags & CONN_F_DEAD) continue;
+    /* a listener still busy picks up the newest frame when done */
+    if ((c->sse_frame != NULL) || (c->out_off < c->out_len)) continue;
+    if (sse_start(sub, f) == (-1)) status = (-1);
+  }
+
+  return(status);
+}
+
+
 /**************/
 /* sse_send() */
 /**************/
-/* takes a sse_descriptor and a char array/string */
-/* sends string to all sockets listening on that sse */
+/* takes a topic descriptor and a char array/string */
+/* sends string to all sockets subscribed to that topic */
+/*  on an SSE_LATEST topic, a listener still sending */
+/*  an older frame skips to this one when it is done */
 /* if disconnect is TRUE(nonzero), will also disconnect all sockets */
 /* return: 0 on success */
 int
@@ -200,40 +914,369 @@ sse_send(
  const char *message,
  int disconnect)
 {
+struct sse_topic_struct *t = NULL;
+struct sse_frame_struct *f = NULL;
+struct sse_sub_struct *sub = NULL;
+unsigned long now = 0;
 int message_len = 0;
-int fd = 0;
 int send_status = 0;
-int count = 0;
-int i = 0;
+int e = 0;
+
+  t = topic_get(in_sse_descriptor);
+  if (t == NULL) {
+    return(-1);
+  }
 
   message_len = 0;
   if (message != NULL) {
     message_len = strlen(message);
   }
 
-  count = socket_sse_map.count;
+  if ((message_len > 0) && (t->mode == SSE_LATEST)) {
+    /* serialize once, into a frame that replaces the previous newest */
+    f = frame_new(message, message_len); /* the topic's own reference */
+    if (f == NULL) {
+      return(-1);
+    }
+    send_status = sse_latest(t, f);
+
+    message_len = 0;
+  }
+
+  if ((message_len > 0) && (t->waits != NULL)) {
+    f = frame_new(message, message_len);
+    if (f != NULL) {
+      wait_release(t, f);
+      frame_unref(f);
+    }
+  }
 
   if (message_len > 0) {
-    for (i = 0; i < count; i++) {
-      if (socket_sse_map.sse[i] == in_sse_descriptor) {
-        fd = socket_sse_map.socket[i];
-        send_status = sckt_write(fd, message, message_len);
+    now = evnt_timer_now();
+    for (sub = t->subs; sub != NULL; sub = sub->next) {
+      if (sub->conn->flags & CONN_F_DEAD) continue;
+      sse_sent(sub->conn, now);
+      /* never blocks, a slow client's frames are queued */
+      send_status = evnt_send(sub->conn->fd, message, message_len);
+      if (send_status == (-1)) {
+        e = evnt_error(sub->conn->fd);
+        if (e != 0) reap_count(sub->conn, now, e);
       }
     }
   }
 
   if (disconnect) {
-    /* in reverse order to minimize rearrangements */
-    for (i = count; i > 0; i--) {
-      if (socket_sse_map.sse[i-1] == in_sse_descriptor) {
-        fd = socket_sse_map.socket[i-1];
-        /* send disconnect to socket */
-        sckt_close(fd);
-        /* remove socket from map */
-        sse_rem(fd);
-      }
+    for (sub = t->subs; sub != NULL; sub = sub->next) {
+      /* closed, and removed from its topics, after this event */
+      evnt_drop(sub->conn->fd);
     }
   }
 
   return(send_status);
 }
+
+
+/***************/
+/* sse_retry() */
+/***************/
+/* for a new listener's retry: field */
+/* return: milliseconds it should wait before reconnecting, */
+/*  SSE_RETRY and a jitter up to as much again */
+unsigned int
+sse_retry(void)
+{
+unsigned int x = sse_seed;
+
+  /* xorshift, quick and good enough for spreading listeners */
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  sse_seed = x;
+
+  return(SSE_RETRY + x % (SSE_RETRY + 1));
+}
+
+
+/*****************/
+/* sse_next_id() */
+/*****************/
+/* reserve the next event id, for sse_event() */
+/*  called by whoever posts an event to every worker, */
+/*  under the lock that orders those posts, so ids rise in post order */
+/* return: the id */
+unsigned long long
+sse_next_id(void)
+{
+  return(__atomic_add_fetch(&sse_id, 1, __ATOMIC_RELAXED));
+}
+
+
+/***************/
+/* sse_event() */
+/***************/
+/* send an event with id in_id, of the topic's name as its type, */
+/*  and one line of in_data, to the subscribers of in_topic */
+/*  and keep it, for sse_replay() to listeners that reconnect */
+/* return: 0 on success, -1 error */
+int
+sse_event(
+ int in_topic,
+ unsigned long long in_id,
+ const char *in_data)
+{
+struct sse_topic_struct *t = NULL;
+struct sse_frame_struct *f = NULL;
+struct sse_sub_struct *sub = NULL;
+unsigned long now = 0;
+char message[512];
+int len = 0;
+int status = 0;
+int e = 0;
+
+  t = topic_get(in_topic);
+  if (t == NULL) {
+    return(-1);
+  }
+
+  len = snprintf(message, sizeof(message), "id: %llu\nevent: %s\ndata: %s\n\n", in_id, t->name, in_data);
+  if ((len < 0) || (len >= (int)sizeof(message))) {
+    fprintf(stderr, "sse_event: event too long\n");
+    return(-1);
+  }
+
+  f = frame_new(message, len);
+  if (f == NULL) {
+    return(-1);
+  }
+  f->id = in_id;
+  ring_push(t, f);
+
+  if (t->mode == SSE_LATEST) {
+    /* the reference from frame_new() passes to the topic */
+    return(sse_latest(t, f));
+  }
+
+  wait_release(t, f);
+
+  now = evnt_timer_now();
+  for (sub = t->subs; sub != NULL; sub = sub->next) {
+    if (sub->conn->flags & CONN_F_DEAD) continue;
+    sse_sent(sub->conn, now);
+    if (evnt_send(sub->conn->fd, f->data, f->len) == (-1)) {
+      /* dropped, by a failed write or a full queue, */
+      /*  only the first is a listener found dead */
+      e = evnt_error(sub->conn->fd);
+      if (e != 0) reap_count(sub->conn, now, e);
+      status = (-1);
+    }
+  }
+  frame_unref(f);
+
+  return(status);
+}
+
+
+/****************/
+/* sse_replay() */
+/****************/
+/* send in_socket, just subscribed to its topics, the events */
+/*  after in_last_id, the Last-Event-ID of a listener reconnecting */
+/*  those of all its topics, in id order, and all in one message */
+/* return: 0 sent, or none missed, */
+/*  -1 some are no longer kept, the caller sends the current state */
+int
+sse_replay(
+ int in_socket,
+ unsigned long long in_last_id)
+{
+struct conn_struct *c = NULL;
+struct sse_sub_struct *sub = NULL;
+struct sse_sub_struct *min = NULL;
+struct sse_topic_struct *t = NULL;
+struct sse_frame_struct *f = NULL;
+unsigned int pos[SSE_TOPICS];
+char *buf = NULL;
+size_t len = 0;
+unsigned int i = 0;
+int d = 0;
+
+  c = conn_get(in_socket);
+  if ((c == NULL) || (c->sse_sub == NULL)) {
+    return(-1);
+  }
+
+  /* each topic must still have every event after it, */
+  /*  an id it never reached is from another run of the server */
+  for (sub = c->sse_sub; sub != NULL; sub = sub->conn_next) {
+    t = sub->topic;
+    if ((in_last_id < t->ring_floor) || (in_last_id > __atomic_load_n(&sse_id, __ATOMIC_RELAXED))) {
+      return(-1);
+    }
+    d = t - sse_topic_tab;
+    pos[d] = t->ring_count;
+    for (i = 0; i < t->ring_count; i++) {
+      f = t->ring[(t->ring_first + i) % SSE_RING];
+      if (f->id > in_last_id) {
+        if (pos[d] == t->ring_count) pos[d] = i;
+        len += f->len;
+      }
+    }
+  }
+  if (len == 0) return(0);
+
+  buf = malloc(len);
+  if (buf == NULL) {
+    fprintf(stderr, "sse_replay: malloc() error\n");
+    return(-1);
+  }
+
+  /* each ring is in id order, merge them */
+  len = 0;
+  for (;;) {
+    min = NULL;
+    for (sub = c->sse_sub; sub != NULL; sub = sub->conn_next) {
+      t = sub->topic;
+      d = t - sse_topic_tab;
+      if (pos[d] >= t->ring_count) continue;
+      if ((min == NULL) || (t->ring[(t->ring_first + pos[d]) % SSE_RING]->id <
+       min->topic->ring[(min->topic->ring_first + pos[min->topic - sse_topic_tab]) % SSE_RING]->id)) {
+        min = sub;
+      }
+    }
+    if (min == NULL) break;
+    t = min->topic;
+    d = t - sse_topic_tab;
+    f = t->ring[(t->ring_first + pos[d]) % SSE_RING];
+    memcpy(&(buf[len]), f->data, f->len);
+    len += f->len;
+    pos[d] += 1;
+  }
+
+  evnt_send(in_socket, buf, len);
+  free(buf);
+
+  /* the newest frames are among them, they are not sent again */
+  for (sub = c->sse_sub; sub != NULL; sub = sub->conn_next) {
+    sub->version = sub->topic->version;
+  }
+
+  return(0);
+}
+
+
+/******************/
+/* sse_snapshot() */
+/******************/
+/* send in_socket the current state of topic in_topic, as in_data, */
+/*  instead of the events it missed, with the id of the newest event */
+/*  of any of its topics, to reconnect from */
+/* return: 0 on success, -1 error */
+int
+sse_snapshot(
+ int in_topic,
+ int in_socket,
+ const char *in_data)
+{
+struct sse_topic_struct *t = NULL;
+struct sse_sub_struct *sub = NULL;
+struct conn_struct *c = NULL;
+unsigned long long id = 0;
+char message[512];
+int len = 0;
+
+  t = topic_get(in_topic);
+  c = conn_get(in_socket);
+  if ((t == NULL) || (c == NULL)) {
+    return(-1);
+  }
+
+  for (sub = c->sse_sub; sub != NULL; sub = sub->conn_next) {
+    if (ring_last(sub->topic) > id) id = ring_last(sub->topic);
+  }
+
+  len = snprintf(message, sizeof(message), "id: %llu\nevent: %s\ndata: %s\n\n", id, t->name, in_data);
+  if ((len < 0) || (len >= (int)sizeof(message))) {
+    fprintf(stderr, "sse_snapshot: state too long\n");
+    return(-1);
+  }
+
+  return(evnt_send(in_socket, message, len));
+}
+
+
+/**************/
+/* sse_wait() */
+/**************/
+/* a long-poll request on in_socket, for topic in_topic, */
+/*  from a client that has seen events up to in_since */
+/*  with a newer event, or in_since not of this run of the server, */
+/*  it is answered now, with the current state in_data, */
+/*  otherwise it is parked until the topic's next event, */
+/*  or SSE_WAIT, on the topic's own list, answered in one pass */
+/* return: 0 answered, 1 parked, -1 error */
+int
+sse_wait(
+ int in_topic,
+ int in_socket,
+ unsigned long long in_since,
+ const char *in_data)
+{
+struct sse_topic_struct *t = NULL;
+struct conn_struct *c = NULL;
+unsigned long long id = 0;
+char message[512];
+char resp[640];
+int len = 0;
+
+  t = topic_get(in_topic);
+  c = conn_get(in_socket);
+  if ((t == NULL) || (c == NULL) || (c->sse_sub != NULL)) {
+    return(-1);
+  }
+
+  /* in_since may be ahead of this worker's ring, an event another */
+  /*  worker has sent may still be on its way here, the wait then */
+  /*  stays parked past it, see wait_release() */
+  id = ring_last(t);
+  if ((in_since >= id) && (in_since <= __atomic_load_n(&sse_id, __ATOMIC_RELAXED))) {
+    if (sub_add(t, c, 1) == (-1)) return(-1);
+    c->sse_sub->since = in_since;
+    return(1);
+  }
+
+  len = snprintf(message, sizeof(message), "id: %llu\nevent: %s\ndata: %s\n\n", id, t->name, in_data);
+  if ((len < 0) || (len >= (int)sizeof(message))) {
+    fprintf(stderr, "sse_wait: state too long\n");
+    return(-1);
+  }
+  len = snprintf(resp, sizeof(resp), "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nCache-Control: no-store\r\n"
+   "Content-Length: %d\r\n\r\n%s", len, message);
+  evnt_send(in_socket, resp, len);
+
+  return(0);
+}
+
+
+/*************/
+/* sse_end() */
+/*************/
+/* release what the topics still hold, after their listeners */
+/*  have been closed */
+void
+sse_end(void)
+{
+struct sse_topic_struct *t = NULL;
+int i = 0;
+
+  for (i = 0; i < SSE_TOPICS; i++) {
+    t = &(sse_topic_tab[i]);
+    frame_unref(t->latest);
+    t->latest = NULL;
+    while (t->ring_count > 0) {
+      frame_unref(t->ring[t->ring_first]);
+      t->ring_first = (t->ring_first + 1) % SSE_RING;
+      t->ring_count -= 1;
+    }
+    t->open = 0;
+  }
+}
@@ -19,14 +19,42 @@
 #ifndef sse_util_h
 #define sse_util_h
 
+/* topic modes */
+#define SSE_QUEUE  0 /* every message to every listener */
+#define SSE_LATEST 1 /* only the newest message matters */
+
 int sse_init(void);
 
-int sse_new(int in_socket);
+int sse_open(const char *in_name, int in_mode);
+
+int sse_topic(const char *in_name, unsigned int in_len);
 
-int sse_add(int in_sse_descriptor, int in_socket);
+int sse_sub(int in_topic, int in_socket);
 
 int sse_rem(int in_socket);
 
+int sse_reap(int in_fd, int in_errno);
+
+void sse_stats(unsigned long *out_reaped, unsigned long *out_ms, unsigned long *out_max_ms);
+
 int sse_send(int in_sse_descriptor, const char *data, int disconnect);
 
+unsigned int sse_retry(void);
+
+unsigned long long sse_next_id(void);
+
+int sse_event(int in_topic, unsigned long long in_id, const char *in_data);
+
+int sse_replay(int in_socket, unsigned long long in_last_id);
+
+int sse_snapshot(int in_topic, int in_socket, const char *in_data);
+
+int sse_wait(int in_topic, int in_socket, unsigned long long in_since, const char *in_data);
+
+int sse_pump(int in_fd, int in_next);
+
+int sse_done(int in_fd, int in_res);
+
+void sse_end(void);
+
 #endif
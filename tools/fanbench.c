@@ -0,0 +1,302 @@
+/* fanbench.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* SSE broadcast latency, from a NEXT press to every listener */
+/*  opens -n listeners of the "freq" topic, timing how fast they are */
+/*  accepted, then presses NEXT -r times, one after the other, */
+/*  timing how long the press takes to reach the first listener, */
+/*  and the last, run it against tunerd with -w 1, 2, 4, 8 */
+/*  with -P and tunerd's process id, on Linux, also the read and write */
+/*  system calls and CPU time tunerd took for the presses, */
+/*  to set the io_uring backend against epoll */
+/* usage: fanbench [-h host] [-p port] [-n listeners] [-r presses] [-P pid] */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/* POSIX headers */
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+/* Local headers */
+#include "load_util.h"
+
+/* Macros */
+/* milliseconds to wait for every listener to hear a press */
+#ifndef FANWAIT
+#define FANWAIT 5000
+#endif
+
+/* File scope variables */
+/* External variables */
+/* External functions */
+/* Structures and unions */
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/****************/
+/* proc_count() */
+/****************/
+/* tunerd's system calls that read and write, as the kernel counts */
+/*  them, and CPU time, in clock ticks, over all its threads */
+/*  io_uring operations are not system calls and are not counted */
+/* return: 0 on success, -1 not known (not Linux, or no such process) */
+static int
+proc_count(
+ long in_pid,
+ unsigned long long *out_syscr,
+ unsigned long long *out_syscw,
+ unsigned long long *out_ticks)
+{
+FILE *fp = NULL;
+char path[64];
+char line[512];
+char *p = NULL;
+unsigned long utime = 0;
+unsigned long stime = 0;
+int found = 0;
+
+  snprintf(path, sizeof(path), "/proc/%ld/io", in_pid);
+  fp = fopen(path, "r");
+  if (fp == NULL) return(-1);
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (sscanf(line, "syscr: %llu", out_syscr) == 1) found += 1;
+    if (sscanf(line, "syscw: %llu", out_syscw) == 1) found += 1;
+  }
+  fclose(fp);
+
+  /* utime and stime are fields 14 and 15, after the command in () */
+  snprintf(path, sizeof(path), "/proc/%ld/stat", in_pid);
+  fp = fopen(path, "r");
+  if (fp == NULL) return(-1);
+  if (fgets(line, sizeof(line), fp) == NULL) line[0] = '\0';
+  fclose(fp);
+  p = strrchr(line, ')');
+  if ((p != NULL) && (sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+   &utime, &stime) == 2)) {
+    *out_ticks = utime + stime;
+    found += 1;
+  }
+
+  return((found == 3) ? 0 : (-1));
+}
+
+
+/***********/
+/* press() */
+/***********/
+/* POST NEXT on a connection of its own, as a browser's button does */
+/* return: 0 answered, -1 not */
+static int
+press(
+ const char *in_host,
+ int in_port,
+ unsigned int in_index)
+{
+const char req[] = "POST /radio_preset HTTP/1.1\r\nConnection: close\r\n"
+ "Content-Length: 11\r\n\r\npreset=next";
+char buf[1024];
+int fd = 0;
+int status = 0;
+
+  fd = load_connect(in_host, in_port, in_index, 0);
+  if (fd == (-1)) return(-1);
+  status = (load_send(fd, req, strlen(req)) == 0) ? load_response(fd, buf, sizeof(buf)) : (-1);
+  close(fd);
+
+  return(((status >= 200) && (status < 300)) ? 0 : (-1));
+}
+
+
+/**********/
+/* main() */
+/**********/
+int
+main(
+ int argc,
+ char *argv[])
+{
+const char req[] = "GET /events?topics=freq HTTP/1.1\r\n\r\n";
+const char *host = "127.0.0.1";
+struct pollfd *pfd = NULL;
+struct timespec ts;
+unsigned long *first = NULL;
+unsigned long *last = NULL;
+unsigned long long t = 0;
+unsigned long long now = 0;
+unsigned long long end = 0;
+char buf[4096];
+unsigned long long syscr[2];
+unsigned long long syscw[2];
+unsigned long long ticks[2];
+unsigned int listeners = 1000;
+unsigned int presses = 200;
+unsigned int heard = 0;
+unsigned int i = 0;
+unsigned int r = 0;
+ssize_t nr = 0;
+long pid = 0;
+int port = 80;
+int counted = 0;
+int opt = 0;
+int n = 0;
+
+  while ((opt = getopt(argc, argv, "h:p:n:r:P:")) != (-1)) {
+    switch (opt) {
+      case 'h':
+        host = optarg;
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 'n':
+        listeners = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        presses = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'P':
+        pid = strtol(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "usage: fanbench [-h host] [-p port] [-n listeners] [-r presses] [-P pid]\n");
+        return(EXIT_FAILURE);
+    }
+  }
+  if ((listeners == 0) || (presses == 0)) {
+    fprintf(stderr, "main: nothing to do\n");
+    return(EXIT_FAILURE);
+  }
+
+  load_nofile(listeners + 16);
+  pfd = malloc(sizeof(struct pollfd) * listeners);
+  first = malloc(sizeof(unsigned long) * presses);
+  last = malloc(sizeof(unsigned long) * presses);
+  if ((pfd == NULL) || (first == NULL) || (last == NULL)) {
+    fprintf(stderr, "main: malloc() error\n");
+    return(EXIT_FAILURE);
+  }
+
+  /* listeners, each is subscribed once its status line is read, */
+  /*  one after the other, as a burst would overflow the backlog */
+  t = load_now();
+  for (i = 0; i < listeners; i++) {
+    pfd[i].fd = load_connect(host, port, i, 0);
+    if (pfd[i].fd == (-1)) return(EXIT_FAILURE);
+    if (load_send(pfd[i].fd, req, strlen(req)) == (-1)) {
+      fprintf(stderr, "main: write() error\n");
+      return(EXIT_FAILURE);
+    }
+    nr = read(pfd[i].fd, buf, 12);
+    if ((nr < 12) || (memcmp(buf, "HTTP/1.1 200", 12) != 0)) {
+      fprintf(stderr, "main: listener %u not subscribed, is tunerd -c large enough?\n", i);
+      return(EXIT_FAILURE);
+    }
+  }
+  now = load_now();
+  printf("%u listeners subscribed in %llu ms, %.0f a second\n", listeners,
+   (now - t) / 1000, (double)listeners * 1000000 / (double)(now - t ? now - t : 1));
+
+  /* the snapshots are sent by now */
+  ts.tv_sec = 0;
+  ts.tv_nsec = 200000000;
+  nanosleep(&ts, NULL);
+
+  if (pid > 0) {
+    counted = (proc_count(pid, &syscr[0], &syscw[0], &ticks[0]) == 0);
+    if (!counted) fprintf(stderr, "main: no system call counts for process %ld\n", pid);
+  }
+
+  for (r = 0; r < presses; r++) {
+    /* whatever came before the press is not what it sent */
+    for (i = 0; i < listeners; i++) {
+      while (recv(pfd[i].fd, buf, sizeof(buf), MSG_DONTWAIT) > 0);
+      pfd[i].events = POLLIN;
+    }
+    heard = 0;
+    t = load_now();
+    if (press(host, port, listeners + r) == (-1)) {
+      fprintf(stderr, "main: NEXT press %u not answered\n", r);
+      return(EXIT_FAILURE);
+    }
+    end = t + FANWAIT * 1000ULL;
+
+    /* a listener has heard once it is sent a frame with data, */
+    /*  a heartbeat comment has none */
+    while ((heard < listeners) && (load_now() < end)) {
+      n = poll(pfd, listeners, FANWAIT);
+      if (n == (-1)) {
+        if (errno == EINTR) continue;
+        fprintf(stderr, "main: poll() error\n");
+        return(EXIT_FAILURE);
+      }
+      now = load_now();
+      for (i = 0; (i < listeners) && (n > 0); i++) {
+        if (pfd[i].revents == 0) continue;
+        n--;
+        nr = recv(pfd[i].fd, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+        if (nr == 0) {
+          fprintf(stderr, "main: listener %u closed by tunerd\n", i);
+          return(EXIT_FAILURE);
+        }
+        if (nr < 0) continue;
+        buf[nr] = '\0';
+        if ((pfd[i].events != 0) && (strstr(buf, "data: ") != NULL)) {
+          /* heard, it is left alone until the next press */
+          if (heard == 0) first[r] = (unsigned long)(now - t);
+          heard += 1;
+          if (heard == listeners) last[r] = (unsigned long)(now - t);
+          pfd[i].events = 0;
+        }
+      }
+    }
+    if (heard < listeners) {
+      fprintf(stderr, "main: press %u reached %u of %u listeners\n", r, heard, listeners);
+      return(EXIT_FAILURE);
+    }
+  }
+
+  if (counted && (proc_count(pid, &syscr[1], &syscw[1], &ticks[1]) == 0)) {
+    printf("tunerd per press: %.1f reads, %.1f writes, %.2f ms CPU\n",
+     (double)(syscr[1] - syscr[0]) / presses, (double)(syscw[1] - syscw[0]) / presses,
+     (double)(ticks[1] - ticks[0]) * 1000 / sysconf(_SC_CLK_TCK) / presses);
+  }
+  load_report("press to first", first, presses);
+  load_report("press to last", last, presses);
+
+  for (i = 0; i < listeners; i++) close(pfd[i].fd);
+  free(pfd);
+  free(first);
+  free(last);
+
+  return(EXIT_SUCCESS);
+}
@@ -0,0 +1,283 @@
+/* herd.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* reconnect storm, many listeners subscribing at once, */
+/*  as every EventSource in the house does after tunerd restarts */
+/*  -n clients, 5000 by default, connect to /radio_freq together; */
+/*  one told 503 comes back after its Retry-After, one dropped */
+/*  without an answer after -R milliseconds, as a browser would */
+/*  reports the time until all are subscribed, how many were turned */
+/*  away or dropped, and the spread of the retry: fields they were given */
+/*  tunerd takes listeners up to 90% of its -c, so with -c a tenth */
+/*  above -n all subscribe; with less, the rest come back in 503 waves */
+/*  until -t ends it, and with a small -b the backlog overflows */
+/* usage: herd [-h host] [-p port] [-n clients] [-R retry_ms] [-t seconds] */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+/* POSIX headers */
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/* Local headers */
+#include "load_util.h"
+
+/* Macros */
+/* what a client keeps of each answer, the head and a little past it */
+#ifndef HERDHEAD
+#define HERDHEAD 256
+#endif
+
+/* File scope variables */
+/* External variables */
+/* External functions */
+/* Structures and unions */
+struct herd_client {
+ int fd;
+ int state;                  /* HERD_ below */
+ unsigned long long at;      /* HERD_WAIT, when to connect again */
+ unsigned int len;
+ char head[HERDHEAD + 1];
+};
+#define HERD_WAIT    0
+#define HERD_CONNECT 1
+#define HERD_SENT    2
+#define HERD_DONE    3
+
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/**************/
+/* herd_off() */
+/**************/
+/* close io_c's connection, to connect again in in_us */
+static void
+herd_off(
+ struct herd_client *io_c,
+ unsigned long long in_us)
+{
+  close(io_c->fd);
+  io_c->fd = -1;
+  io_c->state = HERD_WAIT;
+  io_c->at = load_now() + in_us;
+  io_c->len = 0;
+}
+
+
+/**********/
+/* main() */
+/**********/
+int
+main(
+ int argc,
+ char *argv[])
+{
+const char req[] = "GET /radio_freq HTTP/1.1\r\nAccept: text/event-stream\r\n\r\n";
+const char *host = "127.0.0.1";
+struct herd_client *client = NULL;
+struct herd_client *c = NULL;
+struct pollfd *pfd = NULL;
+unsigned int *who = NULL;
+unsigned long *us = NULL;
+unsigned long long start = 0;
+unsigned long long now = 0;
+unsigned long long next = 0;
+unsigned long retry_min = 0;
+unsigned long retry_max = 0;
+unsigned long retry = 0;
+unsigned int clients = 5000;
+unsigned int redial = 3000;
+unsigned int sec = 120;
+unsigned int done = 0;
+unsigned int busy = 0;
+unsigned int dropped = 0;
+unsigned int attempts = 0;
+unsigned int retries = 0;
+unsigned int n = 0;
+unsigned int i = 0;
+const char *p = NULL;
+socklen_t sl = 0;
+ssize_t nr = 0;
+int status = 0;
+int err = 0;
+int port = 80;
+int opt = 0;
+
+  while ((opt = getopt(argc, argv, "h:p:n:R:t:")) != (-1)) {
+    switch (opt) {
+      case 'h':
+        host = optarg;
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 'n':
+        clients = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'R':
+        redial = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        sec = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "usage: herd [-h host] [-p port] [-n clients] [-R retry_ms] [-t seconds]\n");
+        return(EXIT_FAILURE);
+    }
+  }
+  if (clients == 0) {
+    fprintf(stderr, "main: nothing to do\n");
+    return(EXIT_FAILURE);
+  }
+  if (load_nofile(clients + 16) == (-1)) return(EXIT_FAILURE);
+
+  client = calloc(clients, sizeof(struct herd_client));
+  pfd = malloc(sizeof(struct pollfd) * clients);
+  who = malloc(sizeof(unsigned int) * clients);
+  us = malloc(sizeof(unsigned long) * clients);
+  if ((client == NULL) || (pfd == NULL) || (who == NULL) || (us == NULL)) {
+    fprintf(stderr, "main: malloc() error\n");
+    return(EXIT_FAILURE);
+  }
+  for (i = 0; i < clients; i++) client[i].fd = -1;
+
+  start = load_now();
+  while ((done < clients) && (load_now() - start < sec * 1000000ULL)) {
+
+    /* connect those whose time has come, all at once the first time */
+    now = load_now();
+    next = now + 100000;
+    for (i = 0; i < clients; i++) {
+      c = &(client[i]);
+      if (c->state != HERD_WAIT) continue;
+      if (c->at > now) {
+        if (c->at < next) next = c->at;
+        continue;
+      }
+      attempts += 1;
+      c->fd = load_connect(host, port, i, 1);
+      if (c->fd == (-1)) {
+        c->at = now + redial * 1000ULL;
+        dropped += 1;
+        continue;
+      }
+      c->state = HERD_CONNECT;
+    }
+
+    /* watch every connection on its way */
+    n = 0;
+    for (i = 0; i < clients; i++) {
+      c = &(client[i]);
+      if ((c->state != HERD_CONNECT) && (c->state != HERD_SENT)) continue;
+      pfd[n].fd = c->fd;
+      pfd[n].events = (c->state == HERD_CONNECT) ? POLLOUT : POLLIN;
+      who[n] = i;
+      n += 1;
+    }
+    now = load_now();
+    status = poll(pfd, n, (next > now) ? (int)((next - now) / 1000) + 1 : 0);
+    if (status == (-1)) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "main: poll() error\n");
+      return(EXIT_FAILURE);
+    }
+
+    for (i = 0; (i < n) && (status > 0); i++) {
+      if (pfd[i].revents == 0) continue;
+      status -= 1;
+      c = &(client[who[i]]);
+
+      if (c->state == HERD_CONNECT) {
+        sl = sizeof(err);
+        if ((getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &sl) == (-1)) || (err != 0) ||
+         (load_send(c->fd, req, strlen(req)) == (-1))) {
+          dropped += 1;
+          herd_off(c, redial * 1000ULL);
+          continue;
+        }
+        c->state = HERD_SENT;
+        continue;
+      }
+
+      /* HERD_SENT, wait for the whole head */
+      nr = recv(c->fd, c->head + c->len, HERDHEAD - c->len, 0);
+      if (nr <= 0) {
+        if ((nr == (-1)) && (errno == EAGAIN)) continue;
+        dropped += 1;
+        herd_off(c, redial * 1000ULL);
+        continue;
+      }
+      c->len += (unsigned int)nr;
+      c->head[c->len] = '\0';
+      if ((strstr(c->head, "\r\n\r\n") == NULL) && (c->len < HERDHEAD)) continue;
+
+      if (strncmp(c->head, "HTTP/1.1 200", 12) == 0) {
+        /* subscribed, and held open, no longer watched */
+        us[done] = (unsigned long)(load_now() - start);
+        done += 1;
+        c->state = HERD_DONE;
+        p = strstr(c->head, "\nretry: ");
+        if (p != NULL) {
+          retry = strtoul(p + 8, NULL, 10);
+          if ((retries == 0) || (retry < retry_min)) retry_min = retry;
+          if (retry > retry_max) retry_max = retry;
+          retries += 1;
+        }
+      } else if (strncmp(c->head, "HTTP/1.1 503", 12) == 0) {
+        busy += 1;
+        p = strstr(c->head, "Retry-After: ");
+        herd_off(c, ((p != NULL) ? strtoul(p + 13, NULL, 10) : 1) * 1000000ULL);
+      } else {
+        fprintf(stderr, "main: unexpected answer %.12s\n", c->head);
+        dropped += 1;
+        herd_off(c, redial * 1000ULL);
+      }
+    }
+  }
+
+  printf("%u of %u clients subscribed in %llu ms, %u attempts\n", done, clients,
+   (load_now() - start) / 1000, attempts);
+  printf("%u turned away with 503, %u dropped without an answer\n", busy, dropped);
+  if (retries > 0) {
+    printf("retry: fields %lu to %lu ms, of %u\n", retry_min, retry_max, retries);
+  }
+  load_report("subscribed after", us, done);
+
+  for (i = 0; i < clients; i++) {
+    if (client[i].fd != (-1)) close(client[i].fd);
+  }
+  free(us);
+  free(who);
+  free(pfd);
+  free(client);
+
+  return((done == clients) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
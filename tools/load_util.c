@@ -0,0 +1,289 @@
+/* load_util.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/* POSIX headers */
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* Local headers */
+#include "load_util.h"
+
+/* Macros */
+/* File scope variables */
+/* External variables */
+/* External functions */
+/* Structures and unions */
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/**************/
+/* load_now() */
+/**************/
+/* return: microseconds on the monotonic clock, 0 on error */
+unsigned long long
+load_now(void)
+{
+struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == (-1)) {
+    fprintf(stderr, "load_now: clock_gettime() error\n");
+    return(0);
+  }
+
+  return((unsigned long long)ts.tv_sec * 1000000 + (unsigned long long)ts.tv_nsec / 1000);
+}
+
+
+/*****************/
+/* load_nofile() */
+/*****************/
+/* raise the descriptor limit to in_need, as far as the hard limit allows */
+/* return: 0 on success, -1 fewer are allowed */
+int
+load_nofile(
+ unsigned int in_need)
+{
+struct rlimit rl;
+
+  if (getrlimit(RLIMIT_NOFILE, &rl) == (-1)) {
+    fprintf(stderr, "load_nofile: getrlimit() error\n");
+    return(-1);
+  }
+  if (rl.rlim_cur >= in_need) return(0);
+
+  rl.rlim_cur = in_need;
+  if ((rl.rlim_max != RLIM_INFINITY) && (rl.rlim_max < in_need)) {
+    rl.rlim_cur = rl.rlim_max;
+  }
+  if (setrlimit(RLIMIT_NOFILE, &rl) == (-1)) {
+    fprintf(stderr, "load_nofile: setrlimit() error\n");
+    return(-1);
+  }
+  if (rl.rlim_cur < in_need) {
+    fprintf(stderr, "load_nofile: hard limit %lu is below %u descriptors\n",
+     (unsigned long)rl.rlim_max, in_need);
+    return(-1);
+  }
+
+  return(0);
+}
+
+
+/******************/
+/* load_connect() */
+/******************/
+/* connect to in_host (IPv4 dotted), port in_port, */
+/*  the in_index'th connection of the driver, */
+/*  with in_nonblock the connect is left in progress */
+/* return: socket, -1 on error */
+int
+load_connect(
+ const char *in_host,
+ int in_port,
+ unsigned int in_index,
+ int in_nonblock)
+{
+struct sockaddr_in sa;
+struct sockaddr_in src;
+int fd = 0;
+int one = 1;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(in_port);
+  if (inet_pton(AF_INET, in_host, &(sa.sin_addr)) != 1) {
+    fprintf(stderr, "load_connect: not an IPv4 address %s\n", in_host);
+    return(-1);
+  }
+
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == (-1)) {
+    fprintf(stderr, "load_connect: socket() error %s\n", strerror(errno));
+    return(-1);
+  }
+
+  /* one local address has only so many ports, on loopback */
+  /*  the others of 127/8 are used once it runs out, where the */
+  /*  system answers on them (Linux), not where it does not */
+  if ((strncmp(in_host, "127.", 4) == 0) && (in_index >= LOAD_PERADDR)) {
+    memset(&src, 0, sizeof(src));
+    src.sin_family = AF_INET;
+    src.sin_addr.s_addr = htonl(0x7f000001 + in_index / LOAD_PERADDR);
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&src, sizeof(src)) == (-1)) {
+      fprintf(stderr, "load_connect: bind() error %s\n", strerror(errno));
+      close(fd);
+      return(-1);
+    }
+  }
+
+  if (in_nonblock) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  }
+
+  if ((connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == (-1)) &&
+   (!in_nonblock || (errno != EINPROGRESS))) {
+    fprintf(stderr, "load_connect: connect() error %s\n", strerror(errno));
+    close(fd);
+    return(-1);
+  }
+
+  return(fd);
+}
+
+
+/***************/
+/* load_send() */
+/***************/
+/* write all of in_buf to in_fd, a blocking socket */
+/* return: 0 on success, -1 on error */
+int
+load_send(
+ int in_fd,
+ const char *in_buf,
+ size_t in_len)
+{
+ssize_t nw = 0;
+
+  while (in_len > 0) {
+    nw = write(in_fd, in_buf, in_len);
+    if (nw == (-1)) {
+      if (errno == EINTR) continue;
+      return(-1);
+    }
+    in_buf += nw;
+    in_len -= (size_t)nw;
+  }
+
+  return(0);
+}
+
+
+/*******************/
+/* load_response() */
+/*******************/
+/* read one response from in_fd, a blocking socket, into out_buf, */
+/*  its head and as much of its Content-Length body as fits, */
+/*  the rest of the body is read and discarded */
+/*  nothing past the response is read, so it may be kept alive */
+/* return: HTTP status, -1 on error or a response it cannot frame */
+int
+load_response(
+ int in_fd,
+ char *out_buf,
+ size_t in_size)
+{
+char scratch[4096];
+const char *cl = NULL;
+char *end = NULL;
+unsigned long body = 0;
+size_t used = 0;
+size_t head = 0;
+ssize_t nr = 0;
+int status = 0;
+
+  /* the head, a byte at a time would be slow, */
+  /*  so read what is there and keep what is past it as body */
+  while (1) {
+    if (used + 1 >= in_size) return(-1);
+    nr = read(in_fd, out_buf + used, in_size - 1 - used);
+    if (nr <= 0) {
+      if ((nr == (-1)) && (errno == EINTR)) continue;
+      return(-1);
+    }
+    used += (size_t)nr;
+    out_buf[used] = '\0';
+    end = strstr(out_buf, "\r\n\r\n");
+    if (end != NULL) break;
+  }
+  head = (size_t)(end - out_buf) + 4;
+
+  if (sscanf(out_buf, "HTTP/1.%*c %d", &status) != 1) return(-1);
+  cl = strstr(out_buf, "Content-Length: ");
+  if ((cl != NULL) && (cl < end)) body = strtoul(cl + 16, NULL, 10);
+  if (used - head > body) return(-1); /* read past it, pipelined */
+
+  body -= (unsigned long)(used - head);
+  while (body > 0) {
+    nr = read(in_fd, scratch, (body < sizeof(scratch)) ? body : sizeof(scratch));
+    if (nr <= 0) {
+      if ((nr == (-1)) && (errno == EINTR)) continue;
+      return(-1);
+    }
+    body -= (unsigned long)nr;
+  }
+
+  return(status);
+}
+
+
+/**************/
+/* load_cmp() */
+/**************/
+static int
+load_cmp(
+ const void *in_a,
+ const void *in_b)
+{
+unsigned long a = *(const unsigned long *)in_a;
+unsigned long b = *(const unsigned long *)in_b;
+
+  return((a > b) - (a < b));
+}
+
+
+/*****************/
+/* load_report() */
+/*****************/
+/* print in_count times, in microseconds, as percentiles, */
+/*  io_us is sorted in place */
+void
+load_report(
+ const char *in_label,
+ unsigned long *io_us,
+ unsigned int in_count)
+{
+  if (in_count == 0) {
+    printf("%-24s no samples\n", in_label);
+    return;
+  }
+
+  qsort(io_us, in_count, sizeof(unsigned long), load_cmp);
+  printf("%-24s n %-7u p50 %7lu  p90 %7lu  p99 %7lu  max %7lu us\n", in_label, in_count,
+   io_us[in_count / 2], io_us[(in_count * 9) / 10], io_us[(in_count * 99) / 100], io_us[in_count - 1]);
+}
@@ -0,0 +1,46 @@
+/* load_util.h */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* helpers shared by the load drivers in this directory */
+/*  each driver is a client of a running tunerd, */
+/*  or links the modules it measures, see the Makefile */
+
+#ifndef load_util_h
+#define load_util_h
+
+#include <stddef.h>
+
+/* connections made from one local address, loopback targets */
+/*  are spread over 127.0.0.1, .2, ... past the ephemeral port range */
+#ifndef LOAD_PERADDR
+#define LOAD_PERADDR 20000
+#endif
+
+unsigned long long load_now(void);
+
+int load_nofile(unsigned int in_need);
+
+int load_connect(const char *in_host, int in_port, unsigned int in_index, int in_nonblock);
+
+int load_send(int in_fd, const char *in_buf, size_t in_len);
+
+int load_response(int in_fd, char *out_buf, size_t in_size);
+
+void load_report(const char *in_label, unsigned long *io_us, unsigned int in_count);
+
+#endif
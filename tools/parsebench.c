@@ -0,0 +1,293 @@
+/* parsebench.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* throughput of http_parse(), over requests as browsers send them */
+/*  whole, as one read, and trickled in, as a slow client sends them, */
+/*  against a rescan of the whole buffer on every read, */
+/*  the strstr() and strlen() http_handle() once did */
+/*  -k adds a Cookie header of that many bytes to each, */
+/*  as another site on the same host may have set */
+/* usage: parsebench [-k cookie_bytes] [-r rounds] */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* POSIX headers */
+#include <unistd.h>
+
+/* Local headers */
+#include "http_util.h"
+#include "load_util.h"
+
+/* Macros */
+/* bytes a trickled request arrives in, each read */
+#ifndef TRICKLE
+#define TRICKLE 8
+#endif
+
+/* File scope variables */
+/*  requests captured from browsers, and the tools tunerd sees */
+static const char *corpus[] = {
+ /* Firefox, the page */
+ "GET / HTTP/1.1\r\n"
+ "Host: 192.168.1.128\r\n"
+ "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+ "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+ "Accept-Language: en-US,en;q=0.5\r\n"
+ "Accept-Encoding: gzip, deflate\r\n"
+ "Connection: keep-alive\r\n"
+ "Upgrade-Insecure-Requests: 1\r\n"
+ "If-None-Match: \"5f3a-1a2b\"\r\n"
+ "Priority: u=0, i\r\n"
+ "\r\n",
+ /* Chrome, the event stream */
+ "GET /events?topics=freq,tuning,locked,reload HTTP/1.1\r\n"
+ "Host: 192.168.1.128\r\n"
+ "Connection: keep-alive\r\n"
+ "Accept: text/event-stream\r\n"
+ "Cache-Control: no-cache\r\n"
+ "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/126.0.0.0 Safari/537.36\r\n"
+ "Referer: http://192.168.1.128/\r\n"
+ "Accept-Encoding: gzip, deflate\r\n"
+ "Accept-Language: en-US,en;q=0.9\r\n"
+ "\r\n",
+ /* Safari on a tablet, reconnecting */
+ "GET /radio_freq HTTP/1.1\r\n"
+ "Host: 192.168.1.128\r\n"
+ "Accept: text/event-stream\r\n"
+ "Last-Event-ID: 1879286774497287\r\n"
+ "Cache-Control: no-cache\r\n"
+ "Accept-Language: en-US,en;q=0.9\r\n"
+ "Pragma: no-cache\r\n"
+ "Accept-Encoding: gzip, deflate\r\n"
+ "User-Agent: Mozilla/5.0 (iPad; CPU OS 17_5 like Mac OS X) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/17.5 Mobile/15E148 Safari/604.1\r\n"
+ "Referer: http://192.168.1.128/\r\n"
+ "Connection: keep-alive\r\n"
+ "\r\n",
+ /* Chrome, the NEXT button */
+ "POST /radio_preset HTTP/1.1\r\n"
+ "Host: 192.168.1.128\r\n"
+ "Connection: keep-alive\r\n"
+ "Content-Length: 11\r\n"
+ "Cache-Control: max-age=0\r\n"
+ "Origin: http://192.168.1.128\r\n"
+ "Content-Type: application/x-www-form-urlencoded\r\n"
+ "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/126.0.0.0 Safari/537.36\r\n"
+ "Accept: */*\r\n"
+ "Referer: http://192.168.1.128/\r\n"
+ "Accept-Encoding: gzip, deflate\r\n"
+ "Accept-Language: en-US,en;q=0.9\r\n"
+ "\r\n",
+ /* a long-poll, from an old browser */
+ "GET /radio_freq/wait?since=1879286774497287 HTTP/1.1\r\n"
+ "Host: 192.168.1.128\r\n"
+ "User-Agent: Mozilla/5.0 (compatible; MSIE 9.0; Windows NT 6.1; Trident/5.0)\r\n"
+ "Accept: */*\r\n"
+ "Connection: Keep-Alive\r\n"
+ "\r\n",
+ /* curl */
+ "GET /radio_signal/history?points=60&seconds=600 HTTP/1.1\r\n"
+ "Host: 192.168.1.128\r\n"
+ "User-Agent: curl/8.5.0\r\n"
+ "Accept: */*\r\n"
+ "\r\n"
+};
+#define CORPUS (sizeof(corpus) / sizeof(corpus[0]))
+
+/* External variables */
+/* External functions */
+/* Structures and unions */
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/************/
+/* rescan() */
+/************/
+/* the head found as http_handle() once did, on every read */
+/*  io_buf holds in_len bytes, NUL terminated after each read */
+/* return: 1 head complete, 0 not */
+static int
+rescan(
+ char *io_buf,
+ unsigned int in_len,
+ unsigned int in_read)
+{
+char saved = 0;
+unsigned int n = 0;
+int done = 0;
+
+  for (n = 0; (n < in_len) && !done; ) {
+    n += in_read;
+    if (n > in_len) n = in_len;
+    saved = io_buf[n];
+    io_buf[n] = '\0';
+    done = (strlen(io_buf) > 0) && (strstr(io_buf, "\r\n\r\n") != NULL);
+    io_buf[n] = saved;
+  }
+
+  return(done);
+}
+
+
+/***********/
+/* parse() */
+/***********/
+/* parse in_buf, of in_len bytes, arriving in_read bytes at a time */
+/* return: 1 head complete, 0 not */
+static int
+parse(
+ char *in_buf,
+ unsigned int in_len,
+ unsigned int in_read)
+{
+struct http_req_struct req;
+unsigned int n = 0;
+int status = 0;
+
+  memset(&req, 0, sizeof(req));
+  for (n = 0; (n < in_len) && (status == 0); ) {
+    n += in_read;
+    if (n > in_len) n = in_len;
+    status = http_parse(in_buf, n, &req);
+  }
+
+  return(status == 1);
+}
+
+
+/*********/
+/* run() */
+/*********/
+/* time in_rounds passes over the corpus, with in_f, */
+/*  arriving in_read bytes at a time, and print the rate */
+/* return: 0 every request was parsed, -1 not */
+static int
+run(
+ const char *in_label,
+ int (*in_f)(char *, unsigned int, unsigned int),
+ char **in_buf,
+ unsigned int *in_len,
+ unsigned long long in_bytes,
+ unsigned int in_read,
+ unsigned int in_rounds)
+{
+unsigned long long t = 0;
+unsigned long long us = 0;
+unsigned long done = 0;
+unsigned int r = 0;
+unsigned int i = 0;
+
+  t = load_now();
+  for (r = 0; r < in_rounds; r++) {
+    for (i = 0; i < CORPUS; i++) done += in_f(in_buf[i], in_len[i], in_read);
+  }
+  us = load_now() - t;
+  if (us == 0) us = 1;
+
+  printf("%-10s %5u byte reads  %8.1f MB/s  %7.0f ns/request\n", in_label, in_read,
+   (double)in_bytes * in_rounds / us, (double)us * 1000 / ((double)in_rounds * CORPUS));
+
+  return((done == (unsigned long)in_rounds * CORPUS) ? 0 : (-1));
+}
+
+
+/**********/
+/* main() */
+/**********/
+int
+main(
+ int argc,
+ char *argv[])
+{
+char *buf[CORPUS];
+unsigned int len[CORPUS];
+unsigned int read_size[3] = { 65535, TRICKLE, 1 }; /* whole, slow, slowest */
+unsigned long long bytes = 0;
+unsigned int rounds = 100000;
+unsigned int cookie = 0;
+unsigned int head = 0;
+unsigned int r = 0;
+unsigned int i = 0;
+unsigned int k = 0;
+int status = 0;
+int opt = 0;
+
+  while ((opt = getopt(argc, argv, "k:r:")) != (-1)) {
+    switch (opt) {
+      case 'k':
+        cookie = (unsigned int)strtoul(optarg, NULL, 10);
+        if (cookie > 8192) cookie = 8192;
+        break;
+      case 'r':
+        rounds = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "usage: parsebench [-k cookie_bytes] [-r rounds]\n");
+        return(EXIT_FAILURE);
+    }
+  }
+  if (rounds < 10) rounds = 10;
+
+  /* writable copies, rescan() terminates them in place */
+  /*  the cookie goes before the blank line that ends the head */
+  for (i = 0; i < CORPUS; i++) {
+    len[i] = strlen(corpus[i]);
+    buf[i] = malloc(len[i] + cookie + 16);
+    if (buf[i] == NULL) {
+      fprintf(stderr, "main: malloc() error\n");
+      return(EXIT_FAILURE);
+    }
+    head = len[i] - 2;
+    memcpy(buf[i], corpus[i], head);
+    if (cookie > 0) {
+      memcpy(buf[i] + head, "Cookie: ", 8);
+      memset(buf[i] + head + 8, 'c', cookie);
+      memcpy(buf[i] + head + 8 + cookie, "\r\n", 2);
+      head += cookie + 10;
+    }
+    memcpy(buf[i] + head, "\r\n", 3);
+    len[i] = head + 2;
+    bytes += len[i];
+  }
+  printf("%u requests, %llu bytes, %u rounds\n", (unsigned int)CORPUS, bytes, rounds);
+
+  for (k = 0; k < 3; k++) {
+    /* fewer rounds where each costs more */
+    r = (read_size[k] == 1) ? rounds / 10 : rounds;
+    if (run("http_parse", parse, buf, len, bytes, read_size[k], r) == (-1)) status = (-1);
+    if (run("rescan", rescan, buf, len, bytes, read_size[k], r) == (-1)) status = (-1);
+  }
+
+  for (i = 0; i < CORPUS; i++) free(buf[i]);
+
+  if (status == (-1)) {
+    fprintf(stderr, "main: a corpus request was not parsed\n");
+    return(EXIT_FAILURE);
+  }
+
+  return(EXIT_SUCCESS);
+}
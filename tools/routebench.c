@@ -0,0 +1,232 @@
+/* routebench.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* dispatch time of the route trie, http_rout.c, with hundreds of routes */
+/*  tunerd's own routes, and -n more, a third each literal, */
+/*  with a parameter, and a prefix, then a set of paths looked up */
+/*  -r times each, against the linear scan of every route */
+/*  http_handle() once did, which knew only literal paths */
+/* usage: routebench [-n routes] [-r rounds] */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* POSIX headers */
+#include <unistd.h>
+
+/* Local headers */
+#include "http_util.h"
+#include "http_rout.h"
+#include "load_util.h"
+
+/* Macros */
+/* GET, as http_util.c codes it */
+#define ROUTGET 2
+
+/* File scope variables */
+/* tunerd's GET routes, as http_util.c and tunerd.c register them */
+static const char *own[] = {
+ "/",
+ "/events",
+ "/radio_freq",
+ "/radio_freq/wait",
+ "/radio_signal/history"
+};
+#define OWN (sizeof(own) / sizeof(own[0]))
+
+/* every pattern, as registered, for the linear scan */
+static char **pattern = NULL;
+static unsigned int patterns = 0;
+
+/* External variables */
+/* External functions */
+/* Structures and unions */
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/********/
+/* cb() */
+/********/
+/* stands for a callback, never called */
+static int
+cb(
+ const char *in_req,
+ int in_fd)
+{
+  return(0);
+}
+
+
+/************/
+/* linear() */
+/************/
+/* the scan http_handle() once did, exact match of every route in turn */
+/* return: 0 found, -1 no route */
+static int
+linear(
+ const char *in_path,
+ unsigned int in_len)
+{
+unsigned int i = 0;
+
+  for (i = 0; i < patterns; i++) {
+    if ((strncmp(pattern[i], in_path, in_len) == 0) && (pattern[i][in_len] == '\0')) {
+      return(0);
+    }
+  }
+
+  return(-1);
+}
+
+
+/*********/
+/* add() */
+/*********/
+/* register in_pattern, and keep it for the linear scan */
+/* return: 0 on success, -1 error */
+static int
+add(
+ const char *in_pattern)
+{
+  pattern[patterns] = malloc(strlen(in_pattern) + 1);
+  if (pattern[patterns] == NULL) {
+    fprintf(stderr, "add: malloc() error\n");
+    return(-1);
+  }
+  strcpy(pattern[patterns], in_pattern);
+  patterns += 1;
+
+  return(rout_add(ROUTGET, in_pattern, cb));
+}
+
+
+/**********/
+/* main() */
+/**********/
+int
+main(
+ int argc,
+ char *argv[])
+{
+struct http_req_struct req;
+int (*f)(const char *, int) = NULL;
+char path[8][64];
+char buf[64];
+const char *volatile p = NULL;   /* read anew each round, not hoisted */
+unsigned long long t = 0;
+unsigned long long us[2];
+unsigned int routes = 600;
+unsigned int rounds = 1000000;
+unsigned int paths = 0;
+unsigned int len = 0;
+unsigned int r = 0;
+unsigned int i = 0;
+int found[2];
+int status = 0;
+int opt = 0;
+
+  while ((opt = getopt(argc, argv, "n:r:")) != (-1)) {
+    switch (opt) {
+      case 'n':
+        routes = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        rounds = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "usage: routebench [-n routes] [-r rounds]\n");
+        return(EXIT_FAILURE);
+    }
+  }
+  if (routes < 3) routes = 3;
+  if (rounds == 0) rounds = 1;
+
+  pattern = malloc(sizeof(char *) * (OWN + routes));
+  if (pattern == NULL) {
+    fprintf(stderr, "main: malloc() error\n");
+    return(EXIT_FAILURE);
+  }
+  for (i = 0; i < OWN; i++) {
+    if (add(own[i]) == (-1)) return(EXIT_FAILURE);
+  }
+  for (i = 0; i < routes; i++) {
+    switch (i % 3) {
+      case 0:
+        snprintf(buf, sizeof(buf), "/api/v1/item%u", i);
+        break;
+      case 1:
+        snprintf(buf, sizeof(buf), "/device%u/{index}/state", i);
+        break;
+      default:
+        snprintf(buf, sizeof(buf), "/static%u/*", i);
+        break;
+    }
+    if (add(buf) == (-1)) return(EXIT_FAILURE);
+  }
+
+  /* short and long, literal, parameter, prefix, and none */
+  /*  the generated ones are the last registered of their kind */
+  snprintf(path[paths++], 64, "/");
+  snprintf(path[paths++], 64, "/radio_freq");
+  snprintf(path[paths++], 64, "/radio_signal/history");
+  snprintf(path[paths++], 64, "/api/v1/item%u", (routes - 1) / 3 * 3);
+  snprintf(path[paths++], 64, "/device%u/7/state", (routes - 2) / 3 * 3 + 1);
+  snprintf(path[paths++], 64, "/static%u/js/app/main.js", (routes - 3) / 3 * 3 + 2);
+  snprintf(path[paths++], 64, "/no/such/route");
+  printf("%u routes, %u rounds\n", patterns, rounds);
+  printf("%-32s %10s %10s\n", "path", "trie ns", "linear ns");
+
+  for (i = 0; i < paths; i++) {
+    len = strlen(path[i]);
+    p = path[i];
+
+    t = load_now();
+    for (r = 0; r < rounds; r++) {
+      found[0] = rout_find(ROUTGET, p, 0, len, &req, &f);
+    }
+    us[0] = load_now() - t;
+
+    t = load_now();
+    for (r = 0; r < rounds; r++) found[1] = linear(p, len);
+    us[1] = load_now() - t;
+
+    printf("%-32s %10.1f %10.1f%s\n", path[i], (double)us[0] * 1000 / rounds,
+     (double)us[1] * 1000 / rounds,
+     (found[1] == 0) ? "" : (found[0] == 0) ? "  (not a literal route)" : "  (no route)");
+
+    /* every path but the last has a route */
+    if ((found[0] == 0) != (i + 1 < paths)) {
+      fprintf(stderr, "main: %s matched wrongly\n", path[i]);
+      status = (-1);
+    }
+  }
+
+  for (i = 0; i < patterns; i++) free(pattern[i]);
+  free(pattern);
+
+  return((status == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
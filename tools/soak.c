@@ -0,0 +1,297 @@
+/* soak.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* soak test, tunerd holding many idle SSE listeners */
+/*  opens -n listeners, 50000 by default, of the quiet "reload" topic, */
+/*  reports tunerd's memory per listener, with -P and its process id, */
+/*  then holds them -t seconds, reading their heartbeats, */
+/*  and reports any tunerd closed */
+/*  tunerd needs -c a tenth above -n, as it keeps room for other clients */
+/*  the listeners are spread over -j processes, */
+/*  as each may hold only so many descriptors */
+/* usage: soak [-h host] [-p port] [-n listeners] [-t seconds] [-j processes] [-P pid] */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+/* POSIX headers */
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+
+/* Local headers */
+#include "load_util.h"
+
+/* Macros */
+/* most listeners one process holds, under a common hard limit */
+#ifndef SOAKSHARE
+#define SOAKSHARE 16000
+#endif
+
+/* File scope variables */
+/* External variables */
+/* External functions */
+/* Structures and unions */
+/* what each process tells the first, once its listeners */
+/*  are open, and again once it has held them */
+struct soak_report {
+ unsigned int opened;
+ unsigned int closed;
+ unsigned long long bytes;
+};
+
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/************/
+/* rss_kb() */
+/************/
+/* return: resident memory of process in_pid in kilobytes, -1 not known */
+static long
+rss_kb(
+ long in_pid)
+{
+FILE *fp = NULL;
+char cmd[64];
+long kb = -1;
+
+  snprintf(cmd, sizeof(cmd), "ps -o rss= -p %ld", in_pid);
+  fp = popen(cmd, "r");
+  if (fp == NULL) return(-1);
+  if (fscanf(fp, "%ld", &kb) != 1) kb = -1;
+  pclose(fp);
+
+  return(kb);
+}
+
+
+/**********/
+/* hold() */
+/**********/
+/* in a process of its own, open listeners in_first to in_first + in_count, */
+/*  tell in_out, hold them in_sec seconds, and tell in_out again */
+static void
+hold(
+ const char *in_host,
+ int in_port,
+ unsigned int in_first,
+ unsigned int in_count,
+ unsigned int in_sec,
+ int in_out)
+{
+const char req[] = "GET /events?topics=reload HTTP/1.1\r\n\r\n";
+struct soak_report rep;
+struct pollfd *pfd = NULL;
+struct timeval tv;
+unsigned long long end = 0;
+char buf[4096];
+unsigned int i = 0;
+ssize_t nr = 0;
+int n = 0;
+
+  memset(&rep, 0, sizeof(rep));
+  load_nofile(in_count + 16);
+  pfd = malloc(sizeof(struct pollfd) * in_count);
+  if (pfd == NULL) {
+    fprintf(stderr, "hold: malloc() error\n");
+    write(in_out, &rep, sizeof(rep));
+    return;
+  }
+
+  /* one at a time, each subscribed once its status line is read */
+  tv.tv_sec = 5;
+  tv.tv_usec = 0;
+  for (i = 0; i < in_count; i++) {
+    pfd[i].fd = load_connect(in_host, in_port, in_first + i, 0);
+    if (pfd[i].fd == (-1)) break;
+    pfd[i].events = POLLIN;
+    setsockopt(pfd[i].fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if ((load_send(pfd[i].fd, req, strlen(req)) == (-1)) ||
+     (read(pfd[i].fd, buf, 12) < 12) || (memcmp(buf, "HTTP/1.1 200", 12) != 0)) {
+      /* tunerd refuses listeners past LISTENLOAD, 90%, of its -c */
+      fprintf(stderr, "hold: listener %u not subscribed, is tunerd -c a tenth above -n?\n",
+       in_first + i);
+      close(pfd[i].fd);
+      break;
+    }
+  }
+  rep.opened = i;
+  write(in_out, &rep, sizeof(rep));
+
+  /* heartbeats, and anything else, are read as they come */
+  end = load_now() + in_sec * 1000000ULL;
+  while (load_now() < end) {
+    n = poll(pfd, rep.opened, 1000);
+    if (n == (-1)) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "hold: poll() error\n");
+      break;
+    }
+    for (i = 0; (i < rep.opened) && (n > 0); i++) {
+      if (pfd[i].revents == 0) continue;
+      n--;
+      nr = recv(pfd[i].fd, buf, sizeof(buf), MSG_DONTWAIT);
+      if (nr > 0) {
+        rep.bytes += (unsigned long long)nr;
+      } else if ((nr == 0) || (errno != EAGAIN)) {
+        /* closed by tunerd, no longer watched */
+        rep.closed += 1;
+        pfd[i].fd = -pfd[i].fd - 1;
+      }
+    }
+  }
+  write(in_out, &rep, sizeof(rep));
+
+  for (i = 0; i < rep.opened; i++) {
+    if (pfd[i].fd >= 0) close(pfd[i].fd);
+  }
+  free(pfd);
+}
+
+
+/**********/
+/* main() */
+/**********/
+int
+main(
+ int argc,
+ char *argv[])
+{
+const char *host = "127.0.0.1";
+struct soak_report rep;
+unsigned long long t = 0;
+unsigned long long bytes = 0;
+unsigned int listeners = 50000;
+unsigned int procs = 0;
+unsigned int share = 0;
+unsigned int opened = 0;
+unsigned int closed = 0;
+unsigned int sec = 60;
+unsigned int i = 0;
+long pid = 0;
+long kb[3] = { -1, -1, -1 };
+int *out = NULL;
+int fds[2];
+int port = 80;
+int opt = 0;
+
+  while ((opt = getopt(argc, argv, "h:p:n:t:j:P:")) != (-1)) {
+    switch (opt) {
+      case 'h':
+        host = optarg;
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 'n':
+        listeners = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        sec = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'j':
+        procs = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'P':
+        pid = strtol(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "usage: soak [-h host] [-p port] [-n listeners] [-t seconds] [-j processes] [-P pid]\n");
+        return(EXIT_FAILURE);
+    }
+  }
+  if (listeners == 0) {
+    fprintf(stderr, "main: nothing to do\n");
+    return(EXIT_FAILURE);
+  }
+  if (procs == 0) procs = (listeners + SOAKSHARE - 1) / SOAKSHARE;
+  share = (listeners + procs - 1) / procs;
+
+  out = malloc(sizeof(int) * procs);
+  if (out == NULL) {
+    fprintf(stderr, "main: malloc() error\n");
+    return(EXIT_FAILURE);
+  }
+
+  if (pid > 0) kb[0] = rss_kb(pid);
+
+  /* each process opens its share, in turn, so the backlog */
+  /*  is not overrun, and reports back on a pipe of its own */
+  t = load_now();
+  for (i = 0; i < procs; i++) {
+    if (pipe(fds) == (-1)) {
+      fprintf(stderr, "main: pipe() error\n");
+      return(EXIT_FAILURE);
+    }
+    if (fork() == 0) {
+      close(fds[0]);
+      hold(host, port, i * share, (listeners - i * share < share) ? listeners - i * share : share,
+       sec, fds[1]);
+      _exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+    out[i] = fds[0];
+    if (read(out[i], &rep, sizeof(rep)) != sizeof(rep)) rep.opened = 0;
+    opened += rep.opened;
+  }
+  printf("%u of %u listeners subscribed in %llu ms, by %u processes\n", opened, listeners,
+   (load_now() - t) / 1000, procs);
+
+  if (pid > 0) {
+    kb[1] = rss_kb(pid);
+    if ((kb[0] >= 0) && (kb[1] >= 0) && (opened > 0)) {
+      printf("tunerd resident %ld KB before, %ld KB with them, %.2f KB a listener\n",
+       kb[0], kb[1], (double)(kb[1] - kb[0]) / opened);
+    } else {
+      printf("tunerd memory not known\n");
+    }
+  }
+
+  /* hold, and hear how it went */
+  for (i = 0; i < procs; i++) {
+    if (read(out[i], &rep, sizeof(rep)) == sizeof(rep)) {
+      closed += rep.closed;
+      bytes += rep.bytes;
+    }
+    close(out[i]);
+  }
+  while (wait(NULL) > 0);
+
+  printf("held %u s: %u closed by tunerd, %llu bytes of heartbeats and events\n", sec, closed, bytes);
+  if (pid > 0) {
+    kb[2] = rss_kb(pid);
+    if (kb[2] >= 0) printf("tunerd resident %ld KB after\n", kb[2]);
+  }
+
+  free(out);
+
+  return(((opened == listeners) && (closed == 0)) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
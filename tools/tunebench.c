@@ -0,0 +1,124 @@
+/* tunebench.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* station change latency, through radio_frequency() as tunerd calls it */
+/*  -r changes, 20000 by default, stepping across the FM band */
+/*  built against the simulated tuner, SIMFLAGS in the Makefile, */
+/*  where RADIO_SIMDELAY=0 leaves only tunerd's own part of a change; */
+/*  built with SIMFLAGS empty it times the card itself */
+/*  -o closes the tuner before each change, so each reopens it, */
+/*  reads its settings and sets it, as every change once did */
+/* usage: tunebench [-r changes] [-o] */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+
+/* POSIX headers */
+#include <unistd.h>
+
+/* Local headers */
+#include "radio_util.h"
+#include "load_util.h"
+
+/* Macros */
+/* the band, and the step between stations, in kHz */
+#define TUNELOW  87500
+#define TUNEHIGH 108000
+#define TUNESTEP 200
+
+/* File scope variables */
+/* External variables */
+/* External functions */
+/* Structures and unions */
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/**********/
+/* main() */
+/**********/
+int
+main(
+ int argc,
+ char *argv[])
+{
+unsigned long *us = NULL;
+unsigned long long start = 0;
+unsigned long long t = 0;
+unsigned long kHz = TUNELOW;
+unsigned int changes = 20000;
+unsigned int failed = 0;
+unsigned int i = 0;
+int reopen = 0;
+int opt = 0;
+
+  while ((opt = getopt(argc, argv, "r:o")) != (-1)) {
+    switch (opt) {
+      case 'r':
+        changes = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'o':
+        reopen = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: tunebench [-r changes] [-o]\n");
+        return(EXIT_FAILURE);
+    }
+  }
+  if (changes == 0) changes = 1;
+
+  us = malloc(sizeof(unsigned long) * changes);
+  if (us == NULL) {
+    fprintf(stderr, "main: malloc() error\n");
+    return(EXIT_FAILURE);
+  }
+
+  if (radio_init() == (-1)) {
+    fprintf(stderr, "main: no tuner\n");
+    return(EXIT_FAILURE);
+  }
+
+  start = load_now();
+  for (i = 0; i < changes; i++) {
+    kHz += TUNESTEP;
+    if (kHz > TUNEHIGH) kHz = TUNELOW;
+
+    t = load_now();
+    if (reopen) radio_end();
+    if (radio_frequency(kHz) == (-1)) failed += 1;
+    us[i] = (unsigned long)(load_now() - t);
+  }
+  t = load_now() - start;
+
+  printf("%u station changes, %s, %.0f ns each, %u failed\n", changes,
+   reopen ? "reopening the tuner for each" : "the tuner kept open",
+   (double)t * 1000 / changes, failed);
+  load_report("station change", us, changes);
+
+  radio_end();
+  free(us);
+
+  return((failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,211 @@
+/* wakebench.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* wakeup cost of tunerd's event loop, against the idle connections it holds */
+/*  opens idle SSE listeners in steps, 32, 1000 and 10000 by default, */
+/*  and at each times requests on one keep-alive connection, */
+/*  a loop whose wakeup scans every descriptor slows as they grow, */
+/*  one that is handed only the ready ones does not */
+/* usage: wakebench [-h host] [-p port] [-n levels] [-r requests] */
+/*  tunerd needs -c above the largest level */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* POSIX headers */
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+/* Local headers */
+#include "load_util.h"
+
+/* Macros */
+#ifndef LEVELS
+#define LEVELS "32,1000,10000"
+#endif
+
+/* most levels on the command line */
+#define MAXLEVELS 16
+
+/* File scope variables */
+/* External variables */
+/* External functions */
+/* Structures and unions */
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/***************/
+/* listen_up() */
+/***************/
+/* open idle listeners up to in_count, those from in_have are new */
+/*  each is sent its request and read up to its status line, */
+/*  so it is subscribed before timing starts */
+/* return: listeners held, less than in_count on error */
+static unsigned int
+listen_up(
+ const char *in_host,
+ int in_port,
+ int *io_fd,
+ unsigned int in_have,
+ unsigned int in_count)
+{
+const char req[] = "GET /events?topics=reload HTTP/1.1\r\n\r\n";
+struct timeval tv;
+char status[16];
+unsigned int i = 0;
+ssize_t nr = 0;
+
+  tv.tv_sec = 5;
+  tv.tv_usec = 0;
+  for (i = in_have; i < in_count; i++) {
+    io_fd[i] = load_connect(in_host, in_port, i, 0);
+    if (io_fd[i] == (-1)) return(i);
+    setsockopt(io_fd[i], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (load_send(io_fd[i], req, strlen(req)) == (-1)) {
+      fprintf(stderr, "listen_up: write() error\n");
+      close(io_fd[i]);
+      return(i);
+    }
+    nr = read(io_fd[i], status, 12);
+    if ((nr < 12) || (memcmp(status, "HTTP/1.1 200", 12) != 0)) {
+      fprintf(stderr, "listen_up: listener %u not subscribed, is tunerd -c large enough?\n", i);
+      close(io_fd[i]);
+      return(i);
+    }
+  }
+
+  return(in_count);
+}
+
+
+/**********/
+/* main() */
+/**********/
+int
+main(
+ int argc,
+ char *argv[])
+{
+const char req[] = "GET / HTTP/1.1\r\n\r\n";
+const char *host = "127.0.0.1";
+const char *levels = LEVELS;
+const char *p = NULL;
+char label[32];
+char buf[8192];
+unsigned long *us = NULL;
+unsigned long long t = 0;
+unsigned int level[MAXLEVELS];
+unsigned int nlevels = 0;
+unsigned int have = 0;
+unsigned int rounds = 2000;
+unsigned int i = 0;
+unsigned int k = 0;
+int *fd = NULL;
+int port = 80;
+int active = 0;
+char *ep = NULL;
+int opt = 0;
+
+  while ((opt = getopt(argc, argv, "h:p:n:r:")) != (-1)) {
+    switch (opt) {
+      case 'h':
+        host = optarg;
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 'n':
+        levels = optarg;
+        break;
+      case 'r':
+        rounds = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "usage: wakebench [-h host] [-p port] [-n levels] [-r requests]\n");
+        return(EXIT_FAILURE);
+    }
+  }
+
+  /* levels, rising */
+  p = levels;
+  while ((*p != '\0') && (nlevels < MAXLEVELS)) {
+    level[nlevels] = (unsigned int)strtoul(p, &ep, 10);
+    if ((ep == p) || ((*ep != ',') && (*ep != '\0')) ||
+     ((nlevels > 0) && (level[nlevels] <= level[nlevels - 1]))) {
+      fprintf(stderr, "main: -n takes rising levels, such as %s\n", LEVELS);
+      return(EXIT_FAILURE);
+    }
+    nlevels += 1;
+    p = (*ep == ',') ? ep + 1 : ep;
+  }
+  if ((nlevels == 0) || (rounds == 0)) {
+    fprintf(stderr, "main: nothing to do\n");
+    return(EXIT_FAILURE);
+  }
+
+  load_nofile(level[nlevels - 1] + 16);
+  fd = malloc(sizeof(int) * level[nlevels - 1]);
+  us = malloc(sizeof(unsigned long) * rounds);
+  if ((fd == NULL) || (us == NULL)) {
+    fprintf(stderr, "main: malloc() error\n");
+    return(EXIT_FAILURE);
+  }
+
+  for (k = 0; k < nlevels; k++) {
+    have = listen_up(host, port, fd, have, level[k]);
+    if (have < level[k]) {
+      return(EXIT_FAILURE);
+    }
+
+    /* a new connection, opening the listeners may take */
+    /*  longer than an idle keep-alive one is kept */
+    active = load_connect(host, port, have, 0);
+    if (active == (-1)) {
+      return(EXIT_FAILURE);
+    }
+    for (i = 0; i < rounds; i++) {
+      t = load_now();
+      if ((load_send(active, req, strlen(req)) == (-1)) ||
+       (load_response(active, buf, sizeof(buf)) != 200)) {
+        fprintf(stderr, "main: GET / failed\n");
+        return(EXIT_FAILURE);
+      }
+      us[i] = (unsigned long)(load_now() - t);
+    }
+    close(active);
+    snprintf(label, sizeof(label), "%u idle", have);
+    load_report(label, us, rounds);
+  }
+
+  for (i = 0; i < have; i++) close(fd[i]);
+  free(fd);
+  free(us);
+
+  return(EXIT_SUCCESS);
+}
@@ -0,0 +1,389 @@
+/* tune_util.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Feature test switches */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+/* POSIX headers */
+/*  POSIX Issue 5 */
+#include <pthread.h>
+
+/* Local headers */
+#include "radio_util.h"
+#include "scan_util.h"
+#include "tune_util.h"
+
+/* Macros */
+/* quiet time, in milliseconds, after a press before the tuner is set, */
+/*  presses closer together than this are tuned once, for the last */
+#ifndef TUNE_SETTLE
+#define TUNE_SETTLE 150
+#endif
+
+/* longest, in milliseconds, a wanted frequency waits for quiet, */
+/*  so a stream of presses still tunes */
+#ifndef TUNE_HOLD
+#define TUNE_HOLD 1000
+#endif
+
+/* File scope variables */
+/*  the slot, guarded by tune_lock */
+static pthread_mutex_t tune_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tune_cond;
+static unsigned long tune_kHz = 0;
+static int tune_new = 0;  /* tune_kHz is not yet taken by the thread */
+static int tune_stop = 0;
+static int tune_scanning = 0; /* 1 to start, 2 under way */
+static void (*scan_progress)(const struct scan_sample *, unsigned int, unsigned int) = NULL;
+static void (*scan_done)(int) = NULL;
+static void (*tune_job)(void) = NULL; /* run every tune_every_ms, when idle */
+static unsigned int tune_every_ms = 0;
+static struct timespec tune_due;
+
+/*  set by tune_init(), then only used by the tuning thread */
+static void (*tune_locked)(unsigned long, int) = NULL;
+static pthread_t tune_tid;
+static int tune_running = 0;
+static unsigned long tune_home = 0; /* last tuned for a want */
+
+/* External variables */
+/* External functions */
+/* Structures and unions */
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+/****************/
+/* tune_after() */
+/****************/
+/* in_ts moved in_ms later */
+static void
+tune_after(
+ struct timespec *io_ts,
+ long in_ms)
+{
+  io_ts->tv_sec += in_ms / 1000;
+  io_ts->tv_nsec += (in_ms % 1000) * 1000000L;
+  if (io_ts->tv_nsec >= 1000000000L) {
+    io_ts->tv_sec += 1;
+    io_ts->tv_nsec -= 1000000000L;
+  }
+}
+
+
+/*****************/
+/* tune_before() */
+/*****************/
+/* return: 1 in_a is before in_b, 0 not */
+static int
+tune_before(
+ const struct timespec *in_a,
+ const struct timespec *in_b)
+{
+  if (in_a->tv_sec != in_b->tv_sec) return(in_a->tv_sec < in_b->tv_sec);
+  return(in_a->tv_nsec < in_b->tv_nsec);
+}
+
+
+/********************/
+/* tune_scan_step() */
+/********************/
+/* one step of a band scan, called with tune_lock held, */
+/*  which is let go while the tuner is busy */
+/*  at the end, the tuner goes back to the station it was on */
+static void
+tune_scan_step(void)
+{
+struct scan_sample sample;
+int status = 0;
+
+  if (tune_scanning == 1) {
+    scan_start();
+    tune_scanning = 2;
+  }
+
+  pthread_mutex_unlock(&tune_lock);
+  status = scan_step(&sample);
+  if (status != (-1)) {
+    scan_progress(&sample, scan_at(), scan_steps());
+  }
+  pthread_mutex_lock(&tune_lock);
+
+  if (status == 1) return;
+
+  tune_scanning = 0;
+  pthread_mutex_unlock(&tune_lock);
+  if (tune_home != 0) {
+    tune_locked(tune_home, radio_frequency(tune_home));
+  }
+  scan_done((status == 0) ? 1 : (-1));
+  pthread_mutex_lock(&tune_lock);
+}
+
+
+/*****************/
+/* tune_thread() */
+/*****************/
+/* thread start routine, tunes what is wanted until tune_end() */
+/*  and scans the band, a step at a time, when asked */
+/*  with nothing else to do, runs the job of tune_every() when due */
+static void *
+tune_thread(
+ void *in_arg)
+{
+struct timespec hold;
+struct timespec quiet;
+struct timespec now;
+unsigned long kHz = 0;
+int status = 0;
+
+  pthread_mutex_lock(&tune_lock);
+  for (;;) {
+    while (!tune_new && !tune_scanning && !tune_stop) {
+      if (tune_job == NULL) {
+        pthread_cond_wait(&tune_cond, &tune_lock);
+        continue;
+      }
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if (!tune_before(&now, &tune_due)) break;
+      pthread_cond_timedwait(&tune_cond, &tune_lock, &tune_due);
+    }
+    if (tune_stop) break;
+
+    if (!tune_new && !tune_scanning) {
+      /* the next is due a period after this one ends, not before */
+      pthread_mutex_unlock(&tune_lock);
+      tune_job();
+      pthread_mutex_lock(&tune_lock);
+      clock_gettime(CLOCK_MONOTONIC, &tune_due);
+      tune_after(&tune_due, tune_every_ms);
+      continue;
+    }
+
+    if (!tune_new) {
+      tune_scan_step();
+      continue;
+    }
+
+    /* a press is someone wanting to listen, the scan is given up */
+    if (tune_scanning) {
+      tune_scanning = 0;
+      pthread_mutex_unlock(&tune_lock);
+      scan_done(0);
+      pthread_mutex_lock(&tune_lock);
+    }
+
+    /* wait for the presses to stop, a newer want restarts the wait */
+    clock_gettime(CLOCK_MONOTONIC, &hold);
+    tune_after(&hold, TUNE_HOLD);
+    do {
+      tune_new = 0;
+      clock_gettime(CLOCK_MONOTONIC, &quiet);
+      tune_after(&quiet, TUNE_SETTLE);
+      if (tune_before(&hold, &quiet)) quiet = hold;
+      status = 0;
+      while (!tune_new && !tune_stop && (status != ETIMEDOUT)) {
+        status = pthread_cond_timedwait(&tune_cond, &tune_lock, &quiet);
+      }
+    } while (tune_new && !tune_stop && (status != ETIMEDOUT));
+    if (tune_stop) break;
+    tune_new = 0;
+    kHz = tune_kHz;
+
+    /* the event loops post wants while the tuner is set */
+    pthread_mutex_unlock(&tune_lock);
+    status = radio_frequency(kHz);
+    if (status == 0) tune_home = kHz;
+    tune_locked(kHz, status);
+    pthread_mutex_lock(&tune_lock);
+  }
+  pthread_mutex_unlock(&tune_lock);
+
+  return(NULL);
+}
+
+
+/***************/
+/* tune_init() */
+/***************/
+/* start the tuning thread, with the tuner set to in_kHz */
+/*  in_locked(kHz, status) is called on it */
+/*  after each setting of the tuner, status 0 set, -1 error */
+/*  once, before worker threads, so no signal reaches its thread */
+/* return: 0 on success, -1 error */
+int
+tune_init(
+ unsigned long in_kHz,
+ void (*in_locked)(unsigned long, int))
+{
+pthread_condattr_t attr;
+sigset_t block;
+sigset_t old;
+int status = 0;
+
+  if (tune_running) {
+    fprintf(stderr, "tune_init: repeat call\n");
+    return(-1);
+  }
+  tune_home = in_kHz;
+  tune_locked = in_locked;
+
+  /* timed waits measured on the monotonic clock, */
+  /*  so setting the date does not stretch them */
+  pthread_condattr_init(&attr);
+  if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0) {
+    fprintf(stderr, "tune_init: pthread_condattr_setclock() error\n");
+    pthread_condattr_destroy(&attr);
+    return(-1);
+  }
+  status = pthread_cond_init(&tune_cond, &attr);
+  pthread_condattr_destroy(&attr);
+  if (status != 0) {
+    fprintf(stderr, "tune_init: pthread_cond_init() error\n");
+    return(-1);
+  }
+
+  /* SIGINT and SIGTERM are for the main thread */
+  sigemptyset(&block);
+  sigaddset(&block, SIGINT);
+  sigaddset(&block, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &block, &old);
+  status = pthread_create(&tune_tid, NULL, tune_thread, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (status != 0) {
+    fprintf(stderr, "tune_init: pthread_create() error\n");
+    pthread_cond_destroy(&tune_cond);
+    return(-1);
+  }
+  tune_running = 1;
+
+  return(0);
+}
+
+
+/***************/
+/* tune_want() */
+/***************/
+/* ask for in_kHz to be tuned, replacing a frequency not yet taken */
+/*  returns at once, without waiting on the tuner */
+void
+tune_want(
+ unsigned long in_kHz)
+{
+  pthread_mutex_lock(&tune_lock);
+  tune_kHz = in_kHz;
+  tune_new = 1;
+  pthread_cond_signal(&tune_cond);
+  pthread_mutex_unlock(&tune_lock);
+}
+
+
+/***************/
+/* tune_scan() */
+/***************/
+/* scan the band on the tuning thread, in_progress(sample, step, steps) */
+/*  is called after each step, then in_done(status) once, status 1 done, */
+/*  0 given up for a press, -1 error, both on that thread */
+/* return: 0 started, 1 a scan is already under way */
+int
+tune_scan(
+ void (*in_progress)(const struct scan_sample *, unsigned int, unsigned int),
+ void (*in_done)(int))
+{
+int status = 1;
+
+  pthread_mutex_lock(&tune_lock);
+  if (!tune_scanning) {
+    scan_progress = in_progress;
+    scan_done = in_done;
+    tune_scanning = 1;
+    pthread_cond_signal(&tune_cond);
+    status = 0;
+  }
+  pthread_mutex_unlock(&tune_lock);
+
+  return(status);
+}
+
+
+/****************/
+/* tune_every() */
+/****************/
+/* run in_job() on the tuning thread every in_ms milliseconds, */
+/*  when it is not tuning or scanning, in_ms 0 for never */
+/*  such as reading the tuner, which only that thread may do */
+void
+tune_every(
+ unsigned int in_ms,
+ void (*in_job)(void))
+{
+  pthread_mutex_lock(&tune_lock);
+  tune_every_ms = in_ms;
+  tune_job = (in_ms > 0) ? in_job : NULL;
+  clock_gettime(CLOCK_MONOTONIC, &tune_due);
+  pthread_cond_signal(&tune_cond);
+  pthread_mutex_unlock(&tune_lock);
+}
+
+
+/******************/
+/* tune_pending() */
+/******************/
+/* return: 1 a wanted frequency is waiting to be tuned, 0 not */
+int
+tune_pending(void)
+{
+int pending = 0;
+
+  pthread_mutex_lock(&tune_lock);
+  pending = tune_new;
+  pthread_mutex_unlock(&tune_lock);
+
+  return(pending);
+}
+
+
+/**************/
+/* tune_end() */
+/**************/
+/* stop the thread, waits for a setting in progress */
+/*  a frequency wanted but not yet taken is dropped */
+void
+tune_end(void)
+{
+  if (!tune_running) return;
+
+  pthread_mutex_lock(&tune_lock);
+  tune_stop = 1;
+  pthread_cond_signal(&tune_cond);
+  pthread_mutex_unlock(&tune_lock);
+
+  pthread_join(tune_tid, NULL);
+  pthread_cond_destroy(&tune_cond);
+  tune_running = 0;
+}
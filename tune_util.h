@@ -0,0 +1,43 @@
+/* tune_util.h */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* tunes the radio on a thread of its own, so no event loop waits on it */
+/*  the frequency wanted is one slot, a newer one replaces it, */
+/*  so of quick presses only the last is tuned */
+/*  the band is scanned on it too, between wants, */
+/*  and a periodic job run when it is idle */
+/*  once tune_init() has run, only its thread uses radio_util */
+
+#ifndef tune_util_h
+#define tune_util_h
+
+#include "scan_util.h"
+
+int tune_init(unsigned long in_kHz, void (*in_locked)(unsigned long, int));
+
+void tune_want(unsigned long in_kHz);
+
+int tune_scan(void (*in_progress)(const struct scan_sample *, unsigned int, unsigned int), void (*in_done)(int));
+
+void tune_every(unsigned int in_ms, void (*in_job)(void));
+
+int tune_pending(void);
+
+void tune_end(void);
+
+#endif
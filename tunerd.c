@@ -26,37 +26,210 @@
 #include <string.h>
 
 /* POSIX headers */
+/*  issue 5 */
+#include <pthread.h>
 
 /* Local headers */
 #include "sckt_util.h"
+#include "evnt_util.h"
 #include "http_util.h"
 #include "sse_util.h"
 #include "mix_util.h"
 #include "radio_util.h"
+#include "scan_util.h"
+#include "tune_util.h"
+#include "meter_util.h"
 #include "presets.h"
+#include "watch_util.h"
 
 /* Macros */
-#define MAXSSE 32
+/* watched for changes to the files served and the presets */
+#ifndef WATCHDIR
+#define WATCHDIR "/var/tunerd"
+#endif
+
+/* percent of the connection limit in use, */
+/*  from which new listeners are asked to come back later, */
+/*  so what is left serves the other requests */
+#ifndef LISTENLOAD
+#define LISTENLOAD 90
+#endif
+
+/* most presets a band scan keeps, the strongest stations */
+#ifndef SCANPRESETS
+#define SCANPRESETS 20
+#endif
+
+/* change in signal, 0 to 100, that is pushed to listeners, */
+/*  smaller ones are only kept in the history */
+#ifndef SIGNALDELTA
+#define SIGNALDELTA 10
+#endif
+
+/* points of a signal history, by default and at most */
+#ifndef SIGNALPOINTS
+#define SIGNALPOINTS 60
+#endif
+#ifndef SIGNALPOINTSMAX
+#define SIGNALPOINTSMAX 600
+#endif
+
+/* what a listener subscribed to is sent on connecting */
+#define LISTEN_FREQ   0x01
+#define LISTEN_TUNING 0x02
+#define LISTEN_LOCKED 0x04
+#define LISTEN_SIGNAL 0x08
 
 /* File scope variables */
+/* the tuner is shared by all worker threads, */
+/*  tunerd_lock guards radio_freq, tuned_freq and the presets */
+/*  radio_freq is the station chosen, tuned_freq the one the tuner */
+/*  last locked on, they differ while the tuning thread catches up */
+static pthread_mutex_t tunerd_lock = PTHREAD_MUTEX_INITIALIZER;
 static long radio_freq = 0;
+static long tuned_freq = 0;
+
+/* each worker has its own topics for its own listeners */
+static EVNT_LOCAL int sse_topic_freq = (-1);
+static EVNT_LOCAL int sse_topic_tuning = (-1);
+static EVNT_LOCAL int sse_topic_locked = (-1);
+static EVNT_LOCAL int sse_topic_reload = (-1);
+static EVNT_LOCAL int sse_topic_scan = (-1);
+static EVNT_LOCAL int sse_topic_signal = (-1);
 
-static int sse_desc_freq;
+/* the reading last pushed to listeners, tuning thread only */
+static int signal_told = 0;
+static unsigned long signal_kHz = 0;
+static int signal_level = 0;
+static int signal_stereo = 0;
 
 /* External variables */
 /* External functions */
 /* Structures and unions */
+/* events posted to every worker, one id for all copies */
+struct freq_event_struct {
+ unsigned long long id;
+ long freq;
+};
+struct reload_event_struct {
+ unsigned long long id;
+ char what[32];
+};
+struct text_event_struct {
+ unsigned long long id;
+ char data[96];
+};
+
 /* Signal catching functions */
 
 
 /* Functions */
 
 
+/****************/
+/* sse_listen() */
+/****************/
+/* make in_fd a listener of the topics subscribed to by the caller, */
+/*  in_state the LISTEN_ flags of the frequency topics among them */
+/*  a listener that reconnects with Last-Event-ID is sent */
+/*  what it missed, or the current state if that is gone */
+/* as a HTTP callback function: */
+/*  return:  0 for close socket */
+/*          -1 keep alive socket */
+static int
+sse_listen(
+ int in_fd,
+ int in_state)
+{
+char message[128];
+char last[24];
+const char *hv = NULL;
+char *ep = NULL;
+unsigned long long last_id = 0;
+unsigned int hv_len = 0;
+struct meter_sample sample;
+long freq = 0;
+long tuned = 0;
+
+  /* send HTTP header and data (reference/standard for text/event-stream allows single LF) */
+  /* the queue keeps the default policy, EVNT_DROP: latest-value topics */
+  /*  coalesce in their shared frame, while the queued bytes, the reload */
+  /*  events, a replay and the snapshots below, must all arrive */
+
+  /* with its own time to wait, should it lose the connection */
+  snprintf(message, sizeof(message), "HTTP/1.1 200 OK\r\nConnection: keep-alive\r\nContent-Type: text/event-stream\r\n\r\n"
+   "retry: %u\n\n", sse_retry());
+  evnt_send(in_fd, message, strlen(message));
+
+  hv = http_header(in_fd, "Last-Event-ID", &hv_len);
+  if ((hv != NULL) && (hv_len > 0) && (hv_len < sizeof(last))) {
+    memcpy(last, hv, hv_len);
+    last[hv_len] = '\0';
+    last_id = strtoull(last, &ep, 10);
+    if ((*ep == '\0') && (sse_replay(in_fd, last_id) == 0)) {
+      return(-1);
+    }
+  }
+
+  /* a change posted after this read also reaches this listener, */
+  /*  as this worker's mailbox is read after the handler returns */
+  /*  a reload has no state, only the frequencies are sent */
+  pthread_mutex_lock(&tunerd_lock);
+  freq = radio_freq;
+  tuned = tuned_freq;
+  pthread_mutex_unlock(&tunerd_lock);
+  snprintf(message, sizeof(message), "%ld", freq);
+  if (in_state & LISTEN_FREQ) {
+    sse_snapshot(sse_topic_freq, in_fd, message);
+  }
+  if (in_state & LISTEN_TUNING) {
+    sse_snapshot(sse_topic_tuning, in_fd, message);
+  }
+  if (in_state & LISTEN_LOCKED) {
+    snprintf(message, sizeof(message), "%ld", tuned);
+    sse_snapshot(sse_topic_locked, in_fd, message);
+  }
+  /*  the newest reading, read from the meter without a lock */
+  if ((in_state & LISTEN_SIGNAL) && (meter_get(&sample, 1) == 1)) {
+    snprintf(message, sizeof(message), "kHz=%lu signal=%d stereo=%d",
+     sample.kHz, sample.signal, sample.stereo);
+    sse_snapshot(sse_topic_signal, in_fd, message);
+  }
+
+  /* return with code to keep socket alive (-1) */
+  return(-1);
+}
+
+
+/*****************/
+/* listen_busy() */
+/*****************/
+/* with the connection limit nearly reached, */
+/*  ask a new listener to come back later */
+/* return: 1 asked, 0 room for it */
+static int
+listen_busy(
+ int in_fd)
+{
+char message[128];
+
+  if (evnt_load() < LISTENLOAD) {
+    return(0);
+  }
+
+  snprintf(message, sizeof(message), "HTTP/1.1 503 Service Unavailable\r\nRetry-After: %u\r\n"
+   "Content-Length: 0\r\nConnection: close\r\n\r\n", evnt_retry_after());
+  evnt_send(in_fd, message, strlen(message));
+
+  return(1);
+}
+
+
 /**************/
 /* get_freq() */
 /**************/
 /* handles HTTP request GET freq */
-/*  with Server Sent Events (SSE) */
+/*  with Server Sent Events (SSE), of the topics freq and reload */
 /* as a HTTP callback function: */
 /*  return:  0 for close socket */
 /*          -1 keep alive socket */
@@ -65,30 +238,414 @@ get_freq(
  const char *in_req,
  int in_fd)
 {
-char message[128];
-int status = 0;
+  if (listen_busy(in_fd)) {
+    return(0);
+  }
 
-  /* add socket to SSE listeners */
-  if (sse_desc_freq == (-1)) {
-    sse_desc_freq = sse_new(in_fd);
-    if (sse_desc_freq == (-1)) {
-      fprintf(stderr, "get_freq: error in sse_new\n");
-      return(0);
-    }
-  } else {
-    status = sse_add(sse_desc_freq, in_fd);
-    if (status == (-1)) {
-      fprintf(stderr, "get_freq: error in sse_add\n");
+  if ((sse_sub(sse_topic_freq, in_fd) == (-1)) ||
+   (sse_sub(sse_topic_reload, in_fd) == (-1))) {
+    fprintf(stderr, "get_freq: error in sse_sub\n");
+    return(0);
+  }
+
+  return(sse_listen(in_fd, LISTEN_FREQ));
+}
+
+
+/****************/
+/* get_events() */
+/****************/
+/* handles HTTP request GET events?topics=name,name */
+/*  with Server Sent Events (SSE), of the topics named */
+/*  names not known are skipped, with none known it is not found */
+/* as a HTTP callback function: */
+/*  return:  0 for close socket */
+/*          -1 keep alive socket */
+/*           1 answered, socket may serve another request */
+int
+get_events(
+ const char *in_req,
+ int in_fd)
+{
+const char *v = NULL;
+const char *comma = NULL;
+const char *end = NULL;
+unsigned int len = 0;
+int topic = 0;
+int count = 0;
+int state = 0;
+
+  if (listen_busy(in_fd)) {
+    return(0);
+  }
+
+  v = http_query(in_fd, "topics", &len);
+  if (v == NULL) {
+    return(http_404(in_req, in_fd));
+  }
+
+  for (end = v + len; v < end; v = comma + 1) {
+    comma = memchr(v, ',', end - v);
+    if (comma == NULL) comma = end;
+    topic = sse_topic(v, comma - v);
+    if (topic == (-1)) continue;
+    if (sse_sub(topic, in_fd) == (-1)) {
+      fprintf(stderr, "get_events: error in sse_sub\n");
       return(0);
     }
+    count += 1;
+    if (topic == sse_topic_freq) state |= LISTEN_FREQ;
+    if (topic == sse_topic_tuning) state |= LISTEN_TUNING;
+    if (topic == sse_topic_locked) state |= LISTEN_LOCKED;
+    if (topic == sse_topic_signal) state |= LISTEN_SIGNAL;
   }
 
-  /* send HTTP header and data (reference/standard for text/event-stream allows single LF) */
-  snprintf(message, 128, "HTTP/1.1 200 OK\r\nConnection: keep-alive\r\nContent-Type: text/event-stream\r\n\r\ndata: %ld\n\n", radio_freq);
-  sckt_write(in_fd, message, strlen(message));
+  if (count == 0) {
+    return(http_404(in_req, in_fd));
+  }
 
-  /* return with code to keep socket alive (-1) */
-  return(-1);
+  return(sse_listen(in_fd, state));
+}
+
+
+/*******************/
+/* get_freq_wait() */
+/*******************/
+/* handles HTTP request GET freq/wait?since=id */
+/*  long-poll, for browsers without EventSource */
+/*  answered with the frequency as soon as it is newer than id, */
+/*  parked until it is, or told after a while nothing changed */
+/* as a HTTP callback function: */
+/*  return:  0 for close socket */
+/*          -1 keep alive socket */
+/*           1 answered, socket may serve another request */
+int
+get_freq_wait(
+ const char *in_req,
+ int in_fd)
+{
+char data[32];
+char since[24];
+const char *v = NULL;
+char *ep = NULL;
+unsigned long long since_id = 0;
+unsigned int len = 0;
+int status = 0;
+long freq = 0;
+
+  if (listen_busy(in_fd)) {
+    return(0);
+  }
+
+  v = http_query(in_fd, "since", &len);
+  if ((v != NULL) && (len > 0) && (len < sizeof(since))) {
+    memcpy(since, v, len);
+    since[len] = '\0';
+    since_id = strtoull(since, &ep, 10);
+    if (*ep != '\0') since_id = 0;
+  }
+
+  /* as for a listener, a change posted after this read */
+  /*  is seen by the request, parked or not */
+  pthread_mutex_lock(&tunerd_lock);
+  freq = radio_freq;
+  pthread_mutex_unlock(&tunerd_lock);
+  snprintf(data, sizeof(data), "%ld", freq);
+
+  status = sse_wait(sse_topic_freq, in_fd, since_id, data);
+  if (status == (-1)) {
+    fprintf(stderr, "get_freq_wait: error in sse_wait\n");
+    return(0);
+  }
+
+  return((status == 1) ? (-1) : 1);
+}
+
+
+/******************/
+/* freq_changed() */
+/******************/
+/* posted to every worker, with the frequency chosen */
+/*  sends it to the worker's own SSE listeners, before it is tuned */
+static void
+freq_changed(
+ void *in_arg)
+{
+struct freq_event_struct *ev = in_arg;
+char data[32];
+
+  snprintf(data, sizeof(data), "%ld", ev->freq);
+  sse_event(sse_topic_freq, ev->id, data);
+  sse_event(sse_topic_tuning, ev->id, data);
+}
+
+
+/********************/
+/* locked_changed() */
+/********************/
+/* posted to every worker, with the frequency the tuner is on */
+static void
+locked_changed(
+ void *in_arg)
+{
+struct freq_event_struct *ev = in_arg;
+char data[32];
+
+  snprintf(data, sizeof(data), "%ld", ev->freq);
+  sse_event(sse_topic_locked, ev->id, data);
+}
+
+
+/*******************/
+/* tunerd_locked() */
+/*******************/
+/* on the tuning thread, after the tuner was set to in_kHz */
+/*  listeners are told the frequency it is on, unless a newer one */
+/*  is already wanted, then only that one's locking is told */
+/*  after an error the tuner is taken to be where it was */
+static void
+tunerd_locked(
+ unsigned long in_kHz,
+ int in_status)
+{
+struct freq_event_struct ev;
+
+  pthread_mutex_lock(&tunerd_lock);
+  if (in_status == 0) {
+    tuned_freq = (long)in_kHz;
+  }
+  /* a want is only added under the lock, so none slips in between */
+  if (!tune_pending()) {
+    ev.id = sse_next_id();
+    ev.freq = tuned_freq;
+    evnt_post_all(locked_changed, &ev, sizeof(ev));
+  }
+  pthread_mutex_unlock(&tunerd_lock);
+}
+
+
+/********************/
+/* reload_changed() */
+/********************/
+/* posted to every worker, with what was reloaded */
+/*  tells the worker's own SSE listeners, so pages can refresh */
+static void
+reload_changed(
+ void *in_arg)
+{
+struct reload_event_struct *ev = in_arg;
+
+  sse_event(sse_topic_reload, ev->id, ev->what);
+}
+
+
+/******************/
+/* scan_changed() */
+/******************/
+/* posted to every worker, with the progress of a band scan */
+static void
+scan_changed(
+ void *in_arg)
+{
+struct text_event_struct *ev = in_arg;
+
+  sse_event(sse_topic_scan, ev->id, ev->data);
+}
+
+
+/*****************/
+/* scan_report() */
+/*****************/
+/* tell the listeners of the scan topic in_data */
+/*  posted under the lock, in order with the other events */
+static void
+scan_report(
+ const char *in_data)
+{
+struct text_event_struct ev;
+
+  snprintf(ev.data, sizeof(ev.data), "%s", in_data);
+  pthread_mutex_lock(&tunerd_lock);
+  ev.id = sse_next_id();
+  evnt_post_all(scan_changed, &ev, sizeof(ev));
+  pthread_mutex_unlock(&tunerd_lock);
+}
+
+
+/**********************/
+/* tunerd_scan_step() */
+/**********************/
+/* on the tuning thread, after each frequency of a band scan */
+static void
+tunerd_scan_step(
+ const struct scan_sample *in_sample,
+ unsigned int in_step,
+ unsigned int in_steps)
+{
+char data[96];
+
+  snprintf(data, sizeof(data), "step=%u of=%u kHz=%lu signal=%d stereo=%d",
+   in_step, in_steps, in_sample->kHz, in_sample->signal, in_sample->stereo);
+  scan_report(data);
+}
+
+
+/********************/
+/* tunerd_scanned() */
+/********************/
+/* on the tuning thread, once a band scan has ended */
+/*  the stations found are written as the presets, and take effect */
+/*  at once, the watcher's reload of the file then finds no change */
+static void
+tunerd_scanned(
+ int in_status)
+{
+struct reload_event_struct ev;
+char data[96];
+long *preset = NULL;
+unsigned int count = 0;
+int presets = 0;
+
+  if (in_status != 1) {
+    fprintf(stderr, "tunerd_scanned: scan %s\n", (in_status == 0) ? "cancelled" : "failed");
+    scan_report((in_status == 0) ? "cancelled" : "error");
+    return;
+  }
+
+  preset = (long*) malloc(sizeof(long) * SCANPRESETS);
+  if (preset == NULL) {
+    fprintf(stderr, "tunerd_scanned: malloc() error\n");
+    scan_report("error");
+    return;
+  }
+  count = scan_stations(preset, SCANPRESETS);
+  fprintf(stderr, "tunerd_scanned: %u stations found\n", count);
+
+  /* an empty band, most likely no antenna, leaves the presets alone */
+  if ((count == 0) || (presets_save(preset, (unsigned short)count) == (-1))) {
+    free(preset);
+    snprintf(data, sizeof(data), "done stations=%u saved=0", count);
+    scan_report(data);
+    return;
+  }
+
+  pthread_mutex_lock(&tunerd_lock);
+  presets = presets_swap(preset, SCANPRESETS, (unsigned short)count);
+  if (presets == 1) {
+    ev.id = sse_next_id();
+    snprintf(ev.what, sizeof(ev.what), "presets");
+    evnt_post_all(reload_changed, &ev, sizeof(ev));
+  }
+  pthread_mutex_unlock(&tunerd_lock);
+
+  snprintf(data, sizeof(data), "done stations=%u saved=1", count);
+  scan_report(data);
+}
+
+
+/********************/
+/* signal_changed() */
+/********************/
+/* posted to every worker, with a new reading of the tuner's signal */
+static void
+signal_changed(
+ void *in_arg)
+{
+struct text_event_struct *ev = in_arg;
+
+  sse_event(sse_topic_signal, ev->id, ev->data);
+}
+
+
+/*******************/
+/* tunerd_sample() */
+/*******************/
+/* on the tuning thread, every -s milliseconds it is not busy */
+/*  each reading goes into the meter's history, and to the listeners */
+/*  when it is another station, stereo came or went, */
+/*  or the signal moved by SIGNALDELTA or more since last told */
+/*  a tuner that cannot tell the signal gives no reading at all */
+static void
+tunerd_sample(void)
+{
+struct text_event_struct ev;
+unsigned long kHz = 0;
+int signal = 0;
+int stereo = 0;
+
+  if ((radio_signal(&signal, &stereo) == (-1)) || (signal < 0)) {
+    return;
+  }
+  pthread_mutex_lock(&tunerd_lock);
+  kHz = (unsigned long)tuned_freq;
+  pthread_mutex_unlock(&tunerd_lock);
+
+  meter_put(kHz, signal, stereo);
+
+  if (signal_told && (kHz == signal_kHz) && (stereo == signal_stereo) &&
+   (signal > signal_level - SIGNALDELTA) && (signal < signal_level + SIGNALDELTA)) {
+    return;
+  }
+  signal_told = 1;
+  signal_kHz = kHz;
+  signal_level = signal;
+  signal_stereo = stereo;
+
+  snprintf(ev.data, sizeof(ev.data), "kHz=%lu signal=%d stereo=%d", kHz, signal, stereo);
+  pthread_mutex_lock(&tunerd_lock);
+  ev.id = sse_next_id();
+  evnt_post_all(signal_changed, &ev, sizeof(ev));
+  pthread_mutex_unlock(&tunerd_lock);
+}
+
+
+/*****************/
+/* tunerd_want() */
+/*****************/
+/* return: 1 in_name is a file tunerd reloads when it changes, 0 not */
+static int
+tunerd_want(
+ const char *in_name)
+{
+  return(http_served(in_name) || presets_file(in_name));
+}
+
+
+/*******************/
+/* tunerd_reload() */
+/*******************/
+/* on the watcher thread, after files in the directory changed */
+/*  each table is built aside, then swapped in, */
+/*  and listeners are told when anything differs */
+static void
+tunerd_reload(void)
+{
+struct reload_event_struct ev;
+long *preset = NULL;
+unsigned short size = 0;
+unsigned short count = 0;
+int files = 0;
+int presets = 0;
+
+  files = http_reload();
+
+  if (presets_load(&preset, &size, &count) == 0) {
+    pthread_mutex_lock(&tunerd_lock);
+    presets = presets_swap(preset, size, count);
+    pthread_mutex_unlock(&tunerd_lock);
+  }
+
+  if ((files != 1) && (presets != 1)) return;
+
+  snprintf(ev.what, sizeof(ev.what), "%s%s%s", (files == 1) ? "files" : "",
+   ((files == 1) && (presets == 1)) ? " " : "", (presets == 1) ? "presets" : "");
+  fprintf(stderr, "tunerd_reload: %s reloaded\n", ev.what);
+
+  /* posted under the lock, in order with frequency changes */
+  pthread_mutex_lock(&tunerd_lock);
+  ev.id = sse_next_id();
+  evnt_post_all(reload_changed, &ev, sizeof(ev));
+  pthread_mutex_unlock(&tunerd_lock);
 }
 
 
@@ -98,38 +655,180 @@ int status = 0;
 /* as a HTTP callback function: */
 /*  return:  0 for close socket */
 /*          -1 keep alive socket */
+/*           1 answered, socket may serve another request */
 int
 post_preset(
  const char *in_req,
  int in_fd)
 {
-char HTTP_resp[] = "HTTP/1.1 204 No Content\r\nConnection: close\r\n\r\n";
-char data_message[64];
+char HTTP_resp[] = "HTTP/1.1 204 No Content\r\n\r\n";
+struct freq_event_struct ev;
+
+  pthread_mutex_lock(&tunerd_lock);
 
   /* get next preset */
   radio_freq = presets_next();
 
-  /* set the radio device frequency */
-  radio_frequency(radio_freq);
+  /* send updated frequency to all SSE listeners, on every worker */
+  /*  posted under the lock so every worker sees changes in one order */
+  ev.id = sse_next_id();
+  ev.freq = radio_freq;
+  evnt_post_all(freq_changed, &ev, sizeof(ev));
 
-  /* send updated frequency to all SSE listeners */
-  snprintf(data_message, 64, "data: %ld\n\n", radio_freq);
-  sse_send(sse_desc_freq, data_message, 0);
+  /* the tuning thread sets the radio device frequency, */
+  /*  and tells the listeners when it has locked on */
+  /*  wanted under the lock, so presses are tuned in their order */
+  tune_want((unsigned long)radio_freq);
+
+  pthread_mutex_unlock(&tunerd_lock);
 
   /* send a valid response to this POST connection */
-  sckt_write(in_fd, HTTP_resp, strlen(HTTP_resp));
+  evnt_send(in_fd, HTTP_resp, strlen(HTTP_resp));
 
-  /* close socket, by returning 0 */
-  return(0);
+  /* the client may send its next click on this connection */
+  return(1);
+}
+
+
+/***************/
+/* post_scan() */
+/***************/
+/* handles HTTP request POST scan */
+/*  starts a band scan on the tuning thread and answers at once, */
+/*  its progress goes to the listeners of the scan topic */
+/* as a HTTP callback function: */
+/*  return:  0 for close socket */
+/*          -1 keep alive socket */
+/*           1 answered, socket may serve another request */
+int
+post_scan(
+ const char *in_req,
+ int in_fd)
+{
+char HTTP_started[] = "HTTP/1.1 202 Accepted\r\nContent-Length: 0\r\n\r\n";
+char HTTP_running[] = "HTTP/1.1 409 Conflict\r\nContent-Length: 0\r\n\r\n";
+
+  if (tune_scan(tunerd_scan_step, tunerd_scanned) == 0) {
+    fprintf(stderr, "post_scan: band scan started\n");
+    evnt_send(in_fd, HTTP_started, strlen(HTTP_started));
+  } else {
+    evnt_send(in_fd, HTTP_running, strlen(HTTP_running));
+  }
+
+  return(1);
+}
+
+
+/************************/
+/* get_signal_history() */
+/************************/
+/* handles HTTP request GET signal/history?points=N&seconds=S */
+/*  the tuner's signal readings of the last S seconds (default all kept), */
+/*  taken together into at most N points (default SIGNALPOINTS) */
+/*  as JSON, oldest first, age in milliseconds */
+/*  read from the meter without a lock, the tuner is not touched */
+/* as a HTTP callback function: */
+/*  return:  0 for close socket */
+/*          -1 keep alive socket */
+/*           1 answered, socket may serve another request */
+int
+get_signal_history(
+ const char *in_req,
+ int in_fd)
+{
+struct meter_point *point = NULL;
+char head[160];
+char num[24];
+const char *v = NULL;
+char *ep = NULL;
+char *body = NULL;
+unsigned long long now = 0;
+unsigned long long since = 0;
+unsigned long n = 0;
+unsigned int len = 0;
+unsigned int points = SIGNALPOINTS;
+size_t size = 0;
+size_t used = 0;
+int count = 0;
+int i = 0;
+int w = 0;
+
+  v = http_query(in_fd, "points", &len);
+  if ((v != NULL) && (len > 0) && (len < sizeof(num))) {
+    memcpy(num, v, len);
+    num[len] = '\0';
+    n = strtoul(num, &ep, 10);
+    if ((*ep == '\0') && (n > 0)) points = (n > SIGNALPOINTSMAX) ? SIGNALPOINTSMAX : (unsigned int)n;
+  }
+  now = meter_now();
+  v = http_query(in_fd, "seconds", &len);
+  if ((v != NULL) && (len > 0) && (len < sizeof(num))) {
+    memcpy(num, v, len);
+    num[len] = '\0';
+    n = strtoul(num, &ep, 10);
+    if ((*ep == '\0') && (n > 0) && (n * 1000ULL < now)) since = now - n * 1000ULL;
+  }
+
+  /* a point is at most 59 bytes of names and punctuation, */
+  /*  two numbers of 20 digits, four of 11 and one of 10 */
+  point = malloc(sizeof(struct meter_point) * points);
+  size = 16 + (size_t)points * 160;
+  body = malloc(size);
+  if ((point == NULL) || (body == NULL)) {
+    fprintf(stderr, "get_signal_history: malloc() error\n");
+    free(point);
+    free(body);
+    return(0);
+  }
+  count = meter_series(point, points, since);
+  if (count == (-1)) {
+    free(point);
+    free(body);
+    return(0);
+  }
+
+  /* each part is checked to have fit before the next is added */
+  used = 0;
+  w = snprintf(body, size, "{\"points\":[");
+  for (i = 0; (i < count) && (w >= 0) && ((size_t)w < size - used); i++) {
+    used += (size_t)w;
+    w = snprintf(body + used, size - used,
+     "%s{\"age\":%llu,\"kHz\":%lu,\"signal\":%d,\"min\":%d,\"max\":%d,\"stereo\":%d,\"count\":%u}",
+     (i > 0) ? "," : "", (point[i].ms < now) ? now - point[i].ms : 0, point[i].kHz, point[i].signal,
+     point[i].min, point[i].max, point[i].stereo, point[i].count);
+  }
+  if ((w >= 0) && ((size_t)w < size - used)) {
+    used += (size_t)w;
+    w = snprintf(body + used, size - used, "]}\n");
+  }
+  if ((w < 0) || ((size_t)w >= size - used)) {
+    fprintf(stderr, "get_signal_history: body too long\n");
+    free(point);
+    free(body);
+    return(0);
+  }
+  used += (size_t)w;
+
+  snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+   "Cache-Control: no-store\r\nContent-Length: %lu\r\n\r\n", (unsigned long)used);
+  evnt_send(in_fd, head, strlen(head));
+  evnt_send(in_fd, body, used);
+
+  free(point);
+  free(body);
+
+  return(1);
 }
 
 
 /*****************/
 /* tunerd_init() */
 /*****************/
+/* in_sample_ms between readings of the tuner's signal, 0 for none */
 /* return: 0 on success, -1 error */
 int
-tunerd_init(void)
+tunerd_init(
+ unsigned int in_sample_ms)
 {
 
   /* initialize mixerctl settings */
@@ -139,16 +838,70 @@ tunerd_init(void)
   /* initalize radioctl settings */
   radio_init();
   radio_freq = 99500;
-  radio_frequency(radio_freq);
+  if (radio_frequency(radio_freq) == 0) {
+    tuned_freq = radio_freq;
+  }
 
-  presets_init();
+  /* from here the tuner is set on the tuning thread */
+  if (tune_init((unsigned long)tuned_freq, tunerd_locked) == (-1)) {
+    return(-1);
+  }
+  tune_every(in_sample_ms, tunerd_sample);
 
-  /* no SSE listeners yet */
-  sse_desc_freq = (-1);
+  presets_init();
 
   /* set HTTP callbacks */
   http_callback("GET", "/radio_freq", get_freq);
+  http_callback("GET", "/radio_freq/wait", get_freq_wait);
+  http_callback("GET", "/events", get_events);
   http_callback("POST", "/radio_preset", post_preset);
+  http_callback("POST", "/radio_scan", post_scan);
+  http_callback("GET", "/radio_signal/history", get_signal_history);
+
+  /* edits to root.html, other files and presets.txt take effect */
+  /*  without a restart, which would drop every listener */
+  if (watch_init(WATCHDIR, tunerd_want, tunerd_reload) == (-1)) {
+    fprintf(stderr, "tunerd_init: files are not watched for changes\n");
+  }
+
+  return(0);
+}
+
+
+/****************/
+/* tunerd_end() */
+/****************/
+/* after the workers have stopped, release the tuner */
+void
+tunerd_end(void)
+{
+  tune_end();
+  radio_end();
+}
+
+
+/************************/
+/* tunerd_worker_init() */
+/************************/
+/* once in each worker thread, after its sse_init() */
+/* return: 0 on success, -1 error */
+int
+tunerd_worker_init(void)
+{
+  /* no SSE listeners yet */
+  /*  a listener that falls behind only needs the newest frequency, */
+  /*  but every reload */
+  sse_topic_freq = sse_open("freq", SSE_LATEST);
+  sse_topic_tuning = sse_open("tuning", SSE_LATEST);
+  sse_topic_locked = sse_open("locked", SSE_LATEST);
+  sse_topic_reload = sse_open("reload", SSE_QUEUE);
+  sse_topic_scan = sse_open("scan", SSE_LATEST);
+  sse_topic_signal = sse_open("signal", SSE_LATEST);
+  if ((sse_topic_freq == (-1)) || (sse_topic_tuning == (-1)) ||
+   (sse_topic_locked == (-1)) || (sse_topic_reload == (-1)) ||
+   (sse_topic_scan == (-1)) || (sse_topic_signal == (-1))) {
+    return(-1);
+  }
 
   return(0);
 }
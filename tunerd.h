@@ -19,10 +19,22 @@
 #ifndef tunerd_h
 #define tunerd_h
 
-int tunerd_init(void);
+int tunerd_init(unsigned int in_sample_ms);
+
+int tunerd_worker_init(void);
+
+void tunerd_end(void);
 
 int get_freq(const char *, int);
 
+int get_events(const char *, int);
+
+int get_freq_wait(const char *, int);
+
 int post_preset(const char *, int);
 
+int post_scan(const char *, int);
+
+int get_signal_history(const char *, int);
+
 #endif
@@ -0,0 +1,437 @@
+/* watch_util.c */
+
+/*
+ * Copyright (c) 2017 Douglas Maus
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* directory watcher */
+/*  one thread waits for changes to the files in_want() picks, */
+/*  and once they have settled calls in_changed(), on that thread, */
+/*  so the work of a reload is kept off the event loops */
+/*  an editor's save is several events, a rename or a truncate */
+/*  and writes, they are taken together as one change */
+
+/* Feature test switches */
+/* #define _POSIX_C_SOURCE 200112L */
+ /* inotify and kqueue are not POSIX, */
+ /*  their headers need the system's default namespace */
+
+/* watcher selection, one of WATCH_INOTIFY, WATCH_KQUEUE, WATCH_STAT */
+#if !defined(WATCH_INOTIFY) && !defined(WATCH_KQUEUE) && !defined(WATCH_STAT)
+#if defined(__linux__)
+#define WATCH_INOTIFY
+#elif defined(__OpenBSD__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+      defined(__DragonFly__) || defined(__APPLE__)
+#define WATCH_KQUEUE
+#else
+#define WATCH_STAT
+#endif
+#endif
+#if defined(__linux__)
+#define _DEFAULT_SOURCE /* glibc hides the signal set functions under -std=c99 */
+#endif
+
+/* System headers */
+/* C language headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+/* POSIX headers */
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+/*  POSIX Issue 5 */
+#include <pthread.h>
+
+/* non POSIX headers */
+#if defined(WATCH_INOTIFY)
+#include <sys/inotify.h>
+#elif defined(WATCH_KQUEUE)
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+/* Local headers */
+#include "watch_util.h"
+
+/* Macros */
+/* quiet time, in milliseconds, before a change counts as done */
+#ifndef WATCH_SETTLE
+#define WATCH_SETTLE 200
+#endif
+
+/* between looks at the files, in milliseconds, stat() watcher only */
+#ifndef WATCH_INTERVAL
+#define WATCH_INTERVAL 2000
+#endif
+
+/* File scope variables */
+/*  set by watch_init(), then only used by the watcher thread */
+static char watch_dir[1024];
+static int (*watch_want)(const char *) = NULL;
+static void (*watch_changed)(void) = NULL;
+static pthread_t watch_tid;
+static int watch_running = 0;
+static int watch_pipe[2] = { -1, -1 }; /* written by watch_end() */
+static int watch_fd = -1;              /* inotify or kqueue, -1 for stat() */
+
+#if defined(WATCH_KQUEUE)
+/* a vnode is watched through a descriptor open on it */
+static int watch_dir_fd = -1;
+static int *watch_file_fd = NULL;
+static unsigned int watch_file_count = 0;
+#elif defined(WATCH_STAT)
+static unsigned long long watch_sum = 0; /* of names, sizes and times */
+#endif
+
+/* External variables */
+/* External functions */
+/* Structures and unions */
+/* Signal catching functions */
+
+
+/* Functions */
+
+
+#if defined(WATCH_KQUEUE)
+/*****************/
+/* watch_files() */
+/*****************/
+/* watch each file in_want() picks, for writes in place */
+/*  the directory's own watch sees files added, removed or renamed */
+static void
+watch_files(void)
+{
+struct kevent kev;
+struct dirent *e = NULL;
+DIR *d = NULL;
+int *t = NULL;
+char path[sizeof(watch_dir) + 256];
+unsigned int i = 0;
+int fd = 0;
+
+  /* closing a descriptor removes its events */
+  for (i = 0; i < watch_file_count; i++) {
+    close(watch_file_fd[i]);
+  }
+  watch_file_count = 0;
+
+  d = opendir(watch_dir);
+  if (d == NULL) {
+    fprintf(stderr, "watch_files: opendir() error %s\n", watch_dir);
+    return;
+  }
+
+  while ((e = readdir(d)) != NULL) {
+    if ((e->d_name[0] == '.') || !watch_want(e->d_name)) continue;
+
+    snprintf(path, sizeof(path), "%s/%s", watch_dir, e->d_name);
+    fd = open(path, O_RDONLY);
+    if (fd == (-1)) continue;
+
+    t = realloc(watch_file_fd, sizeof(int) * (watch_file_count + 1));
+    if (t == NULL) {
+      fprintf(stderr, "watch_files: realloc() error\n");
+      close(fd);
+      break;
+    }
+    watch_file_fd = t;
+
+    EV_SET(&kev, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+     NOTE_WRITE | NOTE_EXTEND | NOTE_DELETE | NOTE_RENAME, 0, NULL);
+    if (kevent(watch_fd, &kev, 1, NULL, 0, NULL) == (-1)) {
+      fprintf(stderr, "watch_files: kevent() error %s\n", path);
+      close(fd);
+      continue;
+    }
+    watch_file_fd[watch_file_count] = fd;
+    watch_file_count += 1;
+  }
+  closedir(d);
+}
+#endif
+
+
+#if defined(WATCH_STAT)
+/****************/
+/* watch_stat() */
+/****************/
+/* return: hash of the names, sizes and times of the files in_want() picks */
+static unsigned long long
+watch_stat(void)
+{
+unsigned long long h = 14695981039346656037ULL;
+unsigned long long v[2];
+struct dirent *e = NULL;
+struct stat st;
+DIR *d = NULL;
+char path[sizeof(watch_dir) + 256];
+const char *p = NULL;
+size_t i = 0;
+
+  d = opendir(watch_dir);
+  if (d == NULL) return(0);
+
+  /* FNV-1a, 64 bit */
+  while ((e = readdir(d)) != NULL) {
+    if ((e->d_name[0] == '.') || !watch_want(e->d_name)) continue;
+
+    snprintf(path, sizeof(path), "%s/%s", watch_dir, e->d_name);
+    if (stat(path, &st) == (-1)) continue;
+
+    v[0] = st.st_size;
+    v[1] = st.st_mtime;
+    for (p = e->d_name; *p != '\0'; p++) {
+      h ^= (unsigned char)*p;
+      h *= 1099511628211ULL;
+    }
+    for (i = 0; i < sizeof(v); i++) {
+      h ^= ((unsigned char *)v)[i];
+      h *= 1099511628211ULL;
+    }
+  }
+  closedir(d);
+
+  return(h);
+}
+#endif
+
+
+/*****************/
+/* watch_drain() */
+/*****************/
+/* take the changes waiting */
+/* return: 1 a file in_want() picks has changed, 0 none */
+static int
+watch_drain(void)
+{
+int changed = 0;
+
+#if defined(WATCH_INOTIFY)
+union {
+ struct inotify_event ev;
+ char buf[4096];
+} u;
+struct inotify_event *ev = NULL;
+ssize_t nr = 0;
+ssize_t i = 0;
+
+  while ((nr = read(watch_fd, u.buf, sizeof(u.buf))) > 0) {
+    for (i = 0; i < nr; i += sizeof(struct inotify_event) + ev->len) {
+      ev = (struct inotify_event *)&(u.buf[i]);
+      /* events were lost, any file may have changed */
+      if (ev->mask & IN_Q_OVERFLOW) changed = 1;
+      if ((ev->len > 0) && watch_want(ev->name)) changed = 1;
+    }
+  }
+#elif defined(WATCH_KQUEUE)
+struct kevent kev[16];
+struct timespec ts = { 0, 0 };
+
+  /* only the directory and picked files are watched */
+  while (kevent(watch_fd, NULL, 0, kev, 16, &ts) > 0) {
+    changed = 1;
+  }
+#else
+unsigned long long h = 0;
+
+  h = watch_stat();
+  if (h != watch_sum) {
+    watch_sum = h;
+    changed = 1;
+  }
+#endif
+
+  return(changed);
+}
+
+
+/******************/
+/* watch_thread() */
+/******************/
+/* thread start routine, waits for changes until watch_end() */
+static void *
+watch_thread(
+ void *in_arg)
+{
+struct pollfd pfd[2];
+nfds_t count = 1;
+int timeout = (-1);
+int n = 0;
+
+  pfd[0].fd = watch_pipe[0];
+  pfd[0].events = POLLIN;
+  if (watch_fd != (-1)) {
+    pfd[1].fd = watch_fd;
+    pfd[1].events = POLLIN;
+    count = 2;
+  } else {
+    timeout = WATCH_INTERVAL;
+  }
+
+  for (;;) {
+    pfd[0].revents = 0;
+    pfd[1].revents = 0;
+    n = poll(pfd, count, timeout);
+    if (n == (-1)) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "watch_thread: poll() error\n");
+      break;
+    }
+    if (pfd[0].revents != 0) break;
+    if (!watch_drain()) continue;
+
+    /* wait for the rest of the change, until it has been quiet */
+    while ((watch_fd != (-1)) && (poll(&(pfd[1]), 1, WATCH_SETTLE) > 0)) {
+      watch_drain();
+    }
+
+    watch_changed();
+
+#if defined(WATCH_KQUEUE)
+    /* files replaced since are new vnodes */
+    watch_files();
+#endif
+  }
+
+  return(NULL);
+}
+
+
+/****************/
+/* watch_init() */
+/****************/
+/* watch in_dir, calling in_changed() after any file of it */
+/*  that in_want() picks has changed */
+/*  once, before worker threads, so no signal reaches its thread */
+/* return: 0 on success, -1 error */
+int
+watch_init(
+ const char *in_dir,
+ int (*in_want)(const char *),
+ void (*in_changed)(void))
+{
+sigset_t block;
+sigset_t old;
+int status = 0;
+#if defined(WATCH_KQUEUE)
+struct kevent kev;
+#endif
+
+  if (watch_running) {
+    fprintf(stderr, "watch_init: repeat call\n");
+    return(-1);
+  }
+
+  snprintf(watch_dir, sizeof(watch_dir), "%s", in_dir);
+  watch_want = in_want;
+  watch_changed = in_changed;
+
+  if (pipe(watch_pipe) == (-1)) {
+    fprintf(stderr, "watch_init: pipe() error\n");
+    return(-1);
+  }
+
+#if defined(WATCH_INOTIFY)
+  watch_fd = inotify_init();
+  if (watch_fd == (-1)) {
+    fprintf(stderr, "watch_init: inotify_init() error\n");
+    return(-1);
+  }
+  fcntl(watch_fd, F_SETFL, fcntl(watch_fd, F_GETFL) | O_NONBLOCK);
+  /* files written in place, or put in place by rename */
+  if (inotify_add_watch(watch_fd, watch_dir,
+   IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) == (-1)) {
+    fprintf(stderr, "watch_init: inotify_add_watch() error %s\n", watch_dir);
+    return(-1);
+  }
+#elif defined(WATCH_KQUEUE)
+  watch_fd = kqueue();
+  if (watch_fd == (-1)) {
+    fprintf(stderr, "watch_init: kqueue() error\n");
+    return(-1);
+  }
+  watch_dir_fd = open(watch_dir, O_RDONLY);
+  if (watch_dir_fd == (-1)) {
+    fprintf(stderr, "watch_init: open() error %s\n", watch_dir);
+    return(-1);
+  }
+  EV_SET(&kev, watch_dir_fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE, 0, NULL);
+  if (kevent(watch_fd, &kev, 1, NULL, 0, NULL) == (-1)) {
+    fprintf(stderr, "watch_init: kevent() error %s\n", watch_dir);
+    return(-1);
+  }
+  watch_files();
+#else
+  watch_sum = watch_stat();
+#endif
+
+  /* SIGINT and SIGTERM are for the main thread */
+  sigemptyset(&block);
+  sigaddset(&block, SIGINT);
+  sigaddset(&block, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &block, &old);
+  status = pthread_create(&watch_tid, NULL, watch_thread, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (status != 0) {
+    fprintf(stderr, "watch_init: pthread_create() error\n");
+    return(-1);
+  }
+  watch_running = 1;
+
+  return(0);
+}
+
+
+/***************/
+/* watch_end() */
+/***************/
+/* stop watching, waits for a change in progress to be taken */
+void
+watch_end(void)
+{
+#if defined(WATCH_KQUEUE)
+unsigned int i = 0;
+#endif
+
+  if (watch_running) {
+    write(watch_pipe[1], "", 1);
+    pthread_join(watch_tid, NULL);
+    watch_running = 0;
+  }
+
+#if defined(WATCH_KQUEUE)
+  for (i = 0; i < watch_file_count; i++) {
+    close(watch_file_fd[i]);
+  }
+  free(watch_file_fd);
+  watch_file_fd = NULL;
+  watch_file_count = 0;
+  if (watch_dir_fd != (-1)) close(watch_dir_fd);
+  watch_dir_fd = -1;
+#endif
+  if (watch_fd != (-1)) close(watch_fd);
+  watch_fd = -1;
+  if (watch_pipe[0] != (-1)) close(watch_pipe[0]);
+  if (watch_pipe[1] != (-1)) close(watch_pipe[1]);
+  watch_pipe[0] = -1;
+  watch_pipe[1] = -1;
+}